@@ -0,0 +1,193 @@
+/*
+ * Threaded page fault benchmark for speculative page faults
+ *
+ * A number of threads repeatedly fault in a private anonymous region
+ * of their own and drop it again with MADV_DONTNEED, while one more
+ * thread keeps calling mmap() and munmap(), which take mmap_sem for
+ * writing.  Without CONFIG_SPECULATIVE_PAGE_FAULT every fault waits
+ * for those; with it most faults do not take mmap_sem at all.
+ *
+ * The program reports the faults per second of the faulting threads,
+ * the mmap()/munmap() pairs per second and how many faults the kernel
+ * handled speculatively, from speculative_pgfault in /proc/vmstat.
+ * Run it on kernels built with and without the option to compare.
+ *
+ *	spf-bench [-t threads] [-s seconds] [-m MB per thread] [-n]
+ *
+ * -n leaves out the mmap()/munmap() thread.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#ifndef MADV_DONTNEED
+#define MADV_DONTNEED 4
+#endif
+
+static volatile int stop;
+static unsigned long region_size = 16UL << 20;
+static long page_size;
+
+struct worker {
+	pthread_t thread;
+	unsigned long count;
+};
+
+static void *fault_thread(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long off;
+	char *p;
+
+	p = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	while (!stop) {
+		for (off = 0; off < region_size && !stop; off += page_size) {
+			p[off] = 1;
+			w->count++;
+		}
+		madvise(p, region_size, MADV_DONTNEED);
+	}
+
+	munmap(p, region_size);
+	return NULL;
+}
+
+static void *mmap_thread(void *arg)
+{
+	struct worker *w = arg;
+	char *p;
+
+	while (!stop) {
+		p = mmap(NULL, 4 * page_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		munmap(p, 4 * page_size);
+		w->count++;
+	}
+	return NULL;
+}
+
+/* speculative_pgfault from /proc/vmstat, -1 if the kernel has no such line */
+static long long read_spf_count(void)
+{
+	char name[64];
+	long long val, ret = -1;
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return -1;
+	while (fscanf(f, "%63s %lld", name, &val) == 2) {
+		if (!strcmp(name, "speculative_pgfault")) {
+			ret = val;
+			break;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+	int nr_threads = 4, seconds = 5, with_mmap = 1;
+	unsigned long faults = 0;
+	long long spf_start, spf_end;
+	struct worker *workers, mapper = { .count = 0 };
+	double start, elapsed;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "t:s:m:n")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'm':
+			region_size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'n':
+			with_mmap = 0;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-s seconds] "
+				"[-m MB per thread] [-n]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nr_threads < 1 || seconds < 1 || !region_size) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		return 1;
+	}
+
+	spf_start = read_spf_count();
+	start = now();
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, fault_thread,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	if (with_mmap && pthread_create(&mapper.thread, NULL, mmap_thread,
+					&mapper)) {
+		perror("pthread_create");
+		return 1;
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		faults += workers[i].count;
+	}
+	if (with_mmap)
+		pthread_join(mapper.thread, NULL);
+	elapsed = now() - start;
+	spf_end = read_spf_count();
+
+	printf("%d fault threads, %lu MB each, %s mmap/munmap thread\n",
+	       nr_threads, region_size >> 20, with_mmap ? "with" : "without");
+	printf("faults:        %lu (%.0f/s)\n", faults, faults / elapsed);
+	if (with_mmap)
+		printf("mmap/munmap:   %lu (%.0f/s)\n",
+		       mapper.count, mapper.count / elapsed);
+	if (spf_start < 0 || spf_end < 0)
+		printf("speculative:   not supported by this kernel\n");
+	else
+		printf("speculative:   %lld (%.1f%% of faults)\n",
+		       spf_end - spf_start,
+		       faults ? 100.0 * (spf_end - spf_start) / faults : 0.0);
+
+	free(workers);
+	return 0;
+}
@@ -180,6 +180,23 @@ static inline void blkio_update_group_iops(struct blkio_group *blkg,
 	}
 }
 
+static inline void blkio_update_group_latency_target(struct blkio_group *blkg,
+			unsigned int latency_target)
+{
+	struct blkio_policy_type *blkiop;
+
+	list_for_each_entry(blkiop, &blkio_list, list) {
+
+		/* If this policy does not own the blkg, do not send updates */
+		if (blkiop->plid != blkg->plid)
+			continue;
+
+		if (blkiop->ops.blkio_update_group_latency_target_fn)
+			blkiop->ops.blkio_update_group_latency_target_fn(
+					blkg->key, blkg, latency_target);
+	}
+}
+
 /*
  * Add to the appropriate stat variable depending on the request type.
  * This should be called with the blkg->stats_lock held.
@@ -856,6 +873,14 @@ static int blkio_policy_parse_and_set(char *buf,
 			break;
 		}
 		break;
+	case BLKIO_POLICY_LATENCY:
+		if (temp > UINT_MAX)
+			goto out;
+
+		newpn->plid = plid;
+		newpn->fileid = fileid;
+		newpn->val.latency_target = (unsigned int)temp;
+		break;
 	default:
 		BUG();
 	}
@@ -951,6 +976,25 @@ unsigned int blkcg_get_write_iops(struct blkio_cgroup *blkcg, dev_t dev)
 	return iops;
 }
 
+unsigned int blkcg_get_latency_target(struct blkio_cgroup *blkcg, dev_t dev)
+{
+	struct blkio_policy_node *pn;
+	unsigned long flags;
+	unsigned int latency_target;
+
+	spin_lock_irqsave(&blkcg->lock, flags);
+	pn = blkio_policy_search_node(blkcg, dev, BLKIO_POLICY_LATENCY,
+				BLKIO_LATENCY_target_device);
+	if (pn)
+		latency_target = pn->val.latency_target;
+	else
+		latency_target = blkcg->latency_target;
+	spin_unlock_irqrestore(&blkcg->lock, flags);
+
+	return latency_target;
+}
+EXPORT_SYMBOL_GPL(blkcg_get_latency_target);
+
 /* Checks whether user asked for deleting a policy rule */
 static bool blkio_delete_rule_command(struct blkio_policy_node *pn)
 {
@@ -972,6 +1016,10 @@ static bool blkio_delete_rule_command(struct blkio_policy_node *pn)
 				return 1;
 		}
 		break;
+	case BLKIO_POLICY_LATENCY:
+		if (pn->val.latency_target == 0)
+			return 1;
+		break;
 	default:
 		BUG();
 	}
@@ -997,6 +1045,9 @@ static void blkio_update_policy_rule(struct blkio_policy_node *oldpn,
 			oldpn->val.iops = newpn->val.iops;
 		}
 		break;
+	case BLKIO_POLICY_LATENCY:
+		oldpn->val.latency_target = newpn->val.latency_target;
+		break;
 	default:
 		BUG();
 	}
@@ -1009,7 +1060,7 @@ static void blkio_update_policy_rule(struct blkio_policy_node *oldpn,
 static void blkio_update_blkg_policy(struct blkio_cgroup *blkcg,
 		struct blkio_group *blkg, struct blkio_policy_node *pn)
 {
-	unsigned int weight, iops;
+	unsigned int weight, iops, latency_target;
 	u64 bps;
 
 	switch(pn->plid) {
@@ -1032,6 +1083,11 @@ static void blkio_update_blkg_policy(struct blkio_cgroup *blkcg,
 			break;
 		}
 		break;
+	case BLKIO_POLICY_LATENCY:
+		latency_target = pn->val.latency_target ?
+				pn->val.latency_target : blkcg->latency_target;
+		blkio_update_group_latency_target(blkg, latency_target);
+		break;
 	default:
 		BUG();
 	}
@@ -1143,6 +1199,11 @@ blkio_print_policy_node(struct seq_file *m, struct blkio_policy_node *pn)
 				break;
 			}
 			break;
+		case BLKIO_POLICY_LATENCY:
+			if (pn->fileid == BLKIO_LATENCY_target_device)
+				seq_printf(m, "%u:%u\t%u\n", MAJOR(pn->dev),
+					MINOR(pn->dev), pn->val.latency_target);
+			break;
 		default:
 			BUG();
 	}
@@ -1196,6 +1257,15 @@ static int blkiocg_file_read(struct cgroup *cgrp, struct cftype *cft,
 			BUG();
 		}
 		break;
+	case BLKIO_POLICY_LATENCY:
+		switch(name) {
+		case BLKIO_LATENCY_target_device:
+			blkio_read_policy_node_files(cft, blkcg, m);
+			return 0;
+		default:
+			BUG();
+		}
+		break;
 	default:
 		BUG();
 	}
@@ -1306,6 +1376,18 @@ static int blkiocg_file_read_map(struct cgroup *cgrp, struct cftype *cft,
 			BUG();
 		}
 		break;
+	case BLKIO_POLICY_LATENCY:
+		switch(name) {
+		case BLKIO_LATENCY_io_service_bytes:
+			return blkio_read_blkg_stats(blkcg, cft, cb,
+						BLKIO_STAT_CPU_SERVICE_BYTES, 1, 1);
+		case BLKIO_LATENCY_io_serviced:
+			return blkio_read_blkg_stats(blkcg, cft, cb,
+						BLKIO_STAT_CPU_SERVICED, 1, 1);
+		default:
+			BUG();
+		}
+		break;
 	default:
 		BUG();
 	}
@@ -1339,6 +1421,35 @@ static int blkio_weight_write(struct blkio_cgroup *blkcg, u64 val)
 	return 0;
 }
 
+static int blkio_latency_target_write(struct blkio_cgroup *blkcg, u64 val)
+{
+	struct blkio_group *blkg;
+	struct hlist_node *n;
+	struct blkio_policy_node *pn;
+
+	if (val > UINT_MAX)
+		return -EINVAL;
+
+	spin_lock(&blkio_list_lock);
+	spin_lock_irq(&blkcg->lock);
+	blkcg->latency_target = (unsigned int)val;
+
+	hlist_for_each_entry(blkg, n, &blkcg->blkg_list, blkcg_node) {
+		if (blkg->plid != BLKIO_POLICY_LATENCY)
+			continue;
+
+		pn = blkio_policy_search_node(blkcg, blkg->dev,
+				BLKIO_POLICY_LATENCY, BLKIO_LATENCY_target_device);
+		if (pn)
+			continue;
+
+		blkio_update_group_latency_target(blkg, blkcg->latency_target);
+	}
+	spin_unlock_irq(&blkcg->lock);
+	spin_unlock(&blkio_list_lock);
+	return 0;
+}
+
 static u64 blkiocg_file_read_u64 (struct cgroup *cgrp, struct cftype *cft) {
 	struct blkio_cgroup *blkcg;
 	enum blkio_policy_id plid = BLKIOFILE_POLICY(cft->private);
@@ -1353,6 +1464,12 @@ static u64 blkiocg_file_read_u64 (struct cgroup *cgrp, struct cftype *cft) {
 			return (u64)blkcg->weight;
 		}
 		break;
+	case BLKIO_POLICY_LATENCY:
+		switch(name) {
+		case BLKIO_LATENCY_target:
+			return (u64)blkcg->latency_target;
+		}
+		break;
 	default:
 		BUG();
 	}
@@ -1375,6 +1492,12 @@ blkiocg_file_write_u64(struct cgroup *cgrp, struct cftype *cft, u64 val)
 			return blkio_weight_write(blkcg, val);
 		}
 		break;
+	case BLKIO_POLICY_LATENCY:
+		switch(name) {
+		case BLKIO_LATENCY_target:
+			return blkio_latency_target_write(blkcg, val);
+		}
+		break;
 	default:
 		BUG();
 	}
@@ -1500,6 +1623,36 @@ struct cftype blkio_files[] = {
 	},
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
+#if IS_ENABLED(CONFIG_IOSCHED_DEADLINE_CG)
+	{
+		.name = "latency.target",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_LATENCY,
+				BLKIO_LATENCY_target),
+		.read_u64 = blkiocg_file_read_u64,
+		.write_u64 = blkiocg_file_write_u64,
+	},
+	{
+		.name = "latency.target_device",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_LATENCY,
+				BLKIO_LATENCY_target_device),
+		.read_seq_string = blkiocg_file_read,
+		.write_string = blkiocg_file_write,
+		.max_write_len = 256,
+	},
+	{
+		.name = "latency.io_service_bytes",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_LATENCY,
+				BLKIO_LATENCY_io_service_bytes),
+		.read_map = blkiocg_file_read_map,
+	},
+	{
+		.name = "latency.io_serviced",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_LATENCY,
+				BLKIO_LATENCY_io_serviced),
+		.read_map = blkiocg_file_read_map,
+	},
+#endif /* CONFIG_IOSCHED_DEADLINE_CG */
+
 #ifdef CONFIG_DEBUG_BLK_CGROUP
 	{
 		.name = "avg_queue_size",
@@ -69,8 +69,10 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/gfp.h>
+#include <linux/blk-mq.h>
 
 #include "blk.h"
+#include "blk-mq.h"
 
 /* FLUSH/FUA sequences */
 enum {
@@ -112,6 +114,26 @@ static unsigned int blk_flush_cur_seq(struct request *rq)
 	return 1 << ffz(rq->flush.seq);
 }
 
+/*
+ * Hand @rq over for dispatch.  Legacy queues get it on the dispatch list
+ * directly.  blk-mq queues may be called here from completion context, so
+ * park it on ->queue_head (unused otherwise for them) and let kblockd
+ * insert it into the hardware queues.
+ */
+static void blk_flush_queue_rq(struct request *rq, bool add_front)
+{
+	struct request_queue *q = rq->q;
+
+	if (q->mq_ops) {
+		list_add_tail(&rq->queuelist, &q->queue_head);
+		kblockd_schedule_work(q, &q->mq_flush_work);
+	} else if (add_front) {
+		list_add(&rq->queuelist, &q->queue_head);
+	} else {
+		list_add_tail(&rq->queuelist, &q->queue_head);
+	}
+}
+
 static void blk_flush_restore_request(struct request *rq)
 {
 	/*
@@ -167,7 +189,7 @@ static bool blk_flush_complete_seq(struct request *rq, unsigned int seq,
 
 	case REQ_FSEQ_DATA:
 		list_move_tail(&rq->flush.list, &q->flush_data_in_flight);
-		list_add(&rq->queuelist, &q->queue_head);
+		blk_flush_queue_rq(rq, true);
 		queued = true;
 		break;
 
@@ -181,7 +203,10 @@ static bool blk_flush_complete_seq(struct request *rq, unsigned int seq,
 		BUG_ON(!list_empty(&rq->queuelist));
 		list_del_init(&rq->flush.list);
 		blk_flush_restore_request(rq);
-		__blk_end_request_all(rq, error);
+		if (q->mq_ops)
+			blk_mq_end_io(rq, error);
+		else
+			__blk_end_request_all(rq, error);
 		break;
 
 	default:
@@ -194,15 +219,21 @@ static bool blk_flush_complete_seq(struct request *rq, unsigned int seq,
 static void flush_end_io(struct request *flush_rq, int error)
 {
 	struct request_queue *q = flush_rq->q;
-	struct list_head *running = &q->flush_queue[q->flush_running_idx];
+	struct list_head *running;
 	bool queued = false;
 	struct request *rq, *n;
+	unsigned long flags = 0;
+
+	if (q->mq_ops)
+		spin_lock_irqsave(q->queue_lock, flags);
 
+	running = &q->flush_queue[q->flush_running_idx];
 	BUG_ON(q->flush_pending_idx == q->flush_running_idx);
 
 	/* account completion of the flush request */
 	q->flush_running_idx ^= 1;
-	elv_completed_request(q, flush_rq);
+	if (!q->mq_ops)
+		elv_completed_request(q, flush_rq);
 
 	/* and push the waiting requests to the next stage */
 	list_for_each_entry_safe(rq, n, running, flush.list) {
@@ -223,6 +254,11 @@ static void flush_end_io(struct request *flush_rq, int error)
 	 * directly into request_fn may confuse the driver.  Always use
 	 * kblockd.
 	 */
+	if (q->mq_ops) {
+		spin_unlock_irqrestore(q->queue_lock, flags);
+		return;
+	}
+
 	if (queued || q->flush_queue_delayed)
 		blk_run_queue_async(q);
 	q->flush_queue_delayed = 0;
@@ -246,6 +282,7 @@ static bool blk_kick_flush(struct request_queue *q)
 	struct list_head *pending = &q->flush_queue[q->flush_pending_idx];
 	struct request *first_rq =
 		list_first_entry(pending, struct request, flush.list);
+	struct request *flush_rq = q->mq_ops ? q->mq_flush_rq : &q->flush_rq;
 
 	/* C1 described at the top of this file */
 	if (q->flush_pending_idx != q->flush_running_idx || list_empty(pending))
@@ -261,14 +298,22 @@ static bool blk_kick_flush(struct request_queue *q)
 	 * Issue flush and toggle pending_idx.  This makes pending_idx
 	 * different from running_idx, which means flush is in flight.
 	 */
-	blk_rq_init(q, &q->flush_rq);
-	q->flush_rq.cmd_type = REQ_TYPE_FS;
-	q->flush_rq.cmd_flags = WRITE_FLUSH | REQ_FLUSH_SEQ;
-	q->flush_rq.rq_disk = first_rq->rq_disk;
-	q->flush_rq.end_io = flush_end_io;
+	blk_rq_init(q, flush_rq);
+	if (q->mq_ops) {
+		/*
+		 * Borrow the tag of the first waiting request, which can't
+		 * be in flight while it waits for this flush.
+		 */
+		flush_rq->mq_ctx = first_rq->mq_ctx;
+		flush_rq->tag = first_rq->tag;
+	}
+	flush_rq->cmd_type = REQ_TYPE_FS;
+	flush_rq->cmd_flags = WRITE_FLUSH | REQ_FLUSH_SEQ;
+	flush_rq->rq_disk = first_rq->rq_disk;
+	flush_rq->end_io = flush_end_io;
 
 	q->flush_pending_idx ^= 1;
-	list_add_tail(&q->flush_rq.queuelist, &q->queue_head);
+	blk_flush_queue_rq(flush_rq, false);
 	return true;
 }
 
@@ -284,6 +329,17 @@ static void flush_data_end_io(struct request *rq, int error)
 		blk_run_queue_async(q);
 }
 
+static void mq_flush_data_end_io(struct request *rq, int error)
+{
+	struct request_queue *q = rq->q;
+	unsigned long flags;
+
+	/* blk-mq completes without the queue lock, flush state needs it */
+	spin_lock_irqsave(q->queue_lock, flags);
+	blk_flush_complete_seq(rq, REQ_FSEQ_DATA, error);
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
 /**
  * blk_insert_flush - insert a new FLUSH/FUA request
  * @rq: request to insert
@@ -316,7 +372,10 @@ void blk_insert_flush(struct request *rq)
 	 * complete the request.
 	 */
 	if (!policy) {
-		__blk_end_bidi_request(rq, 0, 0, 0);
+		if (q->mq_ops)
+			blk_mq_end_io(rq, 0);
+		else
+			__blk_end_bidi_request(rq, 0, 0, 0);
 		return;
 	}
 
@@ -329,7 +388,7 @@ void blk_insert_flush(struct request *rq)
 	 */
 	if ((policy & REQ_FSEQ_DATA) &&
 	    !(policy & (REQ_FSEQ_PREFLUSH | REQ_FSEQ_POSTFLUSH))) {
-		list_add_tail(&rq->queuelist, &q->queue_head);
+		blk_flush_queue_rq(rq, false);
 		return;
 	}
 
@@ -341,7 +400,10 @@ void blk_insert_flush(struct request *rq)
 	INIT_LIST_HEAD(&rq->flush.list);
 	rq->cmd_flags |= REQ_FLUSH_SEQ;
 	rq->flush.saved_end_io = rq->end_io; /* Usually NULL */
-	rq->end_io = flush_data_end_io;
+	if (q->mq_ops)
+		rq->end_io = mq_flush_data_end_io;
+	else
+		rq->end_io = flush_data_end_io;
 
 	blk_flush_complete_seq(rq, REQ_FSEQ_ACTIONS & ~policy, 0);
 }
@@ -384,6 +446,45 @@ void blk_abort_flushes(struct request_queue *q)
 	}
 }
 
+static void mq_flush_work(struct work_struct *work)
+{
+	struct request_queue *q;
+	struct request *rq;
+	LIST_HEAD(list);
+
+	q = container_of(work, struct request_queue, mq_flush_work);
+
+	spin_lock_irq(q->queue_lock);
+	list_splice_init(&q->queue_head, &list);
+	spin_unlock_irq(q->queue_lock);
+
+	while (!list_empty(&list)) {
+		rq = list_entry_rq(list.next);
+		list_del_init(&rq->queuelist);
+		blk_mq_insert_request(q, rq, true, true);
+	}
+}
+
+/**
+ * blk_mq_init_flush - set up flush sequencing for a blk-mq queue
+ * @q: request_queue being initialized
+ *
+ * blk-mq requests carry driver data behind them, so the flush request
+ * can't be the one embedded in @q.  Allocate one with room for the
+ * driver's per-request data.
+ */
+int blk_mq_init_flush(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx = q->queue_hw_ctx[0];
+
+	INIT_WORK(&q->mq_flush_work, mq_flush_work);
+	q->mq_flush_rq = kzalloc_node(sizeof(struct request) + hctx->cmd_size,
+				      GFP_KERNEL, q->node);
+	if (!q->mq_flush_rq)
+		return -ENOMEM;
+	return 0;
+}
+
 static void bio_end_flush(struct bio *bio, int err)
 {
 	if (err)
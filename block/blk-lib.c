@@ -6,6 +6,7 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/scatterlist.h>
+#include <linux/slab.h>
 
 #include "blk.h"
 
@@ -26,6 +27,23 @@ static void bio_batch_end_io(struct bio *bio, int err)
 	bio_put(bio);
 }
 
+/*
+ * Largest discard we may put in one bio, rounded down to the discard
+ * granularity.  Zero means the device cannot take discards at all.
+ */
+static unsigned int blk_discard_max_sectors(struct request_queue *q)
+{
+	unsigned int max_discard_sectors;
+
+	max_discard_sectors = min(q->limits.max_discard_sectors, UINT_MAX >> 9);
+	if (max_discard_sectors && q->limits.discard_granularity) {
+		unsigned int disc_sects = q->limits.discard_granularity >> 9;
+
+		max_discard_sectors &= ~(disc_sects - 1);
+	}
+	return max_discard_sectors;
+}
+
 /**
  * blkdev_issue_discard - queue a discard
  * @bdev:	blockdev to issue discard for
@@ -54,18 +72,10 @@ int blkdev_issue_discard(struct block_device *bdev, sector_t sector,
 	if (!blk_queue_discard(q))
 		return -EOPNOTSUPP;
 
-	/*
-	 * Ensure that max_discard_sectors is of the proper
-	 * granularity
-	 */
-	max_discard_sectors = min(q->limits.max_discard_sectors, UINT_MAX >> 9);
+	max_discard_sectors = blk_discard_max_sectors(q);
 	if (unlikely(!max_discard_sectors)) {
 		/* Avoid infinite loop below. Being cautious never hurts. */
 		return -EOPNOTSUPP;
-	} else if (q->limits.discard_granularity) {
-		unsigned int disc_sects = q->limits.discard_granularity >> 9;
-
-		max_discard_sectors &= ~(disc_sects - 1);
 	}
 
 	if (flags & BLKDEV_DISCARD_SECURE) {
@@ -114,6 +124,404 @@ int blkdev_issue_discard(struct block_device *bdev, sector_t sector,
 }
 EXPORT_SYMBOL(blkdev_issue_discard);
 
+/*
+ * Asynchronous discard.
+ *
+ * blkdev_queue_discard() only records the range and returns.  Ranges are
+ * kept per queue in an rbtree sorted by absolute start sector; since
+ * overlapping and adjacent ranges are merged on insert the tree never holds
+ * intersecting entries, which is all the interval lookups below need.  The
+ * worker waits BLK_DISCARD_DELAY after the first queued range so that
+ * extents freed by consecutive journal commits get a chance to coalesce,
+ * then issues them in sector order.  With a rate limit set it sends at
+ * most one BLK_DISCARD_SLICE worth of that rate per run and reschedules.
+ *
+ * A caller about to reuse sectors it queued must call
+ * blkdev_cancel_discard() first: the pending part is dropped and any
+ * overlapping discard already in flight is waited for, so the new data
+ * cannot be overtaken by a stale discard.
+ */
+#define BLK_DISCARD_DELAY	HZ
+#define BLK_DISCARD_SLICE	(HZ / 10 ? HZ / 10 : 1)
+
+struct blk_discard_range {
+	struct rb_node		rb_node;	/* in ->pending */
+	struct list_head	list;		/* in ->inflight */
+	struct blk_async_discard *ad;
+	sector_t		sector;
+	sector_t		nr_sects;
+};
+
+static inline sector_t blk_discard_end(struct blk_discard_range *r)
+{
+	return r->sector + r->nr_sects;
+}
+
+static void blk_discard_free(struct blk_async_discard *ad,
+			     struct blk_discard_range *r)
+{
+	if (!--ad->nr_ranges)
+		ad->bdev = NULL;
+	kfree(r);
+}
+
+/* Pending range with the highest start sector not above @sector. */
+static struct blk_discard_range *
+blk_discard_lookup(struct blk_async_discard *ad, sector_t sector)
+{
+	struct rb_node *n = ad->pending.rb_node;
+	struct blk_discard_range *r, *ret = NULL;
+
+	while (n) {
+		r = rb_entry(n, struct blk_discard_range, rb_node);
+		if (r->sector <= sector) {
+			ret = r;
+			n = n->rb_right;
+		} else
+			n = n->rb_left;
+	}
+	return ret;
+}
+
+/*
+ * Add @new to the pending tree, merging it with whatever it touches.
+ * Returns false if @new was folded into an existing range and is unused.
+ */
+static bool blk_discard_insert(struct blk_async_discard *ad,
+			       struct blk_discard_range *new)
+{
+	struct rb_node **p = &ad->pending.rb_node, *parent = NULL, *n;
+	struct blk_discard_range *r, *next;
+	sector_t end = blk_discard_end(new);
+	bool used = false;
+
+	r = blk_discard_lookup(ad, new->sector);
+	if (r && blk_discard_end(r) >= new->sector) {
+		if (end > blk_discard_end(r))
+			r->nr_sects = end - r->sector;
+	} else {
+		while (*p) {
+			parent = *p;
+			next = rb_entry(parent, struct blk_discard_range,
+					rb_node);
+			if (new->sector < next->sector)
+				p = &parent->rb_left;
+			else
+				p = &parent->rb_right;
+		}
+		rb_link_node(&new->rb_node, parent, p);
+		rb_insert_color(&new->rb_node, &ad->pending);
+		ad->nr_ranges++;
+		r = new;
+		used = true;
+	}
+
+	/* the grown range may now reach its successors */
+	while ((n = rb_next(&r->rb_node))) {
+		next = rb_entry(n, struct blk_discard_range, rb_node);
+		if (next->sector > blk_discard_end(r))
+			break;
+		end = max(blk_discard_end(r), blk_discard_end(next));
+		r->nr_sects = end - r->sector;
+		rb_erase(n, &ad->pending);
+		blk_discard_free(ad, next);
+	}
+	return used;
+}
+
+static bool blk_discard_inflight(struct blk_async_discard *ad,
+				 sector_t sector, sector_t end)
+{
+	struct blk_discard_range *r;
+	bool ret = false;
+
+	spin_lock_irq(&ad->lock);
+	list_for_each_entry(r, &ad->inflight, list) {
+		if (r->sector < end && blk_discard_end(r) > sector) {
+			ret = true;
+			break;
+		}
+	}
+	spin_unlock_irq(&ad->lock);
+	return ret;
+}
+
+static void blk_discard_end_io(struct bio *bio, int err)
+{
+	struct blk_discard_range *r = bio->bi_private;
+	struct blk_async_discard *ad = r->ad;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ad->lock, flags);
+	list_del(&r->list);
+	blk_discard_free(ad, r);
+	spin_unlock_irqrestore(&ad->lock, flags);
+
+	wake_up_all(&ad->wait);
+	bio_put(bio);
+}
+
+/*
+ * Issue pending discards from the lowest sector up, at most @budget
+ * sectors of them.  Whatever is left is picked up by the worker.
+ */
+static void blk_discard_issue(struct request_queue *q, sector_t budget)
+{
+	struct blk_async_discard *ad = &q->async_discard;
+	unsigned int max_sectors = blk_discard_max_sectors(q);
+	unsigned int gran = max(q->limits.discard_granularity >> 9, 1U);
+	struct blk_discard_range *r, *slice;
+	struct block_device *bdev;
+	struct rb_node *n;
+	struct bio *bio;
+	sector_t nr;
+
+	spin_lock_irq(&ad->lock);
+	while (budget && (n = rb_first(&ad->pending))) {
+		r = rb_entry(n, struct blk_discard_range, rb_node);
+
+		if (unlikely(!max_sectors)) {
+			/* the device stopped accepting discards */
+			rb_erase(n, &ad->pending);
+			blk_discard_free(ad, r);
+			continue;
+		}
+
+		nr = min_t(sector_t, r->nr_sects, max_sectors);
+		nr = min(nr, budget);
+		if (nr < r->nr_sects) {
+			nr = max_t(sector_t, nr & ~(sector_t)(gran - 1),
+				   min_t(sector_t, gran, r->nr_sects));
+		}
+
+		if (nr < r->nr_sects) {
+			slice = kmalloc(sizeof(*slice), GFP_ATOMIC);
+			if (!slice)
+				break;
+			slice->ad = ad;
+			slice->sector = r->sector;
+			slice->nr_sects = nr;
+			r->sector += nr;
+			r->nr_sects -= nr;
+			ad->nr_ranges++;
+		} else {
+			rb_erase(n, &ad->pending);
+			slice = r;
+		}
+		list_add_tail(&slice->list, &ad->inflight);
+		bdev = ad->bdev;
+		budget -= min(budget, nr);
+		spin_unlock_irq(&ad->lock);
+
+		bio = bio_alloc(GFP_NOIO, 1);
+		bio->bi_sector = slice->sector;
+		bio->bi_size = nr << 9;
+		bio->bi_bdev = bdev;
+		bio->bi_end_io = blk_discard_end_io;
+		bio->bi_private = slice;
+		submit_bio(REQ_WRITE | REQ_DISCARD, bio);
+
+		spin_lock_irq(&ad->lock);
+	}
+	if (!RB_EMPTY_ROOT(&ad->pending))
+		kblockd_schedule_delayed_work(q, &ad->work, BLK_DISCARD_SLICE);
+	spin_unlock_irq(&ad->lock);
+}
+
+static void blk_discard_work(struct work_struct *work)
+{
+	struct request_queue *q = container_of(work, struct request_queue,
+					       async_discard.work.work);
+	unsigned int rate_kb = ACCESS_ONCE(q->async_discard.rate_kb);
+	sector_t budget = ~(sector_t)0;
+
+	if (rate_kb) {
+		budget = (sector_t)rate_kb * 2 * BLK_DISCARD_SLICE / HZ;
+		budget = max_t(sector_t, budget, 1);
+	}
+	blk_discard_issue(q, budget);
+}
+
+/**
+ * blkdev_queue_discard - queue a discard to be issued in the background
+ * @bdev:	blockdev to issue discard for
+ * @sector:	start sector
+ * @nr_sects:	number of sectors to discard
+ * @gfp_mask:	memory allocation flags
+ *
+ * Description:
+ *    Record the sectors in question for discard and return without waiting.
+ *    Neighbouring queued ranges are merged and sent later by the queue's
+ *    discard worker, subject to the queue's discard_async_rate_kb limit.
+ *    The caller must use blkdev_cancel_discard() before writing to any of
+ *    these sectors again.
+ */
+int blkdev_queue_discard(struct block_device *bdev, sector_t sector,
+		sector_t nr_sects, gfp_t gfp_mask)
+{
+	struct request_queue *q = bdev_get_queue(bdev);
+	struct blk_async_discard *ad;
+	struct blk_discard_range *r;
+	bool used;
+
+	if (!q)
+		return -ENXIO;
+
+	if (!blk_queue_discard(q) || !blk_discard_max_sectors(q))
+		return -EOPNOTSUPP;
+
+	if (!nr_sects)
+		return 0;
+
+	ad = &q->async_discard;
+	r = kmalloc(sizeof(*r), gfp_mask);
+	if (!r)
+		return -ENOMEM;
+	r->ad = ad;
+	r->sector = sector + get_start_sect(bdev);
+	r->nr_sects = nr_sects;
+
+	spin_lock_irq(&ad->lock);
+	ad->bdev = bdev->bd_contains;
+	used = blk_discard_insert(ad, r);
+	kblockd_schedule_delayed_work(q, &ad->work, BLK_DISCARD_DELAY);
+	spin_unlock_irq(&ad->lock);
+
+	if (!used)
+		kfree(r);
+	return 0;
+}
+EXPORT_SYMBOL(blkdev_queue_discard);
+
+/**
+ * blkdev_cancel_discard - make sectors safe to write after a queued discard
+ * @bdev:	blockdev the discard was queued for
+ * @sector:	start sector
+ * @nr_sects:	number of sectors about to be reused
+ *
+ * Description:
+ *    Drop the part of any queued discard that falls inside the given range
+ *    and wait for overlapping discards that were already submitted.  Cheap
+ *    when nothing is queued on the device.  May sleep.
+ */
+void blkdev_cancel_discard(struct block_device *bdev, sector_t sector,
+		sector_t nr_sects)
+{
+	struct request_queue *q = bdev_get_queue(bdev);
+	struct blk_discard_range *r, *tail;
+	struct blk_async_discard *ad;
+	struct rb_node *n;
+	sector_t end;
+
+	if (!q)
+		return;
+
+	ad = &q->async_discard;
+	if (!ACCESS_ONCE(ad->nr_ranges))
+		return;
+
+	sector += get_start_sect(bdev);
+	end = sector + nr_sects;
+
+	spin_lock_irq(&ad->lock);
+	r = blk_discard_lookup(ad, sector);
+	n = r ? &r->rb_node : rb_first(&ad->pending);
+	while (n) {
+		r = rb_entry(n, struct blk_discard_range, rb_node);
+		if (r->sector >= end)
+			break;
+		n = rb_next(n);
+		if (blk_discard_end(r) <= sector)
+			continue;
+
+		if (r->sector < sector) {
+			if (blk_discard_end(r) > end) {
+				/*
+				 * Split.  If that fails the tail is simply
+				 * never discarded, which is always safe.
+				 */
+				tail = kmalloc(sizeof(*tail), GFP_ATOMIC);
+				if (tail) {
+					tail->ad = ad;
+					tail->sector = end;
+					tail->nr_sects = blk_discard_end(r) - end;
+				}
+				r->nr_sects = sector - r->sector;
+				if (tail)
+					blk_discard_insert(ad, tail);
+			} else
+				r->nr_sects = sector - r->sector;
+		} else if (blk_discard_end(r) > end) {
+			r->nr_sects = blk_discard_end(r) - end;
+			r->sector = end;
+		} else {
+			rb_erase(&r->rb_node, &ad->pending);
+			blk_discard_free(ad, r);
+		}
+	}
+	spin_unlock_irq(&ad->lock);
+
+	wait_event(ad->wait, !blk_discard_inflight(ad, sector, end));
+}
+EXPORT_SYMBOL(blkdev_cancel_discard);
+
+static bool blk_discard_idle(struct blk_async_discard *ad)
+{
+	bool ret;
+
+	spin_lock_irq(&ad->lock);
+	ret = list_empty(&ad->inflight);
+	spin_unlock_irq(&ad->lock);
+	return ret;
+}
+
+/**
+ * blkdev_flush_discards - issue queued discards and wait for them
+ * @bdev:	blockdev to flush
+ *
+ * Description:
+ *    Send everything queued on @bdev's queue right away, ignoring the rate
+ *    limit, and wait until it has completed.  Filesystems call this before
+ *    they stop using the device, e.g. at unmount or freeze.
+ */
+void blkdev_flush_discards(struct block_device *bdev)
+{
+	struct request_queue *q = bdev_get_queue(bdev);
+
+	if (!q || !ACCESS_ONCE(q->async_discard.nr_ranges))
+		return;
+
+	blk_discard_issue(q, ~(sector_t)0);
+	wait_event(q->async_discard.wait, blk_discard_idle(&q->async_discard));
+}
+EXPORT_SYMBOL(blkdev_flush_discards);
+
+void blk_async_discard_init(struct request_queue *q)
+{
+	struct blk_async_discard *ad = &q->async_discard;
+
+	spin_lock_init(&ad->lock);
+	ad->pending = RB_ROOT;
+	INIT_LIST_HEAD(&ad->inflight);
+	init_waitqueue_head(&ad->wait);
+	INIT_DELAYED_WORK(&ad->work, blk_discard_work);
+}
+
+/* Called on queue release; whatever is still pending is dropped. */
+void blk_async_discard_exit(struct request_queue *q)
+{
+	struct blk_async_discard *ad = &q->async_discard;
+	struct blk_discard_range *r;
+	struct rb_node *n;
+
+	while ((n = rb_first(&ad->pending))) {
+		r = rb_entry(n, struct blk_discard_range, rb_node);
+		rb_erase(n, &ad->pending);
+		blk_discard_free(ad, r);
+	}
+	WARN_ON(!list_empty(&ad->inflight));
+}
+
 /**
  * blkdev_issue_zeroout - generate number of zero filed write bios
  * @bdev:	blockdev to issue
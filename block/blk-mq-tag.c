@@ -0,0 +1,296 @@
+/*
+ * Tag allocation for blk-mq
+ *
+ * Free tags live in a global pool and in small per-cpu caches.  Allocation
+ * and freeing normally only touch the cache of the local cpu; tags move
+ * between the caches and the pool in batches, so the shared cacheline is
+ * hit once every batch_move requests instead of once per request.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/blkdev.h>
+
+#include "blk-mq-tag.h"
+
+/*
+ * Don't bother with per-cpu caches smaller than this, stealing tags back
+ * and forth would cost more than the global lock.
+ */
+#define BLK_MQ_TAG_CACHE_MIN	4
+
+static inline void move_tags(unsigned int *dst, unsigned int *dst_nr,
+			     unsigned int *src, unsigned int *src_nr,
+			     unsigned int nr)
+{
+	*src_nr -= nr;
+	memcpy(dst + *dst_nr, src + *src_nr, sizeof(unsigned int) * nr);
+	*dst_nr += nr;
+}
+
+/*
+ * Give the cache of some other cpu back to the global pool.  Called with
+ * interrupts disabled and no tag locks held.
+ */
+static void steal_tags(struct blk_mq_tags *tags)
+{
+	unsigned int cpus_have_tags, cpu = tags->cpu_last_stolen;
+	struct blk_mq_tag_cpu *remote;
+
+	for (cpus_have_tags = cpumask_weight(&tags->cpus_have_tags);
+	     cpus_have_tags; cpus_have_tags--) {
+		cpu = cpumask_next(cpu, &tags->cpus_have_tags);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(&tags->cpus_have_tags);
+		if (cpu >= nr_cpu_ids)
+			break;
+
+		tags->cpu_last_stolen = cpu;
+		remote = per_cpu_ptr(tags->tag_cpu, cpu);
+		cpumask_clear_cpu(cpu, &tags->cpus_have_tags);
+
+		spin_lock(&remote->lock);
+		if (remote->nr_free) {
+			spin_lock(&tags->lock);
+			move_tags(tags->freelist, &tags->nr_free,
+				  remote->freelist, &remote->nr_free,
+				  remote->nr_free);
+			spin_unlock(&tags->lock);
+			spin_unlock(&remote->lock);
+			return;
+		}
+		spin_unlock(&remote->lock);
+	}
+}
+
+static unsigned int __blk_mq_get_tag_global(struct blk_mq_tags *tags)
+{
+	unsigned int tag = BLK_MQ_TAG_FAIL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&tags->lock, flags);
+	if (tags->nr_free)
+		tag = tags->freelist[--tags->nr_free];
+	spin_unlock_irqrestore(&tags->lock, flags);
+
+	return tag;
+}
+
+static unsigned int __blk_mq_get_tag(struct blk_mq_tags *tags)
+{
+	struct blk_mq_tag_cpu *tcpu;
+	unsigned int tag = BLK_MQ_TAG_FAIL;
+	unsigned long flags;
+	int stolen = 0;
+
+	if (!tags->max_cache)
+		return __blk_mq_get_tag_global(tags);
+
+	local_irq_save(flags);
+again:
+	tcpu = this_cpu_ptr(tags->tag_cpu);
+	spin_lock(&tcpu->lock);
+
+	if (!tcpu->nr_free) {
+		spin_lock(&tags->lock);
+		move_tags(tcpu->freelist, &tcpu->nr_free,
+			  tags->freelist, &tags->nr_free,
+			  min(tags->nr_free, tags->batch_move));
+		spin_unlock(&tags->lock);
+	}
+
+	if (tcpu->nr_free) {
+		tag = tcpu->freelist[--tcpu->nr_free];
+		if (tcpu->nr_free)
+			cpumask_set_cpu(smp_processor_id(),
+					&tags->cpus_have_tags);
+	}
+	spin_unlock(&tcpu->lock);
+
+	if (tag == BLK_MQ_TAG_FAIL && !stolen++) {
+		steal_tags(tags);
+		goto again;
+	}
+	local_irq_restore(flags);
+
+	return tag;
+}
+
+/**
+ * blk_mq_get_tag - allocate a tag
+ * @tags:	the tag set
+ * @gfp:	if __GFP_WAIT is set, sleep until a tag is available
+ *
+ * Description:
+ *    Returns a tag in [0, nr_tags), or %BLK_MQ_TAG_FAIL if none was free
+ *    and @gfp doesn't allow sleeping.
+ */
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp)
+{
+	DEFINE_WAIT(wait);
+	unsigned int tag;
+
+	tag = __blk_mq_get_tag(tags);
+	if (tag != BLK_MQ_TAG_FAIL || !(gfp & __GFP_WAIT))
+		return tag;
+
+	while (1) {
+		prepare_to_wait(&tags->wait, &wait, TASK_UNINTERRUPTIBLE);
+
+		tag = __blk_mq_get_tag(tags);
+		if (tag != BLK_MQ_TAG_FAIL)
+			break;
+
+		io_schedule();
+	}
+	finish_wait(&tags->wait, &wait);
+
+	return tag;
+}
+
+/**
+ * blk_mq_put_tag - free a tag
+ * @tags:	the tag set
+ * @tag:	tag previously returned by blk_mq_get_tag()
+ *
+ * Description:
+ *    May be called from any context, including hard interrupts.
+ */
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	struct blk_mq_tag_cpu *tcpu;
+	unsigned long flags;
+
+	BUG_ON(tag >= tags->nr_tags);
+
+	if (!tags->max_cache) {
+		spin_lock_irqsave(&tags->lock, flags);
+		tags->freelist[tags->nr_free++] = tag;
+		spin_unlock_irqrestore(&tags->lock, flags);
+		goto wake;
+	}
+
+	local_irq_save(flags);
+	tcpu = this_cpu_ptr(tags->tag_cpu);
+
+	spin_lock(&tcpu->lock);
+	tcpu->freelist[tcpu->nr_free++] = tag;
+	if (tcpu->nr_free == 1)
+		cpumask_set_cpu(smp_processor_id(), &tags->cpus_have_tags);
+
+	if (tcpu->nr_free == tags->max_cache) {
+		spin_lock(&tags->lock);
+		move_tags(tags->freelist, &tags->nr_free,
+			  tcpu->freelist, &tcpu->nr_free,
+			  tags->batch_move);
+		spin_unlock(&tags->lock);
+	}
+	spin_unlock(&tcpu->lock);
+	local_irq_restore(flags);
+
+wake:
+	/*
+	 * Waiters may be on other cpus; they'll steal our cache if the
+	 * global pool is still empty.
+	 */
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+/*
+ * Lockless and therefore racy, good enough as a hint for callers that are
+ * about to sleep on the tag waitqueue.
+ */
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags)
+{
+	return tags->nr_free || !cpumask_empty(&tags->cpus_have_tags);
+}
+
+unsigned int blk_mq_tags_nr_busy(struct blk_mq_tags *tags)
+{
+	unsigned int nr_free = 0;
+	unsigned long flags;
+	int cpu;
+
+	if (tags->max_cache) {
+		for_each_possible_cpu(cpu) {
+			struct blk_mq_tag_cpu *tcpu;
+
+			tcpu = per_cpu_ptr(tags->tag_cpu, cpu);
+			spin_lock_irqsave(&tcpu->lock, flags);
+			nr_free += tcpu->nr_free;
+			spin_unlock_irqrestore(&tcpu->lock, flags);
+		}
+	}
+
+	spin_lock_irqsave(&tags->lock, flags);
+	nr_free += tags->nr_free;
+	spin_unlock_irqrestore(&tags->lock, flags);
+
+	return tags->nr_tags - nr_free;
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node)
+{
+	struct blk_mq_tags *tags;
+	unsigned int i;
+	int cpu;
+
+	tags = kzalloc_node(sizeof(*tags), GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->freelist = kmalloc_node(sizeof(unsigned int) * nr_tags,
+				      GFP_KERNEL, node);
+	if (!tags->freelist)
+		goto err_free_tags;
+
+	tags->nr_tags = nr_tags;
+	spin_lock_init(&tags->lock);
+	init_waitqueue_head(&tags->wait);
+
+	/*
+	 * Hand out the low tags first, drivers that size hardware
+	 * resources by tag like that.
+	 */
+	for (i = 0; i < nr_tags; i++)
+		tags->freelist[i] = nr_tags - i - 1;
+	tags->nr_free = nr_tags;
+
+	/*
+	 * Cap each cache so that all cpus together can't hold more than
+	 * the whole tag space, stealing takes care of the imbalance.
+	 */
+	tags->max_cache = nr_tags / num_possible_cpus();
+	if (tags->max_cache < BLK_MQ_TAG_CACHE_MIN) {
+		tags->max_cache = 0;
+		return tags;
+	}
+	tags->batch_move = max(1u, tags->max_cache / 2);
+
+	tags->tag_cpu = __alloc_percpu(sizeof(struct blk_mq_tag_cpu) +
+				       sizeof(unsigned int) * tags->max_cache,
+				       __alignof__(struct blk_mq_tag_cpu));
+	if (!tags->tag_cpu)
+		goto err_free_freelist;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(tags->tag_cpu, cpu)->lock);
+
+	return tags;
+
+err_free_freelist:
+	kfree(tags->freelist);
+err_free_tags:
+	kfree(tags);
+	return NULL;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	free_percpu(tags->tag_cpu);
+	kfree(tags->freelist);
+	kfree(tags);
+}
@@ -0,0 +1,51 @@
+#ifndef INT_BLK_MQ_TAG_H
+#define INT_BLK_MQ_TAG_H
+
+#include <linux/cpumask.h>
+#include <linux/wait.h>
+
+/*
+ * Per-cpu cache of free tags.  Only the owning cpu allocates from it, but
+ * other cpus may steal the whole cache when the global pool runs dry, so
+ * it is still protected by a lock.
+ */
+struct blk_mq_tag_cpu {
+	spinlock_t		lock;
+	unsigned int		nr_free;
+	unsigned int		freelist[];
+};
+
+struct blk_mq_tags {
+	unsigned int		nr_tags;
+
+	/*
+	 * Tags are moved between the per-cpu caches and the global pool
+	 * batch_move at a time.  A cache holding max_cache tags gives a
+	 * batch back.  max_cache == 0 disables the per-cpu caches.
+	 */
+	unsigned int		max_cache;
+	unsigned int		batch_move;
+
+	struct blk_mq_tag_cpu __percpu *tag_cpu;
+
+	struct {
+		spinlock_t		lock;
+		unsigned int		nr_free;
+		unsigned int		*freelist;
+		unsigned int		cpu_last_stolen;
+		cpumask_t		cpus_have_tags;
+		wait_queue_head_t	wait;
+	} ____cacheline_aligned_in_smp;
+};
+
+#define BLK_MQ_TAG_FAIL		((unsigned int) -1)
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node);
+void blk_mq_free_tags(struct blk_mq_tags *tags);
+
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp);
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag);
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags);
+unsigned int blk_mq_tags_nr_busy(struct blk_mq_tags *tags);
+
+#endif
@@ -7,8 +7,10 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/blktrace_api.h>
+#include <linux/blk-mq.h>
 
 #include "blk.h"
+#include "blk-mq.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -156,6 +158,25 @@ static ssize_t queue_discard_max_show(struct request_queue *q, char *page)
 		       (unsigned long long)q->limits.max_discard_sectors << 9);
 }
 
+static ssize_t queue_discard_async_rate_show(struct request_queue *q,
+					     char *page)
+{
+	return queue_var_show(q->async_discard.rate_kb, page);
+}
+
+static ssize_t queue_discard_async_rate_store(struct request_queue *q,
+					      const char *page, size_t count)
+{
+	unsigned long rate_kb;
+	ssize_t ret = queue_var_store(&rate_kb, page, count);
+
+	if (rate_kb > UINT_MAX)
+		return -EINVAL;
+
+	q->async_discard.rate_kb = rate_kb;
+	return ret;
+}
+
 static ssize_t queue_discard_zeroes_data_show(struct request_queue *q, char *page)
 {
 	return queue_var_show(queue_discard_zeroes_data(q), page);
@@ -273,6 +294,90 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+static ssize_t queue_poll_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_poll(q), page);
+}
+
+static ssize_t queue_poll_store(struct request_queue *q, const char *page,
+				size_t count)
+{
+	unsigned long poll_on;
+	ssize_t ret;
+
+	if (!q->mq_ops || !q->mq_ops->poll)
+		return -EINVAL;
+
+	ret = queue_var_store(&poll_on, page, count);
+
+	spin_lock_irq(q->queue_lock);
+	if (poll_on)
+		queue_flag_set(QUEUE_FLAG_POLL, q);
+	else
+		queue_flag_clear(QUEUE_FLAG_POLL, q);
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_poll_delay_show(struct request_queue *q, char *page)
+{
+	int val;
+
+	if (q->poll_nsec == -1)
+		val = -1;
+	else
+		val = q->poll_nsec / 1000;
+
+	return sprintf(page, "%d\n", val);
+}
+
+static ssize_t queue_poll_delay_store(struct request_queue *q,
+				      const char *page, size_t count)
+{
+	char *p = (char *) page;
+	long val;
+
+	if (!q->mq_ops || !q->mq_ops->poll)
+		return -EINVAL;
+
+	val = simple_strtol(p, &p, 10);
+	if (val < -1 || val > INT_MAX / 1000)
+		return -EINVAL;
+
+	if (val == -1)
+		q->poll_nsec = -1;
+	else
+		q->poll_nsec = val * 1000;
+
+	return count;
+}
+
+#ifdef CONFIG_BLK_WBT
+static ssize_t queue_wbt_lat_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%llu\n",
+		       (unsigned long long)div_u64(blk_wbt_get_lat(q), 1000));
+}
+
+static ssize_t queue_wbt_lat_store(struct request_queue *q, const char *page,
+				   size_t count)
+{
+	char *p = (char *) page;
+	long long val;
+
+	if (!q->request_fn && !q->mq_ops)
+		return -EINVAL;
+
+	val = simple_strtoll(p, &p, 10);
+	if (val < -1 || val > LLONG_MAX / 1000)
+		return -EINVAL;
+
+	blk_wbt_set_lat(q, val == -1 ? -1 : val * 1000);
+	return count;
+}
+#endif
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -352,6 +457,12 @@ static struct queue_sysfs_entry queue_discard_max_entry = {
 	.show = queue_discard_max_show,
 };
 
+static struct queue_sysfs_entry queue_discard_async_rate_entry = {
+	.attr = {.name = "discard_async_rate_kb", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_discard_async_rate_show,
+	.store = queue_discard_async_rate_store,
+};
+
 static struct queue_sysfs_entry queue_discard_zeroes_data_entry = {
 	.attr = {.name = "discard_zeroes_data", .mode = S_IRUGO },
 	.show = queue_discard_zeroes_data_show,
@@ -375,6 +486,26 @@ static struct queue_sysfs_entry queue_rq_affinity_entry = {
 	.store = queue_rq_affinity_store,
 };
 
+static struct queue_sysfs_entry queue_poll_entry = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_show,
+	.store = queue_poll_store,
+};
+
+#ifdef CONFIG_BLK_WBT
+static struct queue_sysfs_entry queue_wbt_lat_entry = {
+	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wbt_lat_show,
+	.store = queue_wbt_lat_store,
+};
+#endif
+
+static struct queue_sysfs_entry queue_poll_delay_entry = {
+	.attr = {.name = "io_poll_delay", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_delay_show,
+	.store = queue_poll_delay_store,
+};
+
 static struct queue_sysfs_entry queue_iostats_entry = {
 	.attr = {.name = "iostats", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_show_iostats,
@@ -403,10 +534,16 @@ static struct attribute *default_attrs[] = {
 	&queue_io_opt_entry.attr,
 	&queue_discard_granularity_entry.attr,
 	&queue_discard_max_entry.attr,
+	&queue_discard_async_rate_entry.attr,
 	&queue_discard_zeroes_data_entry.attr,
 	&queue_nonrot_entry.attr,
 	&queue_nomerges_entry.attr,
 	&queue_rq_affinity_entry.attr,
+	&queue_poll_entry.attr,
+	&queue_poll_delay_entry.attr,
+#ifdef CONFIG_BLK_WBT
+	&queue_wbt_lat_entry.attr,
+#endif
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
 	NULL,
@@ -483,13 +620,20 @@ static void blk_release_queue(struct kobject *kobj)
 		elevator_exit(q->elevator);
 
 	blk_throtl_exit(q);
+	blk_wbt_exit(q);
+	blk_async_discard_exit(q);
 
-	if (rl->rq_pool)
+	if (rl->rq_pool) {
+		mempool_cpu_cache_destroy(rl->rq_pool, rl->rq_cache);
 		mempool_destroy(rl->rq_pool);
+	}
 
 	if (q->queue_tags)
 		__blk_queue_free_tags(q);
 
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
+
 	blk_throtl_release(q);
 	blk_trace_shutdown(q);
 
@@ -0,0 +1,266 @@
+/*
+ * Writeback throttling: keep background writeback from hurting reads
+ *
+ * The flusher threads tag periodic and background writeback with
+ * REQ_BACKGROUND.  Such writes may only have a limited number of requests
+ * in flight on a queue; further ones sleep in blk_wbt_wait() until one
+ * completes.  The limit starts at the queue depth and is scaled by read
+ * completion latency: at the end of every window in which more than one
+ * read in ten took longer than the target, the limit is halved.  A window
+ * with no slow reads, or no reads at all, doubles it again until the full
+ * depth is reached.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include "blk.h"
+
+/* Read latency is judged over windows of this length */
+#define WBT_WINDOW_MSEC		100
+
+/* Default read latency targets, rotational and non-rotational */
+#define WBT_DEF_LAT_ROT		(75ULL * NSEC_PER_MSEC)
+#define WBT_DEF_LAT_NONROT	(2ULL * NSEC_PER_MSEC)
+
+/* ->min_lat_nsec value selecting one of the defaults above */
+#define WBT_LAT_DEFAULT		(-1LL)
+
+#define WBT_TRACKED		1	/* rq->wbt_flags: counted in ->inflight */
+
+struct rq_wb {
+	struct request_queue	*q;
+	s64			min_lat_nsec;	/* 0 disables throttling */
+	unsigned int		scale_step;	/* limit is depth >> scale_step */
+
+	atomic_t		inflight;	/* tracked background requests */
+	atomic_t		nr_reads;	/* reads completed this window */
+	atomic_t		nr_slow;	/* ... and those over target */
+
+	wait_queue_head_t	wait;
+	struct timer_list	window;
+};
+
+static u64 wbt_target(struct rq_wb *rwb)
+{
+	if (rwb->min_lat_nsec != WBT_LAT_DEFAULT)
+		return rwb->min_lat_nsec;
+	return blk_queue_nonrot(rwb->q) ? WBT_DEF_LAT_NONROT : WBT_DEF_LAT_ROT;
+}
+
+static unsigned int wbt_max_step(struct rq_wb *rwb)
+{
+	return ilog2(max(rwb->q->nr_requests, 1UL));
+}
+
+static unsigned int wbt_limit(struct rq_wb *rwb)
+{
+	unsigned int step = min(ACCESS_ONCE(rwb->scale_step),
+				wbt_max_step(rwb));
+
+	return max_t(unsigned long, rwb->q->nr_requests >> step, 1);
+}
+
+static bool wbt_inflight_inc(struct rq_wb *rwb)
+{
+	int limit = wbt_limit(rwb), cur, old;
+
+	if (!wbt_target(rwb)) {
+		atomic_inc(&rwb->inflight);
+		return true;
+	}
+
+	cur = atomic_read(&rwb->inflight);
+	while (cur < limit) {
+		old = atomic_cmpxchg(&rwb->inflight, cur, cur + 1);
+		if (old == cur)
+			return true;
+		cur = old;
+	}
+	return false;
+}
+
+static void wbt_inflight_dec(struct rq_wb *rwb)
+{
+	int inflight = atomic_dec_return(&rwb->inflight);
+
+	if (inflight < (int)wbt_limit(rwb) && waitqueue_active(&rwb->wait))
+		wake_up(&rwb->wait);
+}
+
+static void wbt_arm_window(struct rq_wb *rwb)
+{
+	if (!timer_pending(&rwb->window))
+		mod_timer(&rwb->window,
+			  jiffies + msecs_to_jiffies(WBT_WINDOW_MSEC));
+}
+
+static void wbt_window_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *)data;
+	unsigned int reads = atomic_xchg(&rwb->nr_reads, 0);
+	unsigned int slow = atomic_xchg(&rwb->nr_slow, 0);
+
+	if (rwb->scale_step > wbt_max_step(rwb))
+		rwb->scale_step = wbt_max_step(rwb);
+
+	if (slow * 10 > reads) {
+		if (rwb->scale_step < wbt_max_step(rwb))
+			rwb->scale_step++;
+	} else if (!slow && rwb->scale_step) {
+		rwb->scale_step--;
+		wake_up_all(&rwb->wait);
+	}
+
+	/* keep watching while writeback runs or the limit is still reduced */
+	if (atomic_read(&rwb->inflight) || rwb->scale_step)
+		wbt_arm_window(rwb);
+}
+
+/**
+ * blk_wbt_wait - throttle a background writeback bio
+ * @q:		queue the bio is for
+ * @bio:	the bio about to get a request
+ * @lock:	spinlock held by the caller, dropped while sleeping, or %NULL
+ *
+ * Description:
+ *    Called before allocating a request for @bio.  If @bio is background
+ *    writeback, wait until the queue is below its writeback limit and
+ *    charge it.  Returns %true if the caller must then hand the new request
+ *    to blk_wbt_track(), or call blk_wbt_untrack() if it ends up not
+ *    allocating one.
+ */
+bool blk_wbt_wait(struct request_queue *q, struct bio *bio, spinlock_t *lock)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	DEFINE_WAIT(wait);
+
+	if (!rwb || !wbt_target(rwb))
+		return false;
+	if ((bio->bi_rw & (REQ_WRITE | REQ_BACKGROUND)) !=
+	    (REQ_WRITE | REQ_BACKGROUND))
+		return false;
+	if (bio->bi_rw & (REQ_SYNC | REQ_DISCARD | REQ_FLUSH | REQ_FUA))
+		return false;
+
+	if (!wbt_inflight_inc(rwb)) {
+		if (lock)
+			spin_unlock_irq(lock);
+		for (;;) {
+			prepare_to_wait_exclusive(&rwb->wait, &wait,
+						  TASK_UNINTERRUPTIBLE);
+			if (wbt_inflight_inc(rwb))
+				break;
+			io_schedule();
+		}
+		finish_wait(&rwb->wait, &wait);
+		if (lock)
+			spin_lock_irq(lock);
+	}
+
+	wbt_arm_window(rwb);
+	return true;
+}
+
+void blk_wbt_track(struct request *rq)
+{
+	rq->wbt_flags |= WBT_TRACKED;
+}
+
+void blk_wbt_untrack(struct request_queue *q)
+{
+	wbt_inflight_dec(q->rq_wb);
+}
+
+/**
+ * blk_wbt_done - account a request that is being freed
+ * @rq:		the request
+ *
+ * Description:
+ *    Releases @rq's writeback slot, if it has one, and feeds the latency
+ *    of completed reads into the current window.
+ */
+void blk_wbt_done(struct request *rq)
+{
+	struct rq_wb *rwb = rq->q->rq_wb;
+	u64 target;
+	s64 lat;
+
+	if (!rwb)
+		return;
+
+	if (rq->wbt_flags & WBT_TRACKED) {
+		rq->wbt_flags &= ~WBT_TRACKED;
+		wbt_inflight_dec(rwb);
+		return;
+	}
+
+	if (!rq->issue_time_ns || rq->cmd_type != REQ_TYPE_FS ||
+	    rq_data_dir(rq) != READ)
+		return;
+
+	target = wbt_target(rwb);
+	if (!target)
+		return;
+
+	lat = ktime_to_ns(ktime_get()) - rq->issue_time_ns;
+	atomic_inc(&rwb->nr_reads);
+	if (lat > (s64)target)
+		atomic_inc(&rwb->nr_slow);
+}
+
+/* Whether requests need their issue time for read latency sampling. */
+bool blk_wbt_enabled(struct request_queue *q)
+{
+	return q->rq_wb && wbt_target(q->rq_wb);
+}
+
+u64 blk_wbt_get_lat(struct request_queue *q)
+{
+	return wbt_target(q->rq_wb);
+}
+
+/* @nsec of -1 restores the default target, 0 turns throttling off. */
+void blk_wbt_set_lat(struct request_queue *q, s64 nsec)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	rwb->min_lat_nsec = nsec;
+	rwb->scale_step = 0;
+	wake_up_all(&rwb->wait);
+}
+
+int blk_wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return -ENOMEM;
+
+	rwb->q = q;
+	rwb->min_lat_nsec = WBT_LAT_DEFAULT;
+	atomic_set(&rwb->inflight, 0);
+	atomic_set(&rwb->nr_reads, 0);
+	atomic_set(&rwb->nr_slow, 0);
+	init_waitqueue_head(&rwb->wait);
+	setup_timer(&rwb->window, wbt_window_fn, (unsigned long)rwb);
+
+	q->rq_wb = rwb;
+	return 0;
+}
+
+void blk_wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	del_timer_sync(&rwb->window);
+	q->rq_wb = NULL;
+	kfree(rwb);
+}
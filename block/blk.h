@@ -17,6 +17,8 @@ int blk_rq_append_bio(struct request_queue *q, struct request *rq,
 		      struct bio *bio);
 void blk_drain_queue(struct request_queue *q, bool drain_all);
 void blk_dequeue_request(struct request *rq);
+void blk_async_discard_init(struct request_queue *q);
+void blk_async_discard_exit(struct request_queue *q);
 void __blk_queue_free_tags(struct request_queue *q);
 bool __blk_end_bidi_request(struct request *rq, int error,
 			    unsigned int nr_bytes, unsigned int bidi_bytes);
@@ -26,11 +28,22 @@ void blk_delete_timer(struct request *);
 void blk_add_timer(struct request *);
 void __generic_unplug_device(struct request_queue *);
 
+bool bio_attempt_front_merge(struct request_queue *q, struct request *req,
+			     struct bio *bio);
+bool bio_attempt_back_merge(struct request_queue *q, struct request *req,
+			    struct bio *bio);
+bool blk_attempt_plug_merge(struct request_queue *q, struct bio *bio,
+			    unsigned int *request_count);
+
+void blk_account_io_start(struct request *req, bool new_io);
+void blk_account_io_done(struct request *req);
+
 /*
  * Internal atomic flags for request handling
  */
 enum rq_atomic_flags {
 	REQ_ATOM_COMPLETE = 0,
+	REQ_ATOM_STARTED,
 };
 
 /*
@@ -54,6 +67,7 @@ static inline void blk_clear_rq_complete(struct request *rq)
 
 void blk_insert_flush(struct request *rq);
 void blk_abort_flushes(struct request_queue *q);
+int blk_mq_init_flush(struct request_queue *q);
 
 static inline struct request *__elv_next_request(struct request_queue *q)
 {
@@ -189,6 +203,23 @@ static inline int blk_do_io_stat(struct request *rq)
 	        (rq->cmd_flags & REQ_DISCARD));
 }
 
+#ifdef CONFIG_BLK_DEV_IO_HIST
+/*
+ * Record the size for the histograms before the driver's prep function can
+ * change it (e.g. a discard becoming a one sector payload).  Requeues keep
+ * the original size.
+ */
+static inline void blk_io_hist_start(struct request *rq)
+{
+	if (!rq->hist_sectors)
+		rq->hist_sectors = blk_rq_sectors(rq);
+}
+#else
+static inline void blk_io_hist_start(struct request *rq)
+{
+}
+#endif
+
 #ifdef CONFIG_BLK_DEV_THROTTLING
 extern bool blk_throtl_bio(struct request_queue *q, struct bio *bio);
 extern void blk_throtl_drain(struct request_queue *q);
@@ -206,4 +237,29 @@ static inline void blk_throtl_exit(struct request_queue *q) { }
 static inline void blk_throtl_release(struct request_queue *q) { }
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
+#ifdef CONFIG_BLK_WBT
+extern bool blk_wbt_wait(struct request_queue *q, struct bio *bio,
+			 spinlock_t *lock);
+extern void blk_wbt_track(struct request *rq);
+extern void blk_wbt_untrack(struct request_queue *q);
+extern void blk_wbt_done(struct request *rq);
+extern bool blk_wbt_enabled(struct request_queue *q);
+extern u64 blk_wbt_get_lat(struct request_queue *q);
+extern void blk_wbt_set_lat(struct request_queue *q, s64 nsec);
+extern int blk_wbt_init(struct request_queue *q);
+extern void blk_wbt_exit(struct request_queue *q);
+#else /* CONFIG_BLK_WBT */
+static inline bool blk_wbt_wait(struct request_queue *q, struct bio *bio,
+				spinlock_t *lock)
+{
+	return false;
+}
+static inline void blk_wbt_track(struct request *rq) { }
+static inline void blk_wbt_untrack(struct request_queue *q) { }
+static inline void blk_wbt_done(struct request *rq) { }
+static inline bool blk_wbt_enabled(struct request_queue *q) { return false; }
+static inline int blk_wbt_init(struct request_queue *q) { return 0; }
+static inline void blk_wbt_exit(struct request_queue *q) { }
+#endif /* CONFIG_BLK_WBT */
+
 #endif /* BLK_INTERNAL_H */
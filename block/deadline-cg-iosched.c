@@ -0,0 +1,972 @@
+/*
+ *  Deadline i/o scheduler with per-cgroup completion latency targets.
+ *
+ *  Requests are dispatched in deadline order.  Each blkio cgroup doing
+ *  IO to the queue gets a group here; groups with a latency target have
+ *  their completion latency averaged over a short window, and when one
+ *  of them misses its target, groups with a looser (or no) target get
+ *  their dispatch depth halved.  Depth grows back once all targets are
+ *  met again.
+ *
+ *  Based on deadline-iosched.c, Copyright (C) 2002 Jens Axboe
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
+#include "blk-cgroup.h"
+
+/*
+ * See Documentation/block/deadline-cg-iosched.txt
+ */
+static const int read_expire = HZ / 2;  /* max time before a read is submitted. */
+static const int write_expire = 5 * HZ; /* ditto for writes, these limits are SOFT! */
+static const int writes_starved = 2;    /* max times reads can starve a write */
+static const int fifo_batch = 16;       /* # of sequential requests treated as one
+				     by the above parameters. For throughput. */
+static const int target_window = HZ / 10; /* latency sampling period */
+
+#define DCG_DEPTH_UNLIMITED	UINT_MAX
+
+struct dcg_group {
+	struct blkio_group blkg;
+	struct hlist_node dd_node;
+	int ref;
+
+	/* completion latency target in usecs, 0 if the group has none */
+	unsigned int latency_target;
+
+	/* requests handed to the driver and not yet completed */
+	unsigned int dispatched;
+	/* dispatch limit, lowered while a tighter target is being missed */
+	unsigned int max_depth;
+
+	/* completion latency samples of the current window */
+	unsigned int nr_samples;
+	u64 lat_sum;
+};
+
+struct dcg_data {
+	struct request_queue *queue;
+
+	/*
+	 * requests are present on both sort_list and fifo_list
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[2];
+
+	/*
+	 * next in sort order. read, write or both are NULL
+	 */
+	struct request *next_rq[2];
+	unsigned int batching;		/* number of sequential requests made */
+	unsigned int starved;		/* times reads have starved writes */
+
+	/*
+	 * cgroup groups
+	 */
+	struct dcg_group root_group;
+	struct hlist_head group_list;
+	unsigned int nr_blkcg_linked_grps;
+
+	unsigned long window_start;
+	/* dispatch stopped because all queued requests were over depth */
+	bool depth_blocked;
+	struct work_struct unplug_work;
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[2];
+	int fifo_batch;
+	int writes_starved;
+	int front_merges;
+	int target_window;
+};
+
+#define RQ_DCG(rq)	((struct dcg_group *) (rq)->elevator_private[0])
+
+static inline struct dcg_group *dcg_of_blkg(struct blkio_group *blkg)
+{
+	if (blkg)
+		return container_of(blkg, struct dcg_group, blkg);
+	return NULL;
+}
+
+static inline void dcg_schedule_dispatch(struct dcg_data *dd)
+{
+	if (dd->depth_blocked) {
+		dd->depth_blocked = false;
+		kblockd_schedule_work(dd->queue, &dd->unplug_work);
+	}
+}
+
+static void dcg_kick_queue(struct work_struct *work)
+{
+	struct dcg_data *dd = container_of(work, struct dcg_data, unplug_work);
+	struct request_queue *q = dd->queue;
+
+	spin_lock_irq(q->queue_lock);
+	__blk_run_queue(q);
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * group management, modelled on the cfq group code
+ */
+static void dcg_init_add_group(struct dcg_data *dd, struct dcg_group *dg,
+			       struct blkio_cgroup *blkcg)
+{
+	struct backing_dev_info *bdi = &dd->queue->backing_dev_info;
+	unsigned int major, minor;
+	dev_t dev = 0;
+
+	/*
+	 * bdi->dev may not be set up yet, dcg_find_group() fills in the
+	 * device once it is.
+	 */
+	if (bdi->dev) {
+		sscanf(dev_name(bdi->dev), "%u:%u", &major, &minor);
+		dev = MKDEV(major, minor);
+	}
+	blkiocg_add_blkio_group(blkcg, &dg->blkg, (void *)dd, dev,
+				BLKIO_POLICY_LATENCY);
+	dd->nr_blkcg_linked_grps++;
+	dg->latency_target = blkcg_get_latency_target(blkcg, dg->blkg.dev);
+
+	hlist_add_head(&dg->dd_node, &dd->group_list);
+}
+
+/*
+ * Should be called from sleepable context, alloc_percpu() for the stats
+ * may block.
+ */
+static struct dcg_group *dcg_alloc_group(struct dcg_data *dd)
+{
+	struct dcg_group *dg;
+
+	dg = kzalloc_node(sizeof(*dg), GFP_KERNEL, dd->queue->node);
+	if (!dg)
+		return NULL;
+
+	/*
+	 * Initial reference, dropped by whoever of elevator exit and cgroup
+	 * removal gets to the group first.
+	 */
+	dg->ref = 1;
+	dg->max_depth = DCG_DEPTH_UNLIMITED;
+
+	if (blkio_alloc_blkg_stats(&dg->blkg)) {
+		kfree(dg);
+		return NULL;
+	}
+
+	return dg;
+}
+
+/* called under rcu_read_lock() */
+static inline struct dcg_group *
+__dcg_lookup_group(struct dcg_data *dd, struct blkio_cgroup *blkcg)
+{
+	/* no cgroups in use is the common case, avoid the lookup */
+	if (blkcg == &blkio_root_cgroup)
+		return &dd->root_group;
+
+	return dcg_of_blkg(blkiocg_lookup_group(blkcg, dd));
+}
+
+/*
+ * Called with the queue lock and rcu_read_lock() held.
+ */
+static struct dcg_group *
+dcg_find_group(struct dcg_data *dd, struct blkio_cgroup *blkcg)
+{
+	struct backing_dev_info *bdi = &dd->queue->backing_dev_info;
+	struct dcg_group *dg = __dcg_lookup_group(dd, blkcg);
+	unsigned int major, minor;
+
+	if (dg && !dg->blkg.dev && bdi->dev && dev_name(bdi->dev)) {
+		sscanf(dev_name(bdi->dev), "%u:%u", &major, &minor);
+		dg->blkg.dev = MKDEV(major, minor);
+		dg->latency_target = blkcg_get_latency_target(blkcg,
+							      dg->blkg.dev);
+	}
+
+	return dg;
+}
+
+/*
+ * Find or create the group of the current task.  Called and returns with
+ * the queue lock held, but may drop it to allocate a new group.  Falls
+ * back to the root group if that isn't possible.
+ */
+static struct dcg_group *dcg_get_group(struct dcg_data *dd, gfp_t gfp_mask)
+{
+	struct request_queue *q = dd->queue;
+	struct blkio_cgroup *blkcg;
+	struct dcg_group *dg, *__dg;
+
+	rcu_read_lock();
+	blkcg = task_blkio_cgroup(current);
+	dg = dcg_find_group(dd, blkcg);
+	rcu_read_unlock();
+	if (dg)
+		return dg;
+
+	if (!(gfp_mask & __GFP_WAIT))
+		return &dd->root_group;
+
+	spin_unlock_irq(q->queue_lock);
+	dg = dcg_alloc_group(dd);
+	spin_lock_irq(q->queue_lock);
+
+	rcu_read_lock();
+	blkcg = task_blkio_cgroup(current);
+
+	/*
+	 * Somebody else may have added the group while we weren't holding
+	 * the queue lock.
+	 */
+	__dg = dcg_find_group(dd, blkcg);
+	if (__dg) {
+		if (dg) {
+			free_percpu(dg->blkg.stats_cpu);
+			kfree(dg);
+		}
+		dg = __dg;
+	} else if (!dg) {
+		dg = &dd->root_group;
+	} else {
+		dcg_init_add_group(dd, dg, blkcg);
+	}
+	rcu_read_unlock();
+
+	return dg;
+}
+
+static void dcg_put_group(struct dcg_group *dg)
+{
+	BUG_ON(dg->ref <= 0);
+	dg->ref--;
+	if (dg->ref)
+		return;
+	free_percpu(dg->blkg.stats_cpu);
+	kfree(dg);
+}
+
+static void dcg_destroy_group(struct dcg_data *dd, struct dcg_group *dg)
+{
+	/* Something wrong if we are trying to remove same group twice */
+	BUG_ON(hlist_unhashed(&dg->dd_node));
+
+	hlist_del_init(&dg->dd_node);
+
+	BUG_ON(dd->nr_blkcg_linked_grps <= 0);
+	dd->nr_blkcg_linked_grps--;
+
+	/* drop the initial reference, requests may still hold theirs */
+	dcg_put_group(dg);
+}
+
+static void dcg_release_groups(struct dcg_data *dd)
+{
+	struct hlist_node *pos, *n;
+	struct dcg_group *dg;
+
+	hlist_for_each_entry_safe(dg, pos, n, &dd->group_list, dd_node) {
+		/*
+		 * If the cgroup removal path unhashed the group first, it
+		 * will also destroy it through dcg_unlink_blkio_group().
+		 */
+		if (!blkiocg_del_blkio_group(&dg->blkg))
+			dcg_destroy_group(dd, dg);
+	}
+}
+
+/*
+ * The cgroup is going away, called under rcu_read_lock() so the key is
+ * still a valid dcg_data.
+ */
+static void dcg_unlink_blkio_group(void *key, struct blkio_group *blkg)
+{
+	struct dcg_data *dd = key;
+	unsigned long flags;
+
+	spin_lock_irqsave(dd->queue->queue_lock, flags);
+	dcg_destroy_group(dd, dcg_of_blkg(blkg));
+	spin_unlock_irqrestore(dd->queue->queue_lock, flags);
+}
+
+static void dcg_update_blkio_group_latency_target(void *key,
+			struct blkio_group *blkg, unsigned int latency_target)
+{
+	dcg_of_blkg(blkg)->latency_target = latency_target;
+}
+
+/*
+ * depth control
+ */
+static inline bool dcg_may_dispatch(struct request *rq)
+{
+	struct dcg_group *dg = RQ_DCG(rq);
+
+	return dg->dispatched < dg->max_depth;
+}
+
+static void dcg_scale_down(struct dcg_data *dd, struct dcg_group *dg)
+{
+	unsigned int depth = dg->max_depth;
+
+	if (depth == DCG_DEPTH_UNLIMITED)
+		depth = dd->queue->nr_requests;
+
+	dg->max_depth = max(depth / 2, 1U);
+}
+
+static void dcg_scale_up(struct dcg_data *dd, struct dcg_group *dg)
+{
+	unsigned int depth = dg->max_depth;
+
+	if (depth == DCG_DEPTH_UNLIMITED)
+		return;
+
+	depth += max(depth / 4, 1U);
+	if (depth >= dd->queue->nr_requests)
+		depth = DCG_DEPTH_UNLIMITED;
+	dg->max_depth = depth;
+}
+
+/*
+ * End of a sampling window: find the tightest target whose group missed
+ * it on average, and throttle every group with a looser or no target.
+ * If all targets were met, let throttled groups grow back.
+ */
+static void dcg_adjust_depths(struct dcg_data *dd)
+{
+	unsigned int missed = UINT_MAX;
+	struct hlist_node *pos;
+	struct dcg_group *dg;
+
+	dd->window_start = jiffies;
+
+	hlist_for_each_entry(dg, pos, &dd->group_list, dd_node) {
+		u64 target_ns = (u64)dg->latency_target * NSEC_PER_USEC;
+
+		if (!dg->latency_target || !dg->nr_samples)
+			continue;
+		if (div64_u64(dg->lat_sum, dg->nr_samples) > target_ns)
+			missed = min(missed, dg->latency_target);
+	}
+
+	hlist_for_each_entry(dg, pos, &dd->group_list, dd_node) {
+		unsigned int target = dg->latency_target ? : UINT_MAX;
+
+		if (missed == UINT_MAX)
+			dcg_scale_up(dd, dg);
+		else if (target > missed)
+			dcg_scale_down(dd, dg);
+
+		dg->nr_samples = 0;
+		dg->lat_sum = 0;
+	}
+
+	if (missed == UINT_MAX)
+		dcg_schedule_dispatch(dd);
+}
+
+static void dcg_activate_request(struct request_queue *q, struct request *rq)
+{
+	RQ_DCG(rq)->dispatched++;
+}
+
+static void dcg_deactivate_request(struct request_queue *q, struct request *rq)
+{
+	struct dcg_data *dd = q->elevator->elevator_data;
+
+	WARN_ON(!RQ_DCG(rq)->dispatched);
+	RQ_DCG(rq)->dispatched--;
+	dcg_schedule_dispatch(dd);
+}
+
+static void dcg_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct dcg_data *dd = q->elevator->elevator_data;
+	struct dcg_group *dg = RQ_DCG(rq);
+	unsigned long long now = sched_clock();
+
+	WARN_ON(!dg->dispatched);
+	dg->dispatched--;
+
+	if (dg->latency_target) {
+		dg->nr_samples++;
+		if (time_after64(now, rq_start_time_ns(rq)))
+			dg->lat_sum += now - rq_start_time_ns(rq);
+	}
+
+	if (time_after(jiffies, dd->window_start + dd->target_window))
+		dcg_adjust_depths(dd);
+
+	if (dcg_may_dispatch(rq))
+		dcg_schedule_dispatch(dd);
+}
+
+/*
+ * request lifetime
+ */
+static int
+dcg_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
+{
+	struct dcg_data *dd = q->elevator->elevator_data;
+	struct dcg_group *dg;
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	spin_lock_irq(q->queue_lock);
+	dg = dcg_get_group(dd, gfp_mask);
+	dg->ref++;
+	rq->elevator_private[0] = dg;
+	spin_unlock_irq(q->queue_lock);
+
+	return 0;
+}
+
+/*
+ * queue lock held here
+ */
+static void dcg_put_request(struct request *rq)
+{
+	struct dcg_group *dg = RQ_DCG(rq);
+
+	if (dg) {
+		rq->elevator_private[0] = NULL;
+		dcg_put_group(dg);
+	}
+}
+
+static void dcg_move_request(struct dcg_data *, struct request *);
+
+static inline struct rb_root *
+dcg_rb_root(struct dcg_data *dd, struct request *rq)
+{
+	return &dd->sort_list[rq_data_dir(rq)];
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+dcg_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static void
+dcg_add_rq_rb(struct dcg_data *dd, struct request *rq)
+{
+	struct rb_root *root = dcg_rb_root(dd, rq);
+
+	elv_rb_add(root, rq);
+}
+
+static inline void
+dcg_del_rq_rb(struct dcg_data *dd, struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+
+	if (dd->next_rq[data_dir] == rq)
+		dd->next_rq[data_dir] = dcg_latter_request(rq);
+
+	elv_rb_del(dcg_rb_root(dd, rq), rq);
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void
+dcg_add_request(struct request_queue *q, struct request *rq)
+{
+	struct dcg_data *dd = q->elevator->elevator_data;
+	const int data_dir = rq_data_dir(rq);
+
+	dcg_add_rq_rb(dd, rq);
+
+	/*
+	 * set expire time and add to fifo list
+	 */
+	rq_set_fifo_time(rq, jiffies + dd->fifo_expire[data_dir]);
+	list_add_tail(&rq->queuelist, &dd->fifo_list[data_dir]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void dcg_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct dcg_data *dd = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	dcg_del_rq_rb(dd, rq);
+}
+
+static int
+dcg_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct dcg_data *dd = q->elevator->elevator_data;
+	struct request *__rq;
+	int ret;
+
+	/*
+	 * check for front merge
+	 */
+	if (dd->front_merges) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&dd->sort_list[bio_data_dir(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != blk_rq_pos(__rq));
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				ret = ELEVATOR_FRONT_MERGE;
+				goto out;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+out:
+	*req = __rq;
+	return ret;
+}
+
+static void dcg_merged_request(struct request_queue *q,
+			       struct request *req, int type)
+{
+	struct dcg_data *dd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(dcg_rb_root(dd, req), req);
+		dcg_add_rq_rb(dd, req);
+	}
+}
+
+static void
+dcg_merged_requests(struct request_queue *q, struct request *req,
+		    struct request *next)
+{
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	dcg_remove_request(q, next);
+}
+
+/*
+ * Only merge bios into requests charged to the submitter's group, so
+ * latency samples and depth stay with the right cgroup.  This may be
+ * called without the queue lock from the plug merge path, the group
+ * pointer is only compared, never dereferenced.
+ */
+static int dcg_allow_merge(struct request_queue *q, struct request *rq,
+			   struct bio *bio)
+{
+	struct dcg_data *dd = q->elevator->elevator_data;
+	struct dcg_group *dg;
+
+	rcu_read_lock();
+	dg = __dcg_lookup_group(dd, task_blkio_cgroup(current));
+	rcu_read_unlock();
+
+	return dg == RQ_DCG(rq);
+}
+
+/*
+ * move an entry to dispatch queue
+ */
+static void
+dcg_move_request(struct dcg_data *dd, struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+	struct request_queue *q = rq->q;
+
+	dd->next_rq[READ] = NULL;
+	dd->next_rq[WRITE] = NULL;
+	dd->next_rq[data_dir] = dcg_latter_request(rq);
+
+	blkiocg_update_dispatch_stats(&RQ_DCG(rq)->blkg, blk_rq_bytes(rq),
+				      data_dir, rq_is_sync(rq));
+
+	/*
+	 * take it off the sort and fifo list, move
+	 * to dispatch queue
+	 */
+	dcg_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+/*
+ * dcg_check_fifo returns 0 if there are no expired requests on the fifo,
+ * 1 otherwise. Requires !list_empty(&dd->fifo_list[data_dir])
+ */
+static inline int dcg_check_fifo(struct dcg_data *dd, int ddir)
+{
+	struct request *rq = rq_entry_fifo(dd->fifo_list[ddir].next);
+
+	/*
+	 * rq is expired!
+	 */
+	if (time_after(jiffies, rq_fifo_time(rq)))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * The deadline choice belongs to a group at its depth limit: take the
+ * oldest request of a group that may still dispatch, preferring @ddir.
+ * This walks the fifos, but only while some group is being throttled.
+ */
+static struct request *dcg_find_dispatchable(struct dcg_data *dd, int ddir)
+{
+	struct request *rq;
+	int i;
+
+	for (i = 0; i < 2; i++, ddir ^= 1) {
+		list_for_each_entry(rq, &dd->fifo_list[ddir], queuelist)
+			if (dcg_may_dispatch(rq))
+				return rq;
+	}
+
+	return NULL;
+}
+
+/*
+ * dcg_dispatch_requests selects the best request according to
+ * read/write expire, fifo_batch, etc, skipping groups at their depth
+ * limit unless we are forced to drain
+ */
+static int dcg_dispatch_requests(struct request_queue *q, int force)
+{
+	struct dcg_data *dd = q->elevator->elevator_data;
+	const int reads = !list_empty(&dd->fifo_list[READ]);
+	const int writes = !list_empty(&dd->fifo_list[WRITE]);
+	struct request *rq;
+	int data_dir;
+
+	/*
+	 * batches are currently reads XOR writes
+	 */
+	if (dd->next_rq[WRITE])
+		rq = dd->next_rq[WRITE];
+	else
+		rq = dd->next_rq[READ];
+
+	if (rq && dd->batching < dd->fifo_batch &&
+	    (force || dcg_may_dispatch(rq)))
+		/* we have a next request are still entitled to batch */
+		goto dispatch_request;
+
+	/*
+	 * at this point we are not running a batch. select the appropriate
+	 * data direction (read / write)
+	 */
+
+	if (reads) {
+		BUG_ON(RB_EMPTY_ROOT(&dd->sort_list[READ]));
+
+		if (writes && (dd->starved++ >= dd->writes_starved))
+			goto dispatch_writes;
+
+		data_dir = READ;
+
+		goto dispatch_find_request;
+	}
+
+	/*
+	 * there are either no reads or writes have been starved
+	 */
+
+	if (writes) {
+dispatch_writes:
+		BUG_ON(RB_EMPTY_ROOT(&dd->sort_list[WRITE]));
+
+		dd->starved = 0;
+
+		data_dir = WRITE;
+
+		goto dispatch_find_request;
+	}
+
+	return 0;
+
+dispatch_find_request:
+	/*
+	 * we are not running a batch, find best request for selected data_dir
+	 */
+	if (dcg_check_fifo(dd, data_dir) || !dd->next_rq[data_dir]) {
+		/*
+		 * A deadline has expired, the last request was in the other
+		 * direction, or we have run out of higher-sectored requests.
+		 * Start again from the request with the earliest expiry time.
+		 */
+		rq = rq_entry_fifo(dd->fifo_list[data_dir].next);
+	} else {
+		/*
+		 * The last req was the same dir and we have a next request in
+		 * sort order. No expired requests so continue on from here.
+		 */
+		rq = dd->next_rq[data_dir];
+	}
+
+	if (!force && !dcg_may_dispatch(rq)) {
+		rq = dcg_find_dispatchable(dd, data_dir);
+		if (!rq) {
+			/* a completion will kick the queue */
+			dd->depth_blocked = true;
+			return 0;
+		}
+	}
+
+	dd->batching = 0;
+
+dispatch_request:
+	/*
+	 * rq is the selected appropriate request.
+	 */
+	dd->batching++;
+	dcg_move_request(dd, rq);
+
+	return 1;
+}
+
+static void dcg_exit_queue(struct elevator_queue *e)
+{
+	struct dcg_data *dd = e->elevator_data;
+	struct request_queue *q = dd->queue;
+	bool wait = false;
+
+	BUG_ON(!list_empty(&dd->fifo_list[READ]));
+	BUG_ON(!list_empty(&dd->fifo_list[WRITE]));
+
+	cancel_work_sync(&dd->unplug_work);
+
+	spin_lock_irq(q->queue_lock);
+	dcg_release_groups(dd);
+
+	/*
+	 * Groups the cgroup removal path unhashed first are unlinked under
+	 * rcu_read_lock(), wait for it to be done with dd.
+	 */
+	if (dd->nr_blkcg_linked_grps)
+		wait = true;
+	spin_unlock_irq(q->queue_lock);
+
+	if (wait)
+		synchronize_rcu();
+
+	free_percpu(dd->root_group.blkg.stats_cpu);
+	kfree(dd);
+}
+
+/*
+ * initialize elevator private data (dcg_data).
+ */
+static void *dcg_init_queue(struct request_queue *q)
+{
+	struct dcg_data *dd;
+	struct dcg_group *dg;
+
+	dd = kmalloc_node(sizeof(*dd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!dd)
+		return NULL;
+
+	dd->queue = q;
+	INIT_HLIST_HEAD(&dd->group_list);
+	INIT_WORK(&dd->unplug_work, dcg_kick_queue);
+
+	/*
+	 * The root group is part of dcg_data.  It holds two references, one
+	 * is dropped with the other groups on exit and the other is never
+	 * put since the group is freed along with dd.
+	 */
+	dg = &dd->root_group;
+	dg->ref = 2;
+	dg->max_depth = DCG_DEPTH_UNLIMITED;
+	if (blkio_alloc_blkg_stats(&dg->blkg)) {
+		kfree(dd);
+		return NULL;
+	}
+
+	rcu_read_lock();
+	blkiocg_add_blkio_group(&blkio_root_cgroup, &dg->blkg, (void *)dd, 0,
+				BLKIO_POLICY_LATENCY);
+	rcu_read_unlock();
+	dd->nr_blkcg_linked_grps++;
+	dg->latency_target = blkio_root_cgroup.latency_target;
+	hlist_add_head(&dg->dd_node, &dd->group_list);
+
+	INIT_LIST_HEAD(&dd->fifo_list[READ]);
+	INIT_LIST_HEAD(&dd->fifo_list[WRITE]);
+	dd->sort_list[READ] = RB_ROOT;
+	dd->sort_list[WRITE] = RB_ROOT;
+	dd->fifo_expire[READ] = read_expire;
+	dd->fifo_expire[WRITE] = write_expire;
+	dd->writes_starved = writes_starved;
+	dd->front_merges = 1;
+	dd->fifo_batch = fifo_batch;
+	dd->target_window = target_window;
+	dd->window_start = jiffies;
+	return dd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+dcg_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+dcg_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct dcg_data *dd = e->elevator_data;				\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return dcg_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(dcg_read_expire_show, dd->fifo_expire[READ], 1);
+SHOW_FUNCTION(dcg_write_expire_show, dd->fifo_expire[WRITE], 1);
+SHOW_FUNCTION(dcg_writes_starved_show, dd->writes_starved, 0);
+SHOW_FUNCTION(dcg_front_merges_show, dd->front_merges, 0);
+SHOW_FUNCTION(dcg_fifo_batch_show, dd->fifo_batch, 0);
+SHOW_FUNCTION(dcg_target_window_show, dd->target_window, 1);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct dcg_data *dd = e->elevator_data;				\
+	int __data;							\
+	int ret = dcg_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(dcg_read_expire_store, &dd->fifo_expire[READ], 0, INT_MAX, 1);
+STORE_FUNCTION(dcg_write_expire_store, &dd->fifo_expire[WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(dcg_writes_starved_store, &dd->writes_starved, INT_MIN, INT_MAX, 0);
+STORE_FUNCTION(dcg_front_merges_store, &dd->front_merges, 0, 1, 0);
+STORE_FUNCTION(dcg_fifo_batch_store, &dd->fifo_batch, 0, INT_MAX, 0);
+STORE_FUNCTION(dcg_target_window_store, &dd->target_window, 1, INT_MAX, 1);
+#undef STORE_FUNCTION
+
+#define DCG_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, dcg_##name##_show, \
+				      dcg_##name##_store)
+
+static struct elv_fs_entry dcg_attrs[] = {
+	DCG_ATTR(read_expire),
+	DCG_ATTR(write_expire),
+	DCG_ATTR(writes_starved),
+	DCG_ATTR(front_merges),
+	DCG_ATTR(fifo_batch),
+	DCG_ATTR(target_window),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_dcg = {
+	.ops = {
+		.elevator_merge_fn = 		dcg_merge,
+		.elevator_merged_fn =		dcg_merged_request,
+		.elevator_merge_req_fn =	dcg_merged_requests,
+		.elevator_allow_merge_fn =	dcg_allow_merge,
+		.elevator_dispatch_fn =		dcg_dispatch_requests,
+		.elevator_add_req_fn =		dcg_add_request,
+		.elevator_activate_req_fn =	dcg_activate_request,
+		.elevator_deactivate_req_fn =	dcg_deactivate_request,
+		.elevator_completed_req_fn =	dcg_completed_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_set_req_fn =		dcg_set_request,
+		.elevator_put_req_fn =		dcg_put_request,
+		.elevator_init_fn =		dcg_init_queue,
+		.elevator_exit_fn =		dcg_exit_queue,
+	},
+
+	.elevator_attrs = dcg_attrs,
+	.elevator_name = "deadline-cg",
+	.elevator_owner = THIS_MODULE,
+};
+
+static struct blkio_policy_type blkio_policy_dcg = {
+	.ops = {
+		.blkio_unlink_group_fn =	dcg_unlink_blkio_group,
+		.blkio_update_group_latency_target_fn =
+					dcg_update_blkio_group_latency_target,
+	},
+	.plid = BLKIO_POLICY_LATENCY,
+};
+
+static int __init dcg_init(void)
+{
+	elv_register(&iosched_dcg);
+	blkio_policy_register(&blkio_policy_dcg);
+
+	return 0;
+}
+
+static void __exit dcg_exit(void)
+{
+	blkio_policy_unregister(&blkio_policy_dcg);
+	elv_unregister(&iosched_dcg);
+}
+
+module_init(dcg_init);
+module_exit(dcg_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("deadline IO scheduler with cgroup latency targets");
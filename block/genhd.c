@@ -974,6 +974,60 @@ static ssize_t disk_discard_alignment_show(struct device *dev,
 	return sprintf(buf, "%d\n", queue_discard_alignment(disk->queue));
 }
 
+#ifdef CONFIG_BLK_DEV_IO_HIST
+static const char *const disk_hist_op_names[DISK_HIST_NR_OPS] = {
+	[DISK_HIST_READ]	= "read",
+	[DISK_HIST_WRITE]	= "write",
+	[DISK_HIST_FLUSH]	= "flush",
+	[DISK_HIST_DISCARD]	= "discard",
+};
+
+/*
+ * One line per operation: its name followed by the bucket counts, summed
+ * over all cpus.
+ */
+static ssize_t disk_hist_show(struct gendisk *disk, char *buf, bool lat)
+{
+	int nr = lat ? DISK_HIST_LAT_BUCKETS : DISK_HIST_SIZE_BUCKETS;
+	ssize_t len = 0;
+	int op, i, cpu;
+
+	for (op = 0; op < DISK_HIST_NR_OPS; op++) {
+		len += sprintf(buf + len, "%s", disk_hist_op_names[op]);
+		for (i = 0; i < nr; i++) {
+			unsigned long count = 0;
+
+			for_each_possible_cpu(cpu) {
+				struct disk_io_hist *hist;
+
+				hist = per_cpu_ptr(disk->io_hist, cpu);
+				count += lat ? hist->lat[op][i] :
+					       hist->size[op][i];
+			}
+			len += sprintf(buf + len, " %lu", count);
+		}
+		len += sprintf(buf + len, "\n");
+	}
+
+	return len;
+}
+
+static ssize_t disk_io_lat_hist_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	return disk_hist_show(dev_to_disk(dev), buf, true);
+}
+
+static ssize_t disk_io_size_hist_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	return disk_hist_show(dev_to_disk(dev), buf, false);
+}
+
+static DEVICE_ATTR(io_lat_hist, S_IRUGO, disk_io_lat_hist_show, NULL);
+static DEVICE_ATTR(io_size_hist, S_IRUGO, disk_io_size_hist_show, NULL);
+#endif
+
 static DEVICE_ATTR(range, S_IRUGO, disk_range_show, NULL);
 static DEVICE_ATTR(ext_range, S_IRUGO, disk_ext_range_show, NULL);
 static DEVICE_ATTR(removable, S_IRUGO, disk_removable_show, NULL);
@@ -1006,6 +1060,10 @@ static struct attribute *disk_attrs[] = {
 	&dev_attr_capability.attr,
 	&dev_attr_stat.attr,
 	&dev_attr_inflight.attr,
+#ifdef CONFIG_BLK_DEV_IO_HIST
+	&dev_attr_io_lat_hist.attr,
+	&dev_attr_io_size_hist.attr,
+#endif
 #ifdef CONFIG_FAIL_MAKE_REQUEST
 	&dev_attr_fail.attr,
 #endif
@@ -1101,6 +1159,9 @@ static void disk_release(struct device *dev)
 	disk_replace_part_tbl(disk, NULL);
 	free_part_stats(&disk->part0);
 	free_part_info(&disk->part0);
+#ifdef CONFIG_BLK_DEV_IO_HIST
+	free_percpu(disk->io_hist);
+#endif
 	if (disk->queue)
 		blk_put_queue(disk->queue);
 	kfree(disk);
@@ -1256,8 +1317,19 @@ struct gendisk *alloc_disk_node(int minors, int node_id)
 			kfree(disk);
 			return NULL;
 		}
+#ifdef CONFIG_BLK_DEV_IO_HIST
+		disk->io_hist = alloc_percpu(struct disk_io_hist);
+		if (!disk->io_hist) {
+			free_part_stats(&disk->part0);
+			kfree(disk);
+			return NULL;
+		}
+#endif
 		disk->node_id = node_id;
 		if (disk_expand_part_tbl(disk, 0)) {
+#ifdef CONFIG_BLK_DEV_IO_HIST
+			free_percpu(disk->io_hist);
+#endif
 			free_part_stats(&disk->part0);
 			kfree(disk);
 			return NULL;
@@ -27,6 +27,7 @@
 #include <linux/splice.h>
 #include <linux/pfn.h>
 #include <linux/export.h>
+#include <linux/shmem_fs.h>
 
 #include <asm/uaccess.h>
 #include <asm/io.h>
@@ -678,6 +679,24 @@ static int mmap_zero(struct file *file, struct vm_area_struct *vma)
 	return 0;
 }
 
+#ifdef CONFIG_MMU
+static unsigned long get_unmapped_area_zero(struct file *file,
+				unsigned long addr, unsigned long len,
+				unsigned long pgoff, unsigned long flags)
+{
+	/*
+	 * mmap_zero() will call shmem_zero_setup() to create a file, so use
+	 * shmem's get_unmapped_area in case it can be huge; passing NULL for
+	 * the file, as mm/mmap.c does, so as not to confuse it with ours.
+	 */
+	if (flags & MAP_SHARED)
+		return shmem_get_unmapped_area(NULL, addr, len, pgoff, flags);
+	return current->mm->get_unmapped_area(file, addr, len, pgoff, flags);
+}
+#else
+#define get_unmapped_area_zero	NULL
+#endif
+
 static ssize_t write_full(struct file *file, const char __user *buf,
 			  size_t count, loff_t *ppos)
 {
@@ -781,6 +800,7 @@ static const struct file_operations zero_fops = {
 	.read		= read_zero,
 	.write		= write_zero,
 	.mmap		= mmap_zero,
+	.get_unmapped_area = get_unmapped_area_zero,
 };
 
 /*
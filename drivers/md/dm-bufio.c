@@ -15,6 +15,7 @@
 #include <linux/version.h>
 #include <linux/shrinker.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 
 #define DM_MSG_PREFIX "bufio"
 
@@ -85,6 +86,23 @@
  *	dirty_lru too.  They are later added to lru in the process
  *	context.
  */
+/*
+ * Per-client cache counters.  A read or get is a hit if the block was
+ * cached (or being prefetched) and a miss otherwise.  Evictions count
+ * buffers freed to make room or by the shrinker and age-based cleanup.
+ *
+ * They are per-cpu, so that client_stats can sum them up without taking
+ * the client lock, which nests outside dm_bufio_clients_lock.
+ */
+struct dm_bufio_stats {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	unsigned long prefetches;
+};
+
+#define dm_bufio_stat_inc(c, field)	this_cpu_inc((c)->stats->field)
+
 struct dm_bufio_client {
 	struct mutex lock;
 
@@ -110,6 +128,9 @@ struct dm_bufio_client {
 
 	int async_write_error;
 
+	unsigned long quota_bytes;
+	struct dm_bufio_stats __percpu *stats;
+
 	struct list_head client_list;
 	struct shrinker shrinker;
 };
@@ -737,8 +758,10 @@ static struct dm_buffer *__alloc_buffer_wait_no_callback(struct dm_bufio_client
 		}
 
 		b = __get_unclaimed_buffer(c);
-		if (b)
+		if (b) {
+			dm_bufio_stat_inc(c, evictions);
 			return b;
+		}
 
 		__wait_for_free_buffer(c);
 	}
@@ -792,6 +815,26 @@ static void __write_dirty_buffers_async(struct dm_bufio_client *c, int no_wait)
 	}
 }
 
+/*
+ * The number of buffers a client may hold: its quota if one was set, but
+ * no more than the whole cache, or else an equal share of the cache.
+ */
+static unsigned long client_limit_buffers(struct dm_bufio_client *c)
+{
+	unsigned long bytes = dm_bufio_cache_size_per_client;
+	unsigned long buffers;
+
+	if (c->quota_bytes)
+		bytes = min(c->quota_bytes, dm_bufio_cache_size_latch);
+
+	buffers = bytes >> (c->sectors_per_block_bits + SECTOR_SHIFT);
+
+	if (buffers < DM_BUFIO_MIN_BUFFERS)
+		buffers = DM_BUFIO_MIN_BUFFERS;
+
+	return buffers;
+}
+
 /*
  * Get writeback threshold and buffer limit for a given client.
  */
@@ -807,11 +850,7 @@ static void __get_memory_limit(struct dm_bufio_client *c,
 		mutex_unlock(&dm_bufio_clients_lock);
 	}
 
-	buffers = dm_bufio_cache_size_per_client >>
-		  (c->sectors_per_block_bits + SECTOR_SHIFT);
-
-	if (buffers < DM_BUFIO_MIN_BUFFERS)
-		buffers = DM_BUFIO_MIN_BUFFERS;
+	buffers = client_limit_buffers(c);
 
 	*limit_buffers = buffers;
 	*threshold_buffers = buffers * DM_BUFIO_WRITEBACK_PERCENT / 100;
@@ -836,6 +875,7 @@ static void __check_watermark(struct dm_bufio_client *c)
 		if (!b)
 			return;
 
+		dm_bufio_stat_inc(c, evictions);
 		__free_buffer_wake(b);
 		dm_bufio_cond_resched();
 	}
@@ -869,7 +909,8 @@ static struct dm_buffer *__find(struct dm_bufio_client *c, sector_t block)
 enum new_flag {
 	NF_FRESH = 0,
 	NF_READ = 1,
-	NF_GET = 2
+	NF_GET = 2,
+	NF_PREFETCH = 3
 };
 
 static struct dm_buffer *__bufio_new(struct dm_bufio_client *c, sector_t block,
@@ -881,12 +922,11 @@ static struct dm_buffer *__bufio_new(struct dm_bufio_client *c, sector_t block,
 	*need_submit = 0;
 
 	b = __find(c, block);
-	if (b) {
-		b->hold_count++;
-		__relink_lru(b, test_bit(B_DIRTY, &b->state) ||
-			     test_bit(B_WRITING, &b->state));
-		return b;
-	}
+	if (b)
+		goto found_buffer;
+
+	if (nf == NF_READ || nf == NF_GET)
+		dm_bufio_stat_inc(c, misses);
 
 	if (nf == NF_GET)
 		return NULL;
@@ -900,10 +940,7 @@ static struct dm_buffer *__bufio_new(struct dm_bufio_client *c, sector_t block,
 	b = __find(c, block);
 	if (b) {
 		__free_buffer_wake(new_b);
-		b->hold_count++;
-		__relink_lru(b, test_bit(B_DIRTY, &b->state) ||
-			     test_bit(B_WRITING, &b->state));
-		return b;
+		goto found_buffer;
 	}
 
 	__check_watermark(c);
@@ -922,6 +959,25 @@ static struct dm_buffer *__bufio_new(struct dm_bufio_client *c, sector_t block,
 	b->state = 1 << B_READING;
 	*need_submit = 1;
 
+	if (nf == NF_PREFETCH)
+		dm_bufio_stat_inc(c, prefetches);
+
+	return b;
+
+found_buffer:
+	/*
+	 * A prefetch of a block that is already cached, or that somebody
+	 * else is already reading, has nothing to do.
+	 */
+	if (nf == NF_PREFETCH)
+		return NULL;
+
+	if (nf == NF_READ || nf == NF_GET)
+		dm_bufio_stat_inc(c, hits);
+
+	b->hold_count++;
+	__relink_lru(b, test_bit(B_DIRTY, &b->state) ||
+		     test_bit(B_WRITING, &b->state));
 	return b;
 }
 
@@ -1006,13 +1062,54 @@ void *dm_bufio_new(struct dm_bufio_client *c, sector_t block,
 }
 EXPORT_SYMBOL_GPL(dm_bufio_new);
 
+/*
+ * Start reading the blocks in the background.  The reads of a run are
+ * submitted under one plug, so adjacent blocks get merged into large
+ * requests.  Blocks that are already cached are skipped.
+ */
+void dm_bufio_prefetch(struct dm_bufio_client *c,
+		       sector_t block, unsigned n_blocks)
+{
+	struct blk_plug plug;
+
+	BUG_ON(dm_bufio_in_request());
+
+	blk_start_plug(&plug);
+	dm_bufio_lock(c);
+
+	for (; n_blocks--; block++) {
+		int need_submit;
+		struct dm_buffer *b;
+
+		b = __bufio_new(c, block, NF_PREFETCH, NULL, &need_submit);
+		if (unlikely(b != NULL)) {
+			dm_bufio_unlock(c);
+
+			if (need_submit)
+				submit_io(b, READ, b->block, read_endio);
+			dm_bufio_release(b);
+
+			dm_bufio_cond_resched();
+
+			if (!n_blocks)
+				goto flush_plug;
+			dm_bufio_lock(c);
+		}
+	}
+
+	dm_bufio_unlock(c);
+
+flush_plug:
+	blk_finish_plug(&plug);
+}
+EXPORT_SYMBOL_GPL(dm_bufio_prefetch);
+
 void dm_bufio_release(struct dm_buffer *b)
 {
 	struct dm_bufio_client *c = b->c;
 
 	dm_bufio_lock(c);
 
-	BUG_ON(test_bit(B_READING, &b->state));
 	BUG_ON(!b->hold_count);
 
 	b->hold_count--;
@@ -1022,9 +1119,11 @@ void dm_bufio_release(struct dm_buffer *b)
 		/*
 		 * If there were errors on the buffer, and the buffer is not
 		 * to be written, free the buffer. There is no point in caching
-		 * invalid buffer.
+		 * invalid buffer.  A prefetched buffer may still be being
+		 * read; it is dealt with when it is next looked up.
 		 */
 		if ((b->read_error || b->write_error) &&
+		    !test_bit(B_READING, &b->state) &&
 		    !test_bit(B_WRITING, &b->state) &&
 		    !test_bit(B_DIRTY, &b->state)) {
 			__unlink_buffer(b);
@@ -1269,6 +1368,15 @@ struct dm_bufio_client *dm_bufio_get_client(struct dm_buffer *b)
 }
 EXPORT_SYMBOL_GPL(dm_bufio_get_client);
 
+void dm_bufio_set_quota(struct dm_bufio_client *c, unsigned long bytes)
+{
+	dm_bufio_lock(c);
+	c->quota_bytes = bytes;
+	__check_watermark(c);
+	dm_bufio_unlock(c);
+}
+EXPORT_SYMBOL_GPL(dm_bufio_set_quota);
+
 static void drop_buffers(struct dm_bufio_client *c)
 {
 	struct dm_buffer *b;
@@ -1319,6 +1427,7 @@ static int __cleanup_old_buffer(struct dm_buffer *b, gfp_t gfp,
 	if (b->hold_count)
 		return 1;
 
+	dm_bufio_stat_inc(b->c, evictions);
 	__make_buffer_clean(b);
 	__unlink_buffer(b);
 	__free_buffer_wake(b);
@@ -1390,6 +1499,11 @@ struct dm_bufio_client *dm_bufio_client_create(struct block_device *bdev, unsign
 		r = -ENOMEM;
 		goto bad_hash;
 	}
+	c->stats = alloc_percpu(struct dm_bufio_stats);
+	if (!c->stats) {
+		r = -ENOMEM;
+		goto bad_stats;
+	}
 
 	c->bdev = bdev;
 	c->block_size = block_size;
@@ -1481,6 +1595,8 @@ bad_cache:
 	}
 	dm_io_client_destroy(c->dm_io);
 bad_dm_io:
+	free_percpu(c->stats);
+bad_stats:
 	vfree(c->cache_hash);
 bad_hash:
 	kfree(c);
@@ -1529,6 +1645,7 @@ void dm_bufio_client_destroy(struct dm_bufio_client *c)
 		BUG_ON(c->n_buffers[i]);
 
 	dm_io_client_destroy(c->dm_io);
+	free_percpu(c->stats);
 	vfree(c->cache_hash);
 	kfree(c);
 }
@@ -1674,6 +1791,56 @@ static void __exit dm_bufio_exit(void)
 module_init(dm_bufio_init)
 module_exit(dm_bufio_exit)
 
+static void dm_bufio_sum_stats(struct dm_bufio_client *c,
+			       struct dm_bufio_stats *sum)
+{
+	int cpu;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		struct dm_bufio_stats *s = per_cpu_ptr(c->stats, cpu);
+
+		sum->hits += s->hits;
+		sum->misses += s->misses;
+		sum->evictions += s->evictions;
+		sum->prefetches += s->prefetches;
+	}
+}
+
+/*
+ * One line per client:
+ *	<device> <block size> <buffers> <limit bytes> <hits> <misses>
+ *	<evictions> <prefetches>
+ * The buffer count is sampled without the client lock; each counter is
+ * the sum of its per-cpu parts.
+ */
+static int dm_bufio_get_client_stats(char *buffer, const struct kernel_param *kp)
+{
+	struct dm_bufio_client *c;
+	struct dm_bufio_stats stats;
+	char name[BDEVNAME_SIZE];
+	int len = 0;
+
+	mutex_lock(&dm_bufio_clients_lock);
+	list_for_each_entry(c, &dm_bufio_all_clients, client_list) {
+		dm_bufio_sum_stats(c, &stats);
+		len += scnprintf(buffer + len, PAGE_SIZE - len,
+				 "%s %u %lu %lu %lu %lu %lu %lu\n",
+				 bdevname(c->bdev, name), c->block_size,
+				 c->n_buffers[LIST_CLEAN] + c->n_buffers[LIST_DIRTY],
+				 client_limit_buffers(c) * c->block_size,
+				 stats.hits, stats.misses,
+				 stats.evictions, stats.prefetches);
+	}
+	mutex_unlock(&dm_bufio_clients_lock);
+
+	return len;
+}
+
+static struct kernel_param_ops dm_bufio_client_stats_ops = {
+	.get = dm_bufio_get_client_stats,
+};
+
 module_param_named(max_cache_size_bytes, dm_bufio_cache_size, ulong, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(max_cache_size_bytes, "Size of metadata cache");
 
@@ -1695,6 +1862,9 @@ MODULE_PARM_DESC(allocated_vmalloc_bytes, "Memory allocated with vmalloc");
 module_param_named(current_allocated_bytes, dm_bufio_current_allocated, ulong, S_IRUGO);
 MODULE_PARM_DESC(current_allocated_bytes, "Memory currently used by the cache");
 
+module_param_cb(client_stats, &dm_bufio_client_stats_ops, NULL, S_IRUGO);
+MODULE_PARM_DESC(client_stats, "Per-client cache usage, hits, misses, evictions and prefetches");
+
 MODULE_AUTHOR("Mikulas Patocka <dm-devel@redhat.com>");
 MODULE_DESCRIPTION(DM_NAME " buffered I/O library");
 MODULE_LICENSE("GPL");
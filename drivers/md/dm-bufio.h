@@ -62,6 +62,14 @@ void *dm_bufio_get(struct dm_bufio_client *c, sector_t block,
 void *dm_bufio_new(struct dm_bufio_client *c, sector_t block,
 		   struct dm_buffer **bp);
 
+/*
+ * Prefetch the specified blocks to the cache.
+ * The function starts to read the blocks and returns without waiting for
+ * I/O to finish.
+ */
+void dm_bufio_prefetch(struct dm_bufio_client *c,
+		       sector_t block, unsigned n_blocks);
+
 /*
  * Release a reference obtained with dm_bufio_{read,get,new}. The data
  * pointer and dm_buffer pointer is no longer valid after this call.
@@ -107,6 +115,12 @@ void *dm_bufio_get_block_data(struct dm_buffer *b);
 void *dm_bufio_get_aux_data(struct dm_buffer *b);
 struct dm_bufio_client *dm_bufio_get_client(struct dm_buffer *b);
 
+/*
+ * Limit the memory used by this client's buffers to @bytes.  0 restores
+ * the default, an equal share of max_cache_size_bytes.
+ */
+void dm_bufio_set_quota(struct dm_bufio_client *c, unsigned long bytes);
+
 /*----------------------------------------------------------------*/
 
 #endif
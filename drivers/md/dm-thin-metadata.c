@@ -514,6 +514,14 @@ static int __begin_transaction(struct dm_pool_metadata *pmd)
 	pmd->flags = le32_to_cpu(disk_super->flags);
 	pmd->data_block_size = le32_to_cpu(disk_super->data_block_size);
 
+	/*
+	 * Every lookup starts at one of these roots; get them coming in
+	 * while the superblock is checked.  Nothing happens if they are
+	 * already cached, as they usually are after a commit.
+	 */
+	dm_tm_prefetch(pmd->tm, pmd->root);
+	dm_tm_prefetch(pmd->tm, pmd->details_root);
+
 	features = le32_to_cpu(disk_super->incompat_flags) & ~THIN_FEATURE_INCOMPAT_SUPP;
 	if (features) {
 		DMERR("could not access metadata due to "
@@ -1056,6 +1064,12 @@ int dm_pool_set_metadata_transaction_id(struct dm_pool_metadata *pmd,
 	return 0;
 }
 
+void dm_pool_set_metadata_cache_quota(struct dm_pool_metadata *pmd,
+				      unsigned long bytes)
+{
+	dm_bm_set_cache_quota(pmd->bm, bytes);
+}
+
 int dm_pool_get_metadata_transaction_id(struct dm_pool_metadata *pmd,
 					uint64_t *result)
 {
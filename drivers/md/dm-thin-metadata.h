@@ -75,6 +75,12 @@ int dm_pool_set_metadata_transaction_id(struct dm_pool_metadata *pmd,
 int dm_pool_get_metadata_transaction_id(struct dm_pool_metadata *pmd,
 					uint64_t *result);
 
+/*
+ * Limit the memory used to cache metadata blocks, 0 for the default.
+ */
+void dm_pool_set_metadata_cache_quota(struct dm_pool_metadata *pmd,
+				      unsigned long bytes);
+
 /*
  * Hold/get root for userspace transaction.
  */
@@ -2020,6 +2020,25 @@ static int process_set_transaction_id_mesg(unsigned argc, char **argv, struct po
 	return 0;
 }
 
+static int process_set_metadata_cache_quota_mesg(unsigned argc, char **argv, struct pool *pool)
+{
+	unsigned long bytes;
+	int r;
+
+	r = check_arg_count(argc, 2);
+	if (r)
+		return r;
+
+	if (kstrtoul(argv[1], 10, &bytes)) {
+		DMWARN("set_metadata_cache_quota message: Unrecognised size %s.", argv[1]);
+		return -EINVAL;
+	}
+
+	dm_pool_set_metadata_cache_quota(pool->pmd, bytes);
+
+	return 0;
+}
+
 /*
  * Messages supported:
  *   create_thin	<dev_id>
@@ -2027,6 +2046,7 @@ static int process_set_transaction_id_mesg(unsigned argc, char **argv, struct po
  *   delete		<dev_id>
  *   trim		<dev_id> <new_size_in_sectors>
  *   set_transaction_id <current_trans_id> <new_trans_id>
+ *   set_metadata_cache_quota <bytes>
  */
 static int pool_message(struct dm_target *ti, unsigned argc, char **argv)
 {
@@ -2046,6 +2066,9 @@ static int pool_message(struct dm_target *ti, unsigned argc, char **argv)
 	else if (!strcasecmp(argv[0], "set_transaction_id"))
 		r = process_set_transaction_id_mesg(argc, argv, pool);
 
+	else if (!strcasecmp(argv[0], "set_metadata_cache_quota"))
+		r = process_set_metadata_cache_quota_mesg(argc, argv, pool);
+
 	else
 		DMWARN("Unrecognised thin pool target message received: %s", argv[0]);
 
@@ -581,6 +581,18 @@ int dm_bm_unlock_move(struct dm_block *b, dm_block_t n)
 	return 0;
 }
 
+void dm_bm_prefetch(struct dm_block_manager *bm, dm_block_t b)
+{
+	dm_bufio_prefetch(to_bufio(bm), b, 1);
+}
+EXPORT_SYMBOL_GPL(dm_bm_prefetch);
+
+void dm_bm_set_cache_quota(struct dm_block_manager *bm, unsigned long bytes)
+{
+	dm_bufio_set_quota(to_bufio(bm), bytes);
+}
+EXPORT_SYMBOL_GPL(dm_bm_set_cache_quota);
+
 int dm_bm_flush_and_unlock(struct dm_block_manager *bm,
 			   struct dm_block *superblock)
 {
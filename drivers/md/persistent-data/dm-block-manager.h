@@ -96,6 +96,17 @@ int dm_bm_write_lock_zero(struct dm_block_manager *bm, dm_block_t b,
 
 int dm_bm_unlock(struct dm_block *b);
 
+/*
+ * Request data be prefetched into the cache.  The block isn't locked or
+ * validated; that happens when it is next locked.
+ */
+void dm_bm_prefetch(struct dm_block_manager *bm, dm_block_t b);
+
+/*
+ * Limit the memory the cache uses to @bytes, 0 for the default share.
+ */
+void dm_bm_set_cache_quota(struct dm_block_manager *bm, unsigned long bytes);
+
 /*
  * An optimisation; we often want to copy a block's contents to a new
  * block.  eg, as part of the shadowing operation.  It's far better for
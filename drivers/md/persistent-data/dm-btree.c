@@ -223,6 +223,26 @@ static int push_frame(struct del_stack *s, dm_block_t b, unsigned level)
 	return 0;
 }
 
+/*
+ * Start reading all the unshared children of a node before descending
+ * into the first one, so the walk isn't one synchronous read per node.
+ */
+static void prefetch_children(struct del_stack *s, struct frame *f)
+{
+	unsigned i;
+	uint32_t ref_count;
+	struct blk_plug plug;
+
+	blk_start_plug(&plug);
+	for (i = 0; i < f->nr_children; i++) {
+		dm_block_t b = value64(f->n, i);
+
+		if (!dm_tm_ref(s->tm, b, &ref_count) && ref_count == 1)
+			dm_tm_prefetch(s->tm, b);
+	}
+	blk_finish_plug(&plug);
+}
+
 static void pop_frame(struct del_stack *s)
 {
 	struct frame *f = s->spine + s->top--;
@@ -261,6 +281,10 @@ int dm_btree_del(struct dm_btree_info *info, dm_block_t root)
 		}
 
 		flags = le32_to_cpu(f->n->header.flags);
+		if (!f->current_child &&
+		    ((flags & INTERNAL_NODE) || f->level != (info->levels - 1)))
+			prefetch_children(s, f);
+
 		if (flags & INTERNAL_NODE) {
 			b = value64(f->n, f->current_child);
 			f->current_child++;
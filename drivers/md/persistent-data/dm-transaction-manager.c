@@ -266,6 +266,18 @@ int dm_tm_unlock(struct dm_transaction_manager *tm, struct dm_block *b)
 }
 EXPORT_SYMBOL_GPL(dm_tm_unlock);
 
+void dm_tm_prefetch(struct dm_transaction_manager *tm, dm_block_t b)
+{
+	/*
+	 * The non-blocking clone doesn't support this.
+	 */
+	if (tm->is_clone)
+		return;
+
+	dm_bm_prefetch(tm->bm, b);
+}
+EXPORT_SYMBOL_GPL(dm_tm_prefetch);
+
 void dm_tm_inc(struct dm_transaction_manager *tm, dm_block_t b)
 {
 	/*
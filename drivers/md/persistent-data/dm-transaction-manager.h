@@ -97,6 +97,12 @@ int dm_tm_read_lock(struct dm_transaction_manager *tm, dm_block_t b,
 
 int dm_tm_unlock(struct dm_transaction_manager *tm, struct dm_block *b);
 
+/*
+ * Start reading a block in the background.  A no-op for the non-blocking
+ * clone.
+ */
+void dm_tm_prefetch(struct dm_transaction_manager *tm, dm_block_t b);
+
 /*
  * Functions for altering the reference count of a block directly.
  */
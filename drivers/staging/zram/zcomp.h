@@ -0,0 +1,50 @@
+/*
+ * Compression streams for zram
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/crypto.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+/* Everything one (de)compression in progress needs */
+struct zcomp_strm {
+	struct crypto_comp *tfm;
+	/* compressed output: two pages, in case a page does not compress */
+	void *buffer;
+	struct list_head list;
+};
+
+/* A pool of streams for one compression algorithm */
+struct zcomp {
+	char name[CRYPTO_MAX_ALG_NAME];
+
+	spinlock_t strm_lock;		/* protects the fields below */
+	struct list_head idle_strm;
+	int avail_strm;			/* streams allocated */
+	int max_strm;
+	wait_queue_head_t strm_wait;
+};
+
+extern bool zcomp_available(const char *name);
+extern ssize_t zcomp_available_show(const char *cur, char *buf);
+
+extern struct zcomp *zcomp_create(const char *name, int max_strm);
+extern void zcomp_destroy(struct zcomp *comp);
+extern void zcomp_set_max_streams(struct zcomp *comp, int max_strm);
+
+extern struct zcomp_strm *zcomp_strm_find(struct zcomp *comp);
+extern void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm);
+
+extern int zcomp_compress(struct zcomp_strm *zstrm, const unsigned char *src,
+			  size_t *dst_len);
+extern int zcomp_decompress(struct zcomp_strm *zstrm, const unsigned char *src,
+			    size_t src_len, unsigned char *dst);
+
+#endif
@@ -247,7 +247,7 @@ void bio_free(struct bio *bio, struct bio_set *bs)
 	if (bs->front_pad)
 		p -= bs->front_pad;
 
-	mempool_free(p, bs->bio_pool);
+	mempool_cache_free(p, bs->bio_pool, bs->bio_cache, BIO_CPU_CACHE);
 }
 EXPORT_SYMBOL(bio_free);
 
@@ -266,7 +266,9 @@ EXPORT_SYMBOL(bio_init);
  * @bs:		the bio_set to allocate from.
  *
  * Description:
- *   bio_alloc_bioset will try its own mempool to satisfy the allocation.
+ *   bio_alloc_bioset first reuses a bio recently freed on this cpu, then
+ *   refills this cpu's bios from the slab in one batch, and only then
+ *   tries its own mempool to satisfy the allocation.
  *   If %__GFP_WAIT is set then we will block on the internal pool waiting
  *   for a &struct bio to become free.
  *
@@ -281,7 +283,8 @@ struct bio *bio_alloc_bioset(gfp_t gfp_mask, int nr_iovecs, struct bio_set *bs)
 	struct bio *bio;
 	void *p;
 
-	p = mempool_alloc(bs->bio_pool, gfp_mask);
+	p = mempool_cache_alloc(bs->bio_pool, bs->bio_cache, gfp_mask,
+				BIO_CPU_BATCH);
 	if (unlikely(!p))
 		return NULL;
 	bio = p + bs->front_pad;
@@ -308,7 +311,7 @@ out_set:
 	return bio;
 
 err_free:
-	mempool_free(p, bs->bio_pool);
+	mempool_cache_free(p, bs->bio_pool, bs->bio_cache, BIO_CPU_CACHE);
 	return NULL;
 }
 EXPORT_SYMBOL(bio_alloc_bioset);
@@ -1591,8 +1594,10 @@ static void biovec_free_pools(struct bio_set *bs)
 
 void bioset_free(struct bio_set *bs)
 {
-	if (bs->bio_pool)
+	if (bs->bio_pool) {
+		mempool_cpu_cache_destroy(bs->bio_pool, bs->bio_cache);
 		mempool_destroy(bs->bio_pool);
+	}
 
 	bioset_integrity_free(bs);
 	biovec_free_pools(bs);
@@ -1636,6 +1641,9 @@ struct bio_set *bioset_create(unsigned int pool_size, unsigned int front_pad)
 	if (!bs->bio_pool)
 		goto bad;
 
+	/* optional, without it every bio comes from the pool */
+	bs->bio_cache = mempool_cpu_cache_create();
+
 	if (!biovec_create_pools(bs, pool_size))
 		return bs;
 
@@ -129,6 +129,7 @@ struct dio {
 	unsigned long refcount;		/* direct_io_worker() and bios */
 	struct bio *bio_list;		/* singly linked via bi_private */
 	struct task_struct *waiter;	/* waiting task (NULL if none) */
+	struct request_queue *poll_q;	/* poll for completions (sync only) */
 
 	/* AIO related stuff */
 	struct kiocb *iocb;		/* kiocb */
@@ -425,6 +426,8 @@ static inline void dio_bio_submit(struct dio *dio, struct dio_submit *sdio)
 	if (sdio->submit_io)
 		sdio->submit_io(dio->rw, bio, dio->inode,
 			       sdio->logical_offset_in_bio);
+	else if (dio->poll_q)
+		submit_bio(dio->rw | REQ_HIPRI, bio);
 	else
 		submit_bio(dio->rw, bio);
 
@@ -452,6 +455,7 @@ static struct bio *dio_await_one(struct dio *dio)
 {
 	unsigned long flags;
 	struct bio *bio = NULL;
+	bool first_poll = true;
 
 	spin_lock_irqsave(&dio->bio_lock, flags);
 
@@ -465,7 +469,9 @@ static struct bio *dio_await_one(struct dio *dio)
 		__set_current_state(TASK_UNINTERRUPTIBLE);
 		dio->waiter = current;
 		spin_unlock_irqrestore(&dio->bio_lock, flags);
-		io_schedule();
+		if (!dio->poll_q || !blk_poll(dio->poll_q, first_poll))
+			io_schedule();
+		first_poll = false;
 		/* wake up sets us TASK_RUNNING */
 		spin_lock_irqsave(&dio->bio_lock, flags);
 		dio->waiter = NULL;
@@ -1186,6 +1192,13 @@ __blockdev_direct_IO(int rw, struct kiocb *iocb, struct inode *inode,
 	dio->is_async = !is_sync_kiocb(iocb) && !((rw & WRITE) &&
 		(end > i_size_read(inode)));
 
+	/*
+	 * Synchronous I/O to a queue with polling enabled: spin for the
+	 * completions rather than waiting for the interrupt.
+	 */
+	if (!dio->is_async && bdev && blk_queue_poll(bdev_get_queue(bdev)))
+		dio->poll_q = bdev_get_queue(bdev);
+
 	retval = 0;
 
 	dio->inode = inode;
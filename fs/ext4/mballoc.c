@@ -2567,6 +2567,9 @@ int ext4_mb_release(struct super_block *sb)
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	struct kmem_cache *cachep = get_groupinfo_cache(sb->s_blocksize_bits);
 
+	/* the journal is gone, so no more discards will be queued */
+	blkdev_flush_discards(sb->s_bdev);
+
 	if (sbi->s_group_info) {
 		for (i = 0; i < ngroups; i++) {
 			grinfo = ext4_get_group_info(sb, i);
@@ -2633,6 +2636,26 @@ static inline int ext4_issue_discard(struct super_block *sb,
 	return sb_issue_discard(sb, discard_block, count, GFP_NOFS, 0);
 }
 
+/*
+ * Like ext4_issue_discard(), but leave the discard to the block layer's
+ * background queue so that the jbd2 commit does not wait on it.  Before
+ * the blocks are handed out again ext4_mb_mark_diskspace_used() cancels
+ * whatever is still pending.
+ */
+static void ext4_queue_discard(struct super_block *sb,
+		ext4_group_t block_group, ext4_grpblk_t cluster, int count)
+{
+	ext4_fsblk_t discard_block;
+
+	discard_block = (EXT4_C2B(EXT4_SB(sb), cluster) +
+			 ext4_group_first_block_no(sb, block_group));
+	count = EXT4_C2B(EXT4_SB(sb), count);
+	trace_ext4_discard_blocks(sb,
+			(unsigned long long) discard_block, count);
+	if (sb_queue_discard(sb, discard_block, count, GFP_NOFS) == -ENOMEM)
+		sb_issue_discard(sb, discard_block, count, GFP_NOFS, 0);
+}
+
 /*
  * This function is called by the jbd2 layer once the commit has finished,
  * so we know we can free the blocks that were released with that commit.
@@ -2653,7 +2676,7 @@ static void release_blocks_on_commit(journal_t *journal, transaction_t *txn)
 			 entry->count, entry->group, entry);
 
 		if (test_opt(sb, DISCARD))
-			ext4_issue_discard(sb, entry->group,
+			ext4_queue_discard(sb, entry->group,
 					   entry->start_cluster, entry->count);
 
 		err = ext4_mb_load_buddy(sb, entry->group, &e4b);
@@ -2830,6 +2853,13 @@ ext4_mb_mark_diskspace_used(struct ext4_allocation_context *ac,
 		goto out_err;
 	}
 
+	/*
+	 * The blocks may still have a discard queued from when they were
+	 * last freed.  Checked regardless of the discard mount option, which
+	 * may have been turned off by a remount since.
+	 */
+	sb_cancel_discard(sb, block, len);
+
 	ext4_lock_group(sb, ac->ac_b_ex.fe_group);
 #ifdef AGGRESSIVE_CHECK
 	{
@@ -529,6 +529,11 @@ static long writeback_sb_inodes(struct super_block *sb,
 				struct bdi_writeback *wb,
 				struct wb_writeback_work *work)
 {
+	/*
+	 * for_kupdate and for_background mark the I/O as flusher writeback
+	 * (REQ_BACKGROUND, see wbc_to_write_flags()), which the block layer
+	 * may hold back to keep read latency down.
+	 */
 	struct writeback_control wbc = {
 		.sync_mode		= work->sync_mode,
 		.tagged_writepages	= work->tagged_writepages,
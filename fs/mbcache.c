@@ -20,6 +20,11 @@
  * and may also be in the lru list. An invalid entry is not in any hashes
  * or lists.
  *
+ * The lru list is a per-node list_lru: an entry sits on the list of the
+ * node its memory was allocated from, so that reclaim on a node only
+ * frees the entries living there. mb_cache_spinlock nests outside of the
+ * list_lru lock.
+ *
  * A valid cache entry is only in the lru list if no handles refer to it.
  * Invalid cache entries will be freed when the last handle to the cache
  * entry is released. Entries that cannot be freed immediately are put
@@ -35,6 +40,7 @@
 #include <linux/slab.h>
 #include <linux/sched.h>
 #include <linux/init.h>
+#include <linux/list_lru.h>
 #include <linux/mbcache.h>
 
 
@@ -83,7 +89,7 @@ EXPORT_SYMBOL(mb_cache_entry_find_next);
  */
 
 static LIST_HEAD(mb_cache_list);
-static LIST_HEAD(mb_cache_lru_list);
+static struct list_lru mb_cache_lru;
 static DEFINE_SPINLOCK(mb_cache_spinlock);
 
 /*
@@ -96,6 +102,7 @@ static int mb_cache_shrink_fn(struct shrinker *shrink,
 static struct shrinker mb_cache_shrinker = {
 	.shrink = mb_cache_shrink_fn,
 	.seeks = DEFAULT_SEEKS,
+	.flags = SHRINKER_NUMA_AWARE,
 };
 
 static inline int
@@ -140,7 +147,7 @@ __mb_cache_entry_release_unlock(struct mb_cache_entry *ce)
 		if (!__mb_cache_entry_is_hashed(ce))
 			goto forget;
 		mb_assert(list_empty(&ce->e_lru_list));
-		list_add_tail(&ce->e_lru_list, &mb_cache_lru_list);
+		list_lru_add(&mb_cache_lru, &ce->e_lru_list);
 	}
 	spin_unlock(&mb_cache_spinlock);
 	return;
@@ -150,6 +157,39 @@ forget:
 }
 
 
+/*
+ * Take an unused entry off the lru list and out of the hashes, moving it
+ * to the private list @arg. Called with mb_cache_spinlock held.
+ */
+static enum lru_status
+mb_cache_lru_isolate_locked(struct list_head *item, spinlock_t *lock,
+			    void *arg)
+{
+	struct mb_cache_entry *ce =
+		list_entry(item, struct mb_cache_entry, e_lru_list);
+
+	list_move_tail(&ce->e_lru_list, arg);
+	__mb_cache_entry_unhash(ce);
+	return LRU_REMOVED;
+}
+
+/*
+ * The shrinker walks the lru list without mb_cache_spinlock, which nests
+ * outside of the list_lru lock, so it can only trylock here.
+ */
+static enum lru_status
+mb_cache_lru_isolate(struct list_head *item, spinlock_t *lock, void *arg)
+{
+	enum lru_status ret;
+
+	if (!spin_trylock(&mb_cache_spinlock))
+		return LRU_SKIP;
+	ret = mb_cache_lru_isolate_locked(item, lock, arg);
+	spin_unlock(&mb_cache_spinlock);
+	return ret;
+}
+
+
 /*
  * mb_cache_shrink_fn()  memory pressure callback
  *
@@ -159,36 +199,26 @@ forget:
  * @shrink: (ignored)
  * @sc: shrink_control passed from reclaim
  *
- * Returns the number of objects which are present in the cache.
+ * Returns the number of unused entries on the node being reclaimed.
  */
 static int
 mb_cache_shrink_fn(struct shrinker *shrink, struct shrink_control *sc)
 {
 	LIST_HEAD(free_list);
-	struct mb_cache *cache;
 	struct mb_cache_entry *entry, *tmp;
-	int count = 0;
-	int nr_to_scan = sc->nr_to_scan;
+	unsigned long count;
 	gfp_t gfp_mask = sc->gfp_mask;
 
-	mb_debug("trying to free %d entries", nr_to_scan);
-	spin_lock(&mb_cache_spinlock);
-	while (nr_to_scan-- && !list_empty(&mb_cache_lru_list)) {
-		struct mb_cache_entry *ce =
-			list_entry(mb_cache_lru_list.next,
-				   struct mb_cache_entry, e_lru_list);
-		list_move_tail(&ce->e_lru_list, &free_list);
-		__mb_cache_entry_unhash(ce);
-	}
-	list_for_each_entry(cache, &mb_cache_list, c_cache_list) {
-		mb_debug("cache %s (%d)", cache->c_name,
-			  atomic_read(&cache->c_entry_count));
-		count += atomic_read(&cache->c_entry_count);
-	}
-	spin_unlock(&mb_cache_spinlock);
-	list_for_each_entry_safe(entry, tmp, &free_list, e_lru_list) {
-		__mb_cache_entry_forget(entry, gfp_mask);
+	if (sc->nr_to_scan) {
+		mb_debug("trying to free %lu entries on node %d",
+			 sc->nr_to_scan, sc->nid);
+		list_lru_shrink_walk(&mb_cache_lru, sc, mb_cache_lru_isolate,
+				     &free_list);
+		list_for_each_entry_safe(entry, tmp, &free_list, e_lru_list) {
+			__mb_cache_entry_forget(entry, gfp_mask);
+		}
 	}
+	count = list_lru_shrink_count(&mb_cache_lru, sc);
 	return (count / 100) * sysctl_vfs_cache_pressure;
 }
 
@@ -255,6 +285,29 @@ fail:
 }
 
 
+/*
+ * Entries to take off the lru list: those of @cache, or those on @bdev.
+ */
+struct mb_cache_isolate_arg {
+	struct mb_cache		*cache;
+	struct block_device	*bdev;
+	struct list_head	free_list;
+};
+
+static enum lru_status
+mb_cache_lru_isolate_match(struct list_head *item, spinlock_t *lock,
+			   void *cb_arg)
+{
+	struct mb_cache_isolate_arg *arg = cb_arg;
+	struct mb_cache_entry *ce =
+		list_entry(item, struct mb_cache_entry, e_lru_list);
+
+	if (arg->cache ? ce->e_cache != arg->cache : ce->e_bdev != arg->bdev)
+		return LRU_SKIP;
+	return mb_cache_lru_isolate_locked(item, lock, &arg->free_list);
+}
+
+
 /*
  * mb_cache_shrink()
  *
@@ -267,20 +320,15 @@ fail:
 void
 mb_cache_shrink(struct block_device *bdev)
 {
-	LIST_HEAD(free_list);
+	struct mb_cache_isolate_arg arg = { .bdev = bdev };
 	struct list_head *l, *ltmp;
 
+	INIT_LIST_HEAD(&arg.free_list);
 	spin_lock(&mb_cache_spinlock);
-	list_for_each_safe(l, ltmp, &mb_cache_lru_list) {
-		struct mb_cache_entry *ce =
-			list_entry(l, struct mb_cache_entry, e_lru_list);
-		if (ce->e_bdev == bdev) {
-			list_move_tail(&ce->e_lru_list, &free_list);
-			__mb_cache_entry_unhash(ce);
-		}
-	}
+	list_lru_walk(&mb_cache_lru, mb_cache_lru_isolate_match, &arg,
+		      ULONG_MAX);
 	spin_unlock(&mb_cache_spinlock);
-	list_for_each_safe(l, ltmp, &free_list) {
+	list_for_each_safe(l, ltmp, &arg.free_list) {
 		__mb_cache_entry_forget(list_entry(l, struct mb_cache_entry,
 						   e_lru_list), GFP_KERNEL);
 	}
@@ -297,22 +345,17 @@ mb_cache_shrink(struct block_device *bdev)
 void
 mb_cache_destroy(struct mb_cache *cache)
 {
-	LIST_HEAD(free_list);
+	struct mb_cache_isolate_arg arg = { .cache = cache };
 	struct list_head *l, *ltmp;
 
+	INIT_LIST_HEAD(&arg.free_list);
 	spin_lock(&mb_cache_spinlock);
-	list_for_each_safe(l, ltmp, &mb_cache_lru_list) {
-		struct mb_cache_entry *ce =
-			list_entry(l, struct mb_cache_entry, e_lru_list);
-		if (ce->e_cache == cache) {
-			list_move_tail(&ce->e_lru_list, &free_list);
-			__mb_cache_entry_unhash(ce);
-		}
-	}
+	list_lru_walk(&mb_cache_lru, mb_cache_lru_isolate_match, &arg,
+		      ULONG_MAX);
 	list_del(&cache->c_cache_list);
 	spin_unlock(&mb_cache_spinlock);
 
-	list_for_each_safe(l, ltmp, &free_list) {
+	list_for_each_safe(l, ltmp, &arg.free_list) {
 		__mb_cache_entry_forget(list_entry(l, struct mb_cache_entry,
 						   e_lru_list), GFP_KERNEL);
 	}
@@ -344,14 +387,17 @@ mb_cache_entry_alloc(struct mb_cache *cache, gfp_t gfp_flags)
 	struct mb_cache_entry *ce = NULL;
 
 	if (atomic_read(&cache->c_entry_count) >= cache->c_max_entries) {
+		LIST_HEAD(reuse);
+
 		spin_lock(&mb_cache_spinlock);
-		if (!list_empty(&mb_cache_lru_list)) {
-			ce = list_entry(mb_cache_lru_list.next,
-					struct mb_cache_entry, e_lru_list);
+		list_lru_walk(&mb_cache_lru, mb_cache_lru_isolate_locked,
+			      &reuse, 1);
+		spin_unlock(&mb_cache_spinlock);
+		if (!list_empty(&reuse)) {
+			ce = list_first_entry(&reuse, struct mb_cache_entry,
+					      e_lru_list);
 			list_del_init(&ce->e_lru_list);
-			__mb_cache_entry_unhash(ce);
 		}
-		spin_unlock(&mb_cache_spinlock);
 	}
 	if (!ce) {
 		ce = kmem_cache_alloc(cache->c_entry_cache, gfp_flags);
@@ -469,8 +515,7 @@ mb_cache_entry_get(struct mb_cache *cache, struct block_device *bdev,
 		if (ce->e_bdev == bdev && ce->e_block == block) {
 			DEFINE_WAIT(wait);
 
-			if (!list_empty(&ce->e_lru_list))
-				list_del_init(&ce->e_lru_list);
+			list_lru_del(&mb_cache_lru, &ce->e_lru_list);
 
 			while (ce->e_used > 0) {
 				ce->e_queued++;
@@ -510,8 +555,7 @@ __mb_cache_entry_find(struct list_head *l, struct list_head *head,
 		if (ce->e_bdev == bdev && ce->e_index.o_key == key) {
 			DEFINE_WAIT(wait);
 
-			if (!list_empty(&ce->e_lru_list))
-				list_del_init(&ce->e_lru_list);
+			list_lru_del(&mb_cache_lru, &ce->e_lru_list);
 
 			/* Incrementing before holding the lock gives readers
 			   priority over writers. */
@@ -606,6 +650,11 @@ mb_cache_entry_find_next(struct mb_cache_entry *prev,
 
 static int __init init_mbcache(void)
 {
+	int err;
+
+	err = list_lru_init(&mb_cache_lru);
+	if (err)
+		return err;
 	register_shrinker(&mb_cache_shrinker);
 	return 0;
 }
@@ -613,6 +662,7 @@ static int __init init_mbcache(void)
 static void __exit exit_mbcache(void)
 {
 	unregister_shrinker(&mb_cache_shrinker);
+	list_lru_destroy(&mb_cache_lru);
 }
 
 module_init(init_mbcache)
@@ -283,12 +283,18 @@ struct bio_set {
 	unsigned int front_pad;
 
 	mempool_t *bio_pool;
+	struct mempool_cpu_cache __percpu *bio_cache;
 #if defined(CONFIG_BLK_DEV_INTEGRITY)
 	mempool_t *bio_integrity_pool;
 #endif
 	mempool_t *bvec_pool;
 };
 
+/* Freed bios each cpu keeps for reuse, per bio_set */
+#define BIO_CPU_CACHE		64
+/* Bios allocated from the slab at once when a cpu has none left */
+#define BIO_CPU_BATCH		16
+
 struct biovec_slab {
 	int nr_vecs;
 	char *name;
@@ -18,6 +18,7 @@
 #include <linux/gfp.h>
 #include <linux/bsg.h>
 #include <linux/smp.h>
+#include <linux/rbtree.h>
 
 #include <asm/scatterlist.h>
 
@@ -25,12 +26,16 @@ struct module;
 struct scsi_ioctl_command;
 
 struct request_queue;
+struct rq_wb;
 struct elevator_queue;
 struct request_pm_state;
 struct blk_trace;
 struct request;
 struct sg_io_hdr;
 struct bsg_job;
+struct blk_mq_ops;
+struct blk_mq_hw_ctx;
+struct blk_mq_ctx;
 
 #define BLKDEV_MIN_RQ	4
 #define BLKDEV_MAX_RQ	128	/* Default maximum */
@@ -47,9 +52,15 @@ struct request_list {
 	int starved[2];
 	int elvpriv;
 	mempool_t *rq_pool;
+	struct mempool_cpu_cache __percpu *rq_cache;
 	wait_queue_head_t wait[2];
 };
 
+/* Freed requests each cpu keeps for reuse, per queue */
+#define BLK_RQ_CPU_CACHE	16
+/* Requests allocated from the slab at once when a cpu has none left */
+#define BLK_RQ_CPU_BATCH	4
+
 /*
  * request command types
  */
@@ -82,6 +93,7 @@ struct request {
 	struct call_single_data csd;
 
 	struct request_queue *q;
+	struct blk_mq_ctx *mq_ctx;
 
 	unsigned int cmd_flags;
 	enum rq_cmd_type_bits cmd_type;
@@ -125,10 +137,15 @@ struct request {
 	struct gendisk *rq_disk;
 	struct hd_struct *part;
 	unsigned long start_time;
-#ifdef CONFIG_BLK_CGROUP
+#if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_DEV_IO_HIST)
 	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    /* when passed to hardware */
 #endif
+#ifdef CONFIG_BLK_DEV_IO_HIST
+	unsigned int hist_sectors;	/* size when first started */
+#endif
+	u64 issue_time_ns;		/* when passed to the driver, if polling
+					   or writeback throttling need it */
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
 	 */
@@ -138,6 +155,9 @@ struct request {
 #endif
 
 	unsigned short ioprio;
+#ifdef CONFIG_BLK_WBT
+	unsigned short wbt_flags;	/* blk-wbt accounting state */
+#endif
 
 	int ref_count;
 
@@ -263,6 +283,22 @@ struct queue_limits {
 	unsigned char		discard_zeroes_data;
 };
 
+/*
+ * Discards queued with blkdev_queue_discard() are kept here until the
+ * background worker issues them.  Pending ranges are disjoint, stored
+ * by absolute start sector and merged with their neighbours on insert.
+ */
+struct blk_async_discard {
+	spinlock_t		lock;
+	struct rb_root		pending;
+	struct list_head	inflight;
+	unsigned int		nr_ranges;	/* pending + in flight */
+	unsigned int		rate_kb;	/* KiB/s, 0 means unlimited */
+	struct block_device	*bdev;		/* whole disk, while busy */
+	wait_queue_head_t	wait;
+	struct delayed_work	work;
+};
+
 struct request_queue {
 	/*
 	 * Together with queue_head for cacheline sharing
@@ -286,6 +322,18 @@ struct request_queue {
 	dma_drain_needed_fn	*dma_drain_needed;
 	lld_busy_fn		*lld_busy_fn;
 
+	struct blk_mq_ops	*mq_ops;
+
+	unsigned int		*mq_map;
+
+	/* sw queues */
+	struct blk_mq_ctx __percpu	*queue_ctx;
+	unsigned int		nr_queues;
+
+	/* hw dispatch queues */
+	struct blk_mq_hw_ctx	**queue_hw_ctx;
+	unsigned int		nr_hw_queues;
+
 	/*
 	 * Dispatch queue sorting
 	 */
@@ -351,6 +399,14 @@ struct request_queue {
 	struct timer_list	timeout;
 	struct list_head	timeout_list;
 
+	/*
+	 * Polled completions: poll_nsec is the hybrid sleep before polling,
+	 * -1 for pure busy polling and 0 to derive it from poll_lat_nsec, the
+	 * running mean completion time of polled requests.
+	 */
+	int			poll_nsec;
+	u64			poll_lat_nsec;
+
 	struct queue_limits	limits;
 
 	/*
@@ -374,9 +430,15 @@ struct request_queue {
 	struct list_head	flush_queue[2];
 	struct list_head	flush_data_in_flight;
 	struct request		flush_rq;
+	struct request		*mq_flush_rq;
+	struct work_struct	mq_flush_work;
 
 	struct mutex		sysfs_lock;
 
+	struct list_head	all_q_node;
+
+	struct blk_async_discard async_discard;
+
 #if defined(CONFIG_BLK_DEV_BSG)
 	bsg_job_fn		*bsg_job_fn;
 	int			bsg_job_size;
@@ -387,6 +449,11 @@ struct request_queue {
 	/* Throttle data */
 	struct throtl_data *td;
 #endif
+
+#ifdef CONFIG_BLK_WBT
+	/* Writeback throttling */
+	struct rq_wb *rq_wb;
+#endif
 };
 
 #define QUEUE_FLAG_QUEUED	1	/* uses generic tag queueing */
@@ -408,6 +475,7 @@ struct request_queue {
 #define QUEUE_FLAG_ADD_RANDOM  16	/* Contributes to random pool */
 #define QUEUE_FLAG_SECDISCARD  17	/* supports SECDISCARD */
 #define QUEUE_FLAG_SAME_FORCE  18	/* force complete on same CPU */
+#define QUEUE_FLAG_POLL	       19	/* IO polling enabled if set */
 
 #define QUEUE_FLAG_DEFAULT	((1 << QUEUE_FLAG_IO_STAT) |		\
 				 (1 << QUEUE_FLAG_STACKABLE)	|	\
@@ -490,6 +558,7 @@ static inline void queue_flag_clear(unsigned int flag, struct request_queue *q)
 #define blk_queue_stackable(q)	\
 	test_bit(QUEUE_FLAG_STACKABLE, &(q)->queue_flags)
 #define blk_queue_discard(q)	test_bit(QUEUE_FLAG_DISCARD, &(q)->queue_flags)
+#define blk_queue_poll(q)	test_bit(QUEUE_FLAG_POLL, &(q)->queue_flags)
 #define blk_queue_secdiscard(q)	(blk_queue_discard(q) && \
 	test_bit(QUEUE_FLAG_SECDISCARD, &(q)->queue_flags))
 
@@ -656,6 +725,7 @@ extern void blk_unregister_queue(struct gendisk *disk);
 extern void generic_make_request(struct bio *bio);
 extern void blk_rq_init(struct request_queue *q, struct request *rq);
 extern void blk_put_request(struct request *);
+extern bool blk_poll(struct request_queue *q, bool may_sleep);
 extern void __blk_put_request(struct request_queue *, struct request *);
 extern struct request *blk_get_request(struct request_queue *, int, gfp_t);
 extern struct request *blk_make_request(struct request_queue *, struct bio *,
@@ -876,6 +946,7 @@ extern void blk_put_queue(struct request_queue *);
 struct blk_plug {
 	unsigned long magic; /* detect uninitialized use-cases */
 	struct list_head list; /* requests */
+	struct list_head mq_list; /* blk-mq requests */
 	struct list_head cb_list; /* md requires an unplug callback */
 	unsigned int should_sort; /* list to be sorted before flushing? */
 };
@@ -910,7 +981,9 @@ static inline bool blk_needs_flush_plug(struct task_struct *tsk)
 {
 	struct blk_plug *plug = tsk->plug;
 
-	return plug && (!list_empty(&plug->list) || !list_empty(&plug->cb_list));
+	return plug && (!list_empty(&plug->list) ||
+			!list_empty(&plug->mq_list) ||
+			!list_empty(&plug->cb_list));
 }
 
 /*
@@ -949,6 +1022,25 @@ static inline int sb_issue_discard(struct super_block *sb, sector_t block,
 				    nr_blocks << (sb->s_blocksize_bits - 9),
 				    gfp_mask, flags);
 }
+extern int blkdev_queue_discard(struct block_device *bdev, sector_t sector,
+		sector_t nr_sects, gfp_t gfp_mask);
+extern void blkdev_cancel_discard(struct block_device *bdev, sector_t sector,
+		sector_t nr_sects);
+extern void blkdev_flush_discards(struct block_device *bdev);
+static inline int sb_queue_discard(struct super_block *sb, sector_t block,
+		sector_t nr_blocks, gfp_t gfp_mask)
+{
+	return blkdev_queue_discard(sb->s_bdev,
+				    block << (sb->s_blocksize_bits - 9),
+				    nr_blocks << (sb->s_blocksize_bits - 9),
+				    gfp_mask);
+}
+static inline void sb_cancel_discard(struct super_block *sb, sector_t block,
+		sector_t nr_blocks)
+{
+	blkdev_cancel_discard(sb->s_bdev, block << (sb->s_blocksize_bits - 9),
+			      nr_blocks << (sb->s_blocksize_bits - 9));
+}
 static inline int sb_issue_zeroout(struct super_block *sb, sector_t block,
 		sector_t nr_blocks, gfp_t gfp_mask)
 {
@@ -1151,8 +1243,11 @@ static inline void put_dev_sector(Sector p)
 
 struct work_struct;
 int kblockd_schedule_work(struct request_queue *q, struct work_struct *work);
+int kblockd_schedule_delayed_work(struct request_queue *q,
+				  struct delayed_work *dwork,
+				  unsigned long delay);
 
-#ifdef CONFIG_BLK_CGROUP
+#if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_DEV_IO_HIST)
 /*
  * This should not be using sched_clock(). A real patch is in progress
  * to fix this up, until that is in place we need to disable preemption
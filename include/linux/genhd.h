@@ -96,6 +96,28 @@ struct partition_meta_info {
 	u8 volname[PARTITION_META_INFO_VOLNAMELTH];
 };
 
+#ifdef CONFIG_BLK_DEV_IO_HIST
+/*
+ * Per-cpu log2 histograms of completed requests, see
+ * Documentation/block/io-hist.txt
+ */
+enum {
+	DISK_HIST_READ = 0,
+	DISK_HIST_WRITE,
+	DISK_HIST_FLUSH,
+	DISK_HIST_DISCARD,
+	DISK_HIST_NR_OPS,
+};
+
+#define DISK_HIST_LAT_BUCKETS	32	/* usecs, last one is >= 2^30 */
+#define DISK_HIST_SIZE_BUCKETS	16	/* sectors, last one is >= 2^14 */
+
+struct disk_io_hist {
+	unsigned long lat[DISK_HIST_NR_OPS][DISK_HIST_LAT_BUCKETS];
+	unsigned long size[DISK_HIST_NR_OPS][DISK_HIST_SIZE_BUCKETS];
+};
+#endif
+
 struct hd_struct {
 	sector_t start_sect;
 	sector_t nr_sects;
@@ -189,6 +211,9 @@ struct gendisk {
 	struct disk_events *ev;
 #ifdef  CONFIG_BLK_DEV_INTEGRITY
 	struct blk_integrity *integrity;
+#endif
+#ifdef CONFIG_BLK_DEV_IO_HIST
+	struct disk_io_hist __percpu *io_hist;
 #endif
 	int node_id;
 };
@@ -0,0 +1,207 @@
+/*
+ * Generic LRU infrastructure: lists of reclaimable objects, split by the
+ * node the objects live on and, optionally, the memcg they are charged to.
+ */
+#ifndef _LRU_LIST_H
+#define _LRU_LIST_H
+
+#include <linux/list.h>
+#include <linux/nodemask.h>
+#include <linux/spinlock.h>
+
+struct mem_cgroup;
+struct shrink_control;
+
+/* list_lru_walk_cb has to always return one of those */
+enum lru_status {
+	LRU_REMOVED,		/* item removed from list */
+	LRU_ROTATE,		/* item referenced, give another pass */
+	LRU_SKIP,		/* item cannot be locked, skip */
+	LRU_RETRY,		/* item not freeable. May drop the lock
+				   internally, but has to return locked. */
+};
+
+struct list_lru_one {
+	struct list_head	list;
+	long			nr_items;
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	/* the memcg owning the list, -1 for the node's own list */
+	int			memcg_id;
+#endif
+};
+
+struct list_lru_node {
+	/* protects all lists on the node, including the per-memcg ones */
+	spinlock_t		lock;
+	/* items that are not charged to a memcg */
+	struct list_lru_one	lru;
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	/*
+	 * Per-memcg lists, indexed by kmemcg_id.  A NULL entry means the
+	 * memcg's objects go to @lru; once a memcg is gone its entry points
+	 * to the list of the ancestor that inherited its objects.
+	 */
+	struct list_lru_one	**memcg_lrus;
+	int			nr_memcg_lrus;
+#endif
+	/* all items on the node */
+	long			nr_items;
+} ____cacheline_aligned_in_smp;
+
+struct list_lru {
+	struct list_lru_node	*node;
+	nodemask_t		active_nodes;
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	struct list_head	list;
+	bool			memcg_aware;
+#endif
+};
+
+void list_lru_destroy(struct list_lru *lru);
+int __list_lru_init(struct list_lru *lru, bool memcg_aware);
+
+static inline int list_lru_init(struct list_lru *lru)
+{
+	return __list_lru_init(lru, false);
+}
+
+/*
+ * Objects on a memcg aware list_lru are kept on a separate list for the
+ * memcg they are charged to, so that memcg reclaim can find them.
+ */
+static inline int list_lru_init_memcg(struct list_lru *lru)
+{
+	return __list_lru_init(lru, true);
+}
+
+/**
+ * list_lru_add: add an element to the lru list's tail
+ * @list_lru: the lru pointer
+ * @item: the item to be added.
+ *
+ * If the element is already part of a list, this function returns doing
+ * nothing. Therefore the caller does not need to keep state about whether or
+ * not the element already belongs in the list and is allowed to lazy update
+ * it. Note however that this is valid for *a* list, not *this* list. If
+ * the caller organize itself in a way that elements can be in more than
+ * one type of list, it is up to the caller to fully remove the item from
+ * the previous list (with list_lru_del() for instance) before moving it
+ * to @list_lru
+ *
+ * The item is put on the list of the node its memory lives on and, if
+ * @list_lru is memcg aware, of the memcg it is charged to.
+ *
+ * Return value: true if the list was updated, false otherwise
+ */
+bool list_lru_add(struct list_lru *lru, struct list_head *item);
+
+/**
+ * list_lru_del: delete an element to the lru list
+ * @list_lru: the lru pointer
+ * @item: the item to be deleted.
+ *
+ * This function works analogously as list_lru_add in terms of list
+ * manipulation. The comments about an element already pertaining to
+ * a list are also valid for list_lru_del.
+ *
+ * Return value: true if the list was updated, false otherwise
+ */
+bool list_lru_del(struct list_lru *lru, struct list_head *item);
+
+/**
+ * list_lru_count_one: return the number of objects of a memcg on a node
+ * @lru: the lru pointer.
+ * @nid: the node id to count from.
+ * @memcg: the memcg to count from, or NULL for all objects on the node.
+ *
+ * Always return a non-negative number, 0 for empty lists. There is no
+ * guarantee that the list is not updated while the count is being computed.
+ * Callers that want such a guarantee need to provide an outer lock.
+ */
+unsigned long list_lru_count_one(struct list_lru *lru, int nid,
+				 struct mem_cgroup *memcg);
+
+static inline unsigned long list_lru_count_node(struct list_lru *lru, int nid)
+{
+	return list_lru_count_one(lru, nid, NULL);
+}
+
+static inline unsigned long list_lru_count(struct list_lru *lru)
+{
+	long count = 0;
+	int nid;
+
+	for_each_node_mask(nid, lru->active_nodes)
+		count += list_lru_count_node(lru, nid);
+
+	return count;
+}
+
+/* the objects a shrinker is asked to look at: the node and memcg in @sc */
+unsigned long list_lru_shrink_count(struct list_lru *lru,
+				    struct shrink_control *sc);
+
+typedef enum lru_status
+(*list_lru_walk_cb)(struct list_head *item, spinlock_t *lock, void *cb_arg);
+
+/**
+ * list_lru_walk_one: walk a list_lru, isolating and disposing freeable items.
+ * @lru: the lru pointer.
+ * @nid: the node id to scan from.
+ * @memcg: the memcg to scan from, or NULL for all objects on the node.
+ * @isolate: callback function that is resposible for deciding what to do with
+ *  the item currently being scanned
+ * @cb_arg: opaque type that will be passed to @isolate
+ * @nr_to_walk: how many items to scan.
+ *
+ * This function will scan all elements in a particular list_lru, calling the
+ * @isolate callback for each of those items, along with the current list
+ * spinlock and a caller-provided opaque. The @isolate callback can choose to
+ * drop the lock internally, but *must* return with the lock held. The callback
+ * will return an enum lru_status telling the list_lru infrastructure what to
+ * do with the object being scanned.
+ *
+ * Please note that nr_to_walk does not mean how many objects will be freed,
+ * just how many objects will be scanned.
+ *
+ * Return value: the number of objects effectively removed from the LRU.
+ */
+unsigned long list_lru_walk_one(struct list_lru *lru, int nid,
+				struct mem_cgroup *memcg,
+				list_lru_walk_cb isolate, void *cb_arg,
+				unsigned long *nr_to_walk);
+
+static inline unsigned long
+list_lru_walk_node(struct list_lru *lru, int nid, list_lru_walk_cb isolate,
+		   void *cb_arg, unsigned long *nr_to_walk)
+{
+	return list_lru_walk_one(lru, nid, NULL, isolate, cb_arg, nr_to_walk);
+}
+
+static inline unsigned long
+list_lru_walk(struct list_lru *lru, list_lru_walk_cb isolate,
+	      void *cb_arg, unsigned long nr_to_walk)
+{
+	long isolated = 0;
+	int nid;
+
+	for_each_node_mask(nid, lru->active_nodes) {
+		isolated += list_lru_walk_node(lru, nid, isolate,
+					       cb_arg, &nr_to_walk);
+		if (!nr_to_walk)
+			break;
+	}
+	return isolated;
+}
+
+/* walk the objects a shrinker is asked to look at, see list_lru_shrink_count */
+unsigned long list_lru_shrink_walk(struct list_lru *lru,
+				   struct shrink_control *sc,
+				   list_lru_walk_cb isolate, void *cb_arg);
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+int memcg_list_lrus_online(int memcg_id);
+void memcg_list_lrus_offline(int memcg_id, int parent_id);
+#endif
+
+#endif /* _LRU_LIST_H */
@@ -0,0 +1,48 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ *  LZ4 Public Kernel Interface
+ *
+ *  LZ4 is a byte-oriented LZ77 compressor tuned for decompression
+ *  speed.  Only the raw block format is supported here; framing is up
+ *  to the user.
+ */
+
+#define LZ4_MEM_COMPRESS	(4096 * sizeof(unsigned char *))
+#define LZ4HC_MEM_COMPRESS	(65538 * sizeof(unsigned char *))
+
+/*
+ * Worst case output size for @isize bytes of input: incompressible data
+ * is stored as literals plus one length byte per 255 of them.
+ */
+#define lz4_compressbound(isize)	((isize) + ((isize) / 255) + 16)
+
+/*
+ * These require 'wrkmem' of size LZ4_MEM_COMPRESS or LZ4HC_MEM_COMPRESS
+ * and an output buffer of at least lz4_compressbound(src_len) bytes.
+ * LZ4HC searches harder for matches: it compresses better and much more
+ * slowly, while decompression is as fast as for LZ4.
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * Safe decompression: *dst_len is the size of @dst on entry and the
+ * size of the output on return.  Malformed input is never read or
+ * written past the buffer ends.
+ */
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len);
+
+/*
+ * Return values (< 0 = Error)
+ */
+#define LZ4_E_OK			0
+#define LZ4_E_ERROR			(-1)
+#define LZ4_E_INPUT_OVERRUN		(-4)
+#define LZ4_E_OUTPUT_OVERRUN		(-5)
+#define LZ4_E_LOOKBEHIND_OVERRUN	(-6)
+
+#endif
@@ -21,11 +21,13 @@
 #define _LINUX_MEMCONTROL_H
 #include <linux/cgroup.h>
 #include <linux/vm_event_item.h>
+#include <linux/jump_label.h>
 
 struct mem_cgroup;
 struct page_cgroup;
 struct page;
 struct mm_struct;
+struct kmem_cache;
 
 /* Stats that can be updated by kernel. */
 enum mem_cgroup_page_stat_item {
@@ -381,5 +383,77 @@ mem_cgroup_print_bad_page(struct page *page)
 }
 #endif
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+extern struct jump_label_key memcg_kmem_enabled_key;
+
+/*
+ * Kernel memory accounting is switched on with the first memory cgroup
+ * other than the root one and stays on from then on.
+ */
+static inline bool memcg_kmem_enabled(void)
+{
+	return static_branch(&memcg_kmem_enabled_key);
+}
+
+extern struct kmem_cache *__memcg_kmem_get_cache(struct kmem_cache *cachep,
+						 gfp_t gfp);
+extern void __memcg_kmem_put_cache(struct kmem_cache *cachep);
+extern int __memcg_kmem_charge_pages(struct page *page, gfp_t gfp, int order);
+extern void __memcg_kmem_uncharge_pages(struct page *page, int order);
+
+extern int memcg_charge_slab(struct kmem_cache *s, gfp_t gfp, int order);
+extern void memcg_uncharge_slab(struct kmem_cache *s, int order);
+extern void memcg_destroy_child_caches(struct kmem_cache *root);
+extern int memcg_cache_id(struct mem_cgroup *memcg);
+
+/**
+ * memcg_kmem_charge_pages - charge a page allocation to the current memcg
+ * @page: the freshly allocated page
+ * @gfp: the allocation mask
+ * @order: the allocation order
+ *
+ * Only allocations passing __GFP_ACCOUNT are charged.  Returns -ENOMEM if
+ * the memcg is over its limit, in which case the page has to be freed.
+ */
+static inline int
+memcg_kmem_charge_pages(struct page *page, gfp_t gfp, int order)
+{
+	if (memcg_kmem_enabled() && (gfp & __GFP_ACCOUNT))
+		return __memcg_kmem_charge_pages(page, gfp, order);
+	return 0;
+}
+
+/**
+ * memcg_kmem_uncharge_pages - uncharge a page on its way back to the allocator
+ * @page: the page being freed
+ * @order: the allocation order
+ */
+static inline void memcg_kmem_uncharge_pages(struct page *page, int order)
+{
+	if (memcg_kmem_enabled())
+		__memcg_kmem_uncharge_pages(page, order);
+}
+#else
+static inline bool memcg_kmem_enabled(void)
+{
+	return false;
+}
+
+static inline int
+memcg_kmem_charge_pages(struct page *page, gfp_t gfp, int order)
+{
+	return 0;
+}
+
+static inline void memcg_kmem_uncharge_pages(struct page *page, int order)
+{
+}
+
+static inline int memcg_cache_id(struct mem_cgroup *memcg)
+{
+	return -1;
+}
+#endif /* CONFIG_CGROUP_MEM_RES_CTLR_KMEM */
+
 #endif /* _LINUX_MEMCONTROL_H */
 
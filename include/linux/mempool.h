@@ -33,6 +33,20 @@ extern void mempool_destroy(mempool_t *pool);
 extern void * mempool_alloc(mempool_t *pool, gfp_t gfp_mask);
 extern void mempool_free(void *element, mempool_t *pool);
 
+struct mempool_cpu_cache {
+	void *head;		/* freed elements, chained through word 0 */
+	unsigned int nr;
+};
+
+extern struct mempool_cpu_cache __percpu *mempool_cpu_cache_create(void);
+extern void mempool_cpu_cache_destroy(mempool_t *pool,
+			struct mempool_cpu_cache __percpu *cache);
+extern void *mempool_cache_alloc(mempool_t *pool,
+			struct mempool_cpu_cache __percpu *cache, gfp_t gfp_mask,
+			unsigned int batch);
+extern void mempool_cache_free(void *element, mempool_t *pool,
+			struct mempool_cpu_cache __percpu *cache, unsigned int max);
+
 /*
  * A mempool_alloc_t and mempool_free_t that get the memory from
  * a slab that is passed in through pool_data.
@@ -12,6 +12,7 @@ enum {
 	PCG_FILE_MAPPED, /* page is accounted as "mapped" */
 	/* No lock in page_cgroup */
 	PCG_ACCT_LRU, /* page has been accounted for (under lru_lock) */
+	PCG_KMEM, /* __GFP_ACCOUNT page charged to pc->mem_cgroup */
 	__NR_PCG_FLAGS,
 };
 
@@ -90,6 +91,10 @@ SETPCGFLAG(Migration, MIGRATION)
 CLEARPCGFLAG(Migration, MIGRATION)
 TESTPCGFLAG(Migration, MIGRATION)
 
+SETPCGFLAG(Kmem, KMEM)
+CLEARPCGFLAG(Kmem, KMEM)
+TESTPCGFLAG(Kmem, KMEM)
+
 static inline void lock_page_cgroup(struct page_cgroup *pc)
 {
 	/*
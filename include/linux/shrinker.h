@@ -1,6 +1,8 @@
 #ifndef _LINUX_SHRINKER_H
 #define _LINUX_SHRINKER_H
 
+#include <linux/nodemask.h>
+
 /*
  * This struct is used to pass information from page reclaim to the shrinkers.
  * We consolidate the values for easier extention later.
@@ -10,6 +12,20 @@ struct shrink_control {
 
 	/* How many slab objects shrinker() should scan and try to reclaim */
 	unsigned long nr_to_scan;
+
+	/* The nodes being reclaimed, all nodes if left empty */
+	nodemask_t nodes_to_scan;
+	/*
+	 * The node whose objects a SHRINKER_NUMA_AWARE shrinker should
+	 * count and scan, set by shrink_slab for each of nodes_to_scan.
+	 */
+	int nid;
+
+	/*
+	 * The memcg being reclaimed, or NULL for global reclaim.  Only
+	 * shrinkers with SHRINKER_MEMCG_AWARE are called for a memcg.
+	 */
+	struct mem_cgroup *memcg;
 };
 
 /*
@@ -27,17 +43,29 @@ struct shrink_control {
  *
  * Note that 'shrink' will be passed nr_to_scan == 0 when the VM is
  * querying the cache size, so a fastpath for that case is appropriate.
+ *
+ * A shrinker with SHRINKER_NUMA_AWARE set is called for each node under
+ * reclaim, and should only count and scan the objects on node 'sc->nid'.
  */
 struct shrinker {
 	int (*shrink)(struct shrinker *, struct shrink_control *sc);
 	int seeks;	/* seeks to recreate an obj */
 	long batch;	/* reclaim batch size, 0 = default */
+	unsigned long flags;
 
 	/* These are for internal use */
 	struct list_head list;
 	atomic_long_t nr_in_batch; /* objs pending delete */
+	/* objs pending delete, per node, for SHRINKER_NUMA_AWARE */
+	atomic_long_t *nr_deferred;
 };
 #define DEFAULT_SEEKS 2 /* A good number if you don't know better. */
+
+/* Flags */
+#define SHRINKER_MEMCG_AWARE	(1 << 0)
+/* called once per node being reclaimed, with sc->nid set */
+#define SHRINKER_NUMA_AWARE	(1 << 1)
+
 extern void register_shrinker(struct shrinker *);
 extern void unregister_shrinker(struct shrinker *);
 #endif
@@ -71,6 +71,28 @@ struct kmem_cache_order_objects {
 	unsigned long x;
 };
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+/*
+ * The per-memcg copies of a root cache (one created by kmem_cache_create),
+ * indexed by kmemcg_id.  The array is replaced under RCU as it grows.
+ */
+struct memcg_cache_array {
+	struct rcu_head rcu_head;
+	int nr_caches;
+	struct kmem_cache *caches[0];
+};
+
+/* Bookkeeping of a per-memcg copy of a root cache */
+struct memcg_cache_params {
+	struct mem_cgroup *memcg;	/* charged for the slab pages */
+	struct list_head list;		/* in memcg->memcg_slab_caches */
+	struct kmem_cache *cachep;
+	struct kmem_cache *root_cache;
+	atomic_t nr_pages;		/* slab pages, +1 while memcg is alive */
+	struct work_struct destroy;
+};
+#endif
+
 /*
  * Slab cache management.
  */
@@ -99,6 +121,10 @@ struct kmem_cache {
 #ifdef CONFIG_SYSFS
 	struct kobject kobj;	/* For sysfs */
 #endif
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	struct memcg_cache_array *memcg_caches;	/* root caches */
+	struct memcg_cache_params *memcg_params; /* per-memcg copies */
+#endif
 
 #ifdef CONFIG_NUMA
 	/*
@@ -109,6 +135,12 @@ struct kmem_cache {
 	struct kmem_cache_node *node[MAX_NUMNODES];
 };
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+struct kmem_cache *kmem_cache_create_memcg(struct kmem_cache *root,
+		const char *name, struct memcg_cache_params *params);
+void kmem_cache_deactivate_memcg(struct kmem_cache *s);
+#endif
+
 /*
  * Kmalloc subsystem.
  */
@@ -81,6 +81,21 @@ struct writeback_control {
 	unsigned range_cyclic:1;	/* range_start is cyclic */
 };
 
+/*
+ * Write flags for bios submitted on behalf of @wbc.  Periodic and
+ * background writeback done by the flusher threads is tagged
+ * REQ_BACKGROUND so that the block layer can throttle it in favour of
+ * other I/O.
+ */
+static inline int wbc_to_write_flags(struct writeback_control *wbc)
+{
+	if (wbc->sync_mode == WB_SYNC_ALL)
+		return WRITE_SYNC;
+	if (wbc->for_kupdate || wbc->for_background)
+		return WRITE | REQ_BACKGROUND;
+	return WRITE;
+}
+
 /*
  * fs/fs-writeback.c
  */	
@@ -0,0 +1,43 @@
+#ifndef _LINUX_ZSWAP_H
+#define _LINUX_ZSWAP_H
+
+#include <linux/types.h>
+#include <linux/mm_types.h>
+#include <linux/errno.h>
+
+#ifdef CONFIG_ZSWAP
+
+extern int zswap_store(struct page *page);
+extern int zswap_load(struct page *page);
+extern void zswap_invalidate(int type, pgoff_t offset);
+extern int zswap_swapon(int type);
+extern void zswap_swapoff(int type);
+
+#else
+
+static inline int zswap_store(struct page *page)
+{
+	return -ENODEV;
+}
+
+static inline int zswap_load(struct page *page)
+{
+	return -ENOENT;
+}
+
+static inline void zswap_invalidate(int type, pgoff_t offset)
+{
+}
+
+static inline int zswap_swapon(int type)
+{
+	return 0;
+}
+
+static inline void zswap_swapoff(int type)
+{
+}
+
+#endif
+
+#endif /* _LINUX_ZSWAP_H */
@@ -66,6 +66,37 @@ done:
 	return ret;
 }
 
+/*
+ * Charge the whole hierarchy even if that takes it over the limit, for
+ * callers that cannot fail or back out.  Returns -ENOMEM if any of the
+ * counters went over its limit, so that the caller can try to bring the
+ * usage down again.
+ */
+int res_counter_charge_nofail(struct res_counter *counter, unsigned long val,
+			      struct res_counter **limit_fail_at)
+{
+	int ret = 0;
+	unsigned long flags;
+	struct res_counter *c;
+
+	*limit_fail_at = NULL;
+	local_irq_save(flags);
+	for (c = counter; c != NULL; c = c->parent) {
+		spin_lock(&c->lock);
+		if (res_counter_charge_locked(c, val) < 0) {
+			c->usage += val;
+			if (c->usage > c->max_usage)
+				c->max_usage = c->usage;
+			if (!*limit_fail_at)
+				*limit_fail_at = c;
+			ret = -ENOMEM;
+		}
+		spin_unlock(&c->lock);
+	}
+	local_irq_restore(flags);
+	return ret;
+}
+
 void res_counter_uncharge_locked(struct res_counter *counter, unsigned long val)
 {
 	if (WARN_ON(counter->usage < val))
@@ -2193,6 +2193,10 @@ static int irqtime_account_si_update(void)
 
 #endif
 
+#ifdef CONFIG_NUMA_BALANCING
+static void migrate_task_to(struct task_struct *p, int target_cpu);
+#endif
+
 #include "sched_idletask.c"
 #include "sched_fair.c"
 #include "sched_rt.c"
@@ -2964,6 +2968,16 @@ static void __sched_fork(struct task_struct *p)
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	INIT_HLIST_HEAD(&p->preempt_notifiers);
 #endif
+
+#ifdef CONFIG_NUMA_BALANCING
+	p->node_stamp = 0ULL;
+	p->numa_scan_period = sysctl_numa_balancing_scan_period_min;
+	p->numa_work_pending = 0;
+	p->numa_preferred_nid = -1;
+	p->numa_pages_faulted = 0;
+	p->numa_pages_migrated = 0;
+	p->numa_faults = NULL;
+#endif
 }
 
 /*
@@ -3801,6 +3815,19 @@ unlock:
 	raw_spin_unlock_irqrestore(&p->pi_lock, flags);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Move the current task p to target_cpu, the way sched_exec() does, to
+ * bring it closer to its memory.
+ */
+static void migrate_task_to(struct task_struct *p, int target_cpu)
+{
+	struct migration_arg arg = { p, target_cpu };
+
+	stop_one_cpu(task_cpu(p), migration_cpu_stop, &arg);
+}
+#endif
+
 #endif
 
 DEFINE_PER_CPU(struct kernel_stat, kstat);
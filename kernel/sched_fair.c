@@ -23,6 +23,7 @@
 #include <linux/latencytop.h>
 #include <linux/sched.h>
 #include <linux/cpumask.h>
+#include <linux/mempolicy.h>
 
 /*
  * Targeted preemption latency for CPU-bound tasks:
@@ -103,6 +104,24 @@ unsigned int __read_mostly sysctl_sched_shares_window = 10000000UL;
 unsigned int sysctl_sched_cfs_bandwidth_slice = 5000UL;
 #endif
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Automatic NUMA balancing, see task_numa_work().  It is on by default and
+ * does nothing on machines with a single node.
+ */
+unsigned int sysctl_numa_balancing __read_mostly = 1;
+
+/* Runtime of a new process before its memory is first scanned, in ms */
+unsigned int sysctl_numa_balancing_scan_delay = 1000;
+
+/* Bounds of the runtime between two scans, adapted per task, in ms */
+unsigned int sysctl_numa_balancing_scan_period_min = 1000;
+unsigned int sysctl_numa_balancing_scan_period_max = 60000;
+
+/* Memory made inaccessible by each scan, in MB */
+unsigned int sysctl_numa_balancing_scan_size = 256;
+#endif
+
 static const struct sched_class fair_sched_class;
 
 /**************************************************************
@@ -2775,6 +2794,42 @@ static void pull_task(struct rq *src_rq, struct task_struct *p,
 	check_preempt_curr(this_rq, p, 0);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/* Whether moving @p from @src_cpu to @dst_cpu takes it to its preferred node */
+static bool migrate_improves_locality(struct task_struct *p, int src_cpu,
+				      int dst_cpu)
+{
+	int nid = p->numa_preferred_nid;
+
+	if (!sysctl_numa_balancing || nid == -1)
+		return false;
+	return cpu_to_node(src_cpu) != nid && cpu_to_node(dst_cpu) == nid;
+}
+
+/* Whether moving @p from @src_cpu to @dst_cpu takes it off its preferred node */
+static bool migrate_degrades_locality(struct task_struct *p, int src_cpu,
+				      int dst_cpu)
+{
+	int nid = p->numa_preferred_nid;
+
+	if (!sysctl_numa_balancing || nid == -1)
+		return false;
+	return cpu_to_node(src_cpu) == nid && cpu_to_node(dst_cpu) != nid;
+}
+#else
+static inline bool migrate_improves_locality(struct task_struct *p,
+					     int src_cpu, int dst_cpu)
+{
+	return false;
+}
+
+static inline bool migrate_degrades_locality(struct task_struct *p,
+					     int src_cpu, int dst_cpu)
+{
+	return false;
+}
+#endif
+
 /*
  * can_migrate_task - may task p from runqueue rq be migrated to this_cpu?
  */
@@ -2805,9 +2860,16 @@ int can_migrate_task(struct task_struct *p, struct rq *rq, int this_cpu,
 	 * Aggressive migration if:
 	 * 1) task is cache cold, or
 	 * 2) too many balance attempts have failed.
+	 *
+	 * A task whose memory is on another node is treated as cache hot
+	 * when it would leave that node, and as cold when it would return.
 	 */
 
 	tsk_cache_hot = task_hot(p, rq->clock_task, sd);
+	if (migrate_improves_locality(p, cpu_of(rq), this_cpu))
+		tsk_cache_hot = 0;
+	else if (migrate_degrades_locality(p, cpu_of(rq), this_cpu))
+		tsk_cache_hot = 1;
 	if (!tsk_cache_hot ||
 		sd->nr_balance_failed > sd->cache_nice_tries) {
 #ifdef CONFIG_SCHEDSTATS
@@ -4859,6 +4921,214 @@ static inline void idle_balance(int cpu, struct rq *rq)
 
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Automatic NUMA balancing.
+ *
+ * After every numa_scan_period of runtime a task makes the next part of
+ * its address space inaccessible with change_prot_numa().  The hinting
+ * faults that follow migrate misplaced pages toward the faulting CPU (see
+ * do_numa_page()) and are counted per node in numa_faults.  The node that
+ * collects most of them becomes the task's preferred node: the task is
+ * moved there if that leaves the load balanced, and the load balancer is
+ * reluctant to take it away again.
+ */
+
+static inline bool numa_balancing_enabled(void)
+{
+	return sysctl_numa_balancing && nr_online_nodes > 1;
+}
+
+/* Move @p to the least loaded CPU of @nid, unless that unbalances the load */
+static void task_numa_migrate(struct task_struct *p, int nid)
+{
+	unsigned long load, min_load = ULONG_MAX;
+	int cpu, dst_cpu = -1;
+
+	for_each_cpu_and(cpu, cpumask_of_node(nid), tsk_cpus_allowed(p)) {
+		if (!cpu_active(cpu))
+			continue;
+		load = weighted_cpuload(cpu);
+		if (load < min_load) {
+			min_load = load;
+			dst_cpu = cpu;
+		}
+	}
+
+	if (dst_cpu == -1 ||
+	    min_load + p->se.load.weight > weighted_cpuload(task_cpu(p)))
+		return;
+
+	migrate_task_to(p, dst_cpu);
+}
+
+static void task_numa_placement(struct task_struct *p)
+{
+	unsigned long faults, max_faults = 0;
+	int nid, max_nid = -1;
+
+	if (!p->numa_faults)
+		return;
+
+	for_each_online_node(nid) {
+		faults = p->numa_faults[nid];
+		if (faults > max_faults) {
+			max_faults = faults;
+			max_nid = nid;
+		}
+		/* halve the history, so that recent faults weigh the most */
+		p->numa_faults[nid] = faults / 2;
+	}
+
+	/*
+	 * Scan faster while pages are still being migrated, and slower once
+	 * the task's memory stays on the node it runs on.
+	 */
+	if (p->numa_pages_migrated * 8 > p->numa_pages_faulted)
+		p->numa_scan_period = max(p->numa_scan_period / 2,
+					  sysctl_numa_balancing_scan_period_min);
+	else
+		p->numa_scan_period = min(p->numa_scan_period * 2,
+					  sysctl_numa_balancing_scan_period_max);
+	p->numa_pages_faulted = 0;
+	p->numa_pages_migrated = 0;
+
+	if (max_nid == -1)
+		return;
+
+	p->numa_preferred_nid = max_nid;
+	if (cpu_to_node(task_cpu(p)) != max_nid)
+		task_numa_migrate(p, max_nid);
+}
+
+/*
+ * Called by the current task for NUMA hinting faults on @pages pages that
+ * are, after migration if @migrated, on @node.
+ */
+void task_numa_fault(int node, int pages, bool migrated)
+{
+	struct task_struct *p = current;
+
+	if (!sysctl_numa_balancing)
+		return;
+
+	if (unlikely(!p->numa_faults)) {
+		p->numa_faults = kzalloc(sizeof(*p->numa_faults) * nr_node_ids,
+					 GFP_KERNEL | __GFP_NOWARN);
+		if (!p->numa_faults)
+			return;
+	}
+
+	p->numa_faults[node] += pages;
+	p->numa_pages_faulted += pages;
+	if (migrated)
+		p->numa_pages_migrated += pages;
+}
+
+void task_numa_free(struct task_struct *p)
+{
+	kfree(p->numa_faults);
+}
+
+/*
+ * Scan the next part of the current task's address space, on the way back
+ * to user mode after task_tick_numa() asked for it.
+ */
+void task_numa_work(void)
+{
+	unsigned long migrate, next_scan, now = jiffies;
+	struct task_struct *p = current;
+	struct mm_struct *mm = p->mm;
+	struct vm_area_struct *vma;
+	unsigned long start, end;
+	long pages, virtpages;
+
+	p->numa_work_pending = 0;
+	if (!mm || (p->flags & PF_EXITING))
+		return;
+
+	task_numa_placement(p);
+
+	/*
+	 * Only one thread of a process scans in each period: the one that
+	 * moves numa_next_scan on.
+	 */
+	migrate = mm->numa_next_scan;
+	if (time_before(now, migrate))
+		return;
+	next_scan = now + msecs_to_jiffies(p->numa_scan_period);
+	if (cmpxchg(&mm->numa_next_scan, migrate, next_scan) != migrate)
+		return;
+
+	pages = sysctl_numa_balancing_scan_size;
+	pages <<= 20 - PAGE_SHIFT;	/* MB in pages */
+	if (!pages)
+		return;
+	/* sparsely populated ranges must not make the walk unbounded */
+	virtpages = pages * 8;
+
+	down_read(&mm->mmap_sem);
+	start = mm->numa_scan_offset;
+	vma = find_vma(mm, start);
+	if (!vma) {
+		start = 0;
+		vma = mm->mmap;
+	}
+	for (; vma; vma = vma->vm_next) {
+		if (!vma_migratable(vma) ||
+		    !(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+			continue;
+
+		do {
+			start = max(start, vma->vm_start);
+			end = ALIGN(start + (pages << PAGE_SHIFT), PMD_SIZE);
+			end = min(end, vma->vm_end);
+			pages -= change_prot_numa(vma, start, end);
+			virtpages -= (end - start) >> PAGE_SHIFT;
+
+			start = end;
+			if (pages <= 0 || virtpages <= 0)
+				goto out;
+		} while (end != vma->vm_end);
+	}
+out:
+	/* resume after this range next time, or start over */
+	mm->numa_scan_offset = vma ? start : 0;
+	up_read(&mm->mmap_sem);
+}
+
+static void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+	u64 period, now;
+
+	if (!numa_balancing_enabled())
+		return;
+	if (!curr->mm || (curr->flags & (PF_EXITING | PF_KTHREAD)) ||
+	    curr->numa_work_pending)
+		return;
+
+	/*
+	 * Runtime rather than wall time drives the scans, so that tasks
+	 * are placed by the busy threads, and only once they have done
+	 * some actual work.
+	 */
+	now = curr->se.sum_exec_runtime;
+	period = (u64)curr->numa_scan_period * NSEC_PER_MSEC;
+
+	if (now - curr->node_stamp > period) {
+		curr->node_stamp = now;
+		if (!time_before(jiffies, curr->mm->numa_next_scan)) {
+			curr->numa_work_pending = 1;
+			set_tsk_thread_flag(curr, TIF_NOTIFY_RESUME);
+		}
+	}
+}
+#else
+static inline void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * scheduler tick hitting a task of our scheduling class:
  */
@@ -4871,6 +5141,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	task_tick_numa(rq, curr);
 }
 
 /*
@@ -0,0 +1,162 @@
+/*
+ * LZ4 decompressor for the Linux kernel.
+ *
+ * Reads the legacy lz4 stream format written by "lz4c -l": a 32-bit
+ * little-endian magic number, followed by blocks that each decompress to
+ * at most 8MB and are preceded by their compressed size, also as a 32-bit
+ * little-endian value.  The stream ends with the input; several streams
+ * may be concatenated.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifdef STATIC
+#include "lz4/lz4_decompress.c"
+#else
+#include <linux/decompress/unlz4.h>
+#endif
+
+#include <linux/types.h>
+#include <linux/lz4.h>
+#include <linux/decompress/mm.h>
+
+#include <linux/compiler.h>
+#include <asm/unaligned.h>
+
+#define LZ4_LEGACY_MAGIC	0x184C2102
+#define LZ4_LEGACY_BLOCK_SIZE	(8 << 20)
+
+STATIC inline int INIT unlz4(u8 *input, int in_len,
+				int (*fill) (void *, unsigned int),
+				int (*flush) (void *, unsigned int),
+				u8 *output, int *posp,
+				void (*error) (char *x))
+{
+	u32 src_len;
+	size_t dst_len;
+	int size, blocks = 0;
+	u8 *in_buf, *out_buf;
+	int ret = -1;
+
+	if (output) {
+		out_buf = output;
+	} else if (!flush) {
+		error("NULL output pointer and no flush function provided");
+		goto exit;
+	} else {
+		out_buf = large_malloc(LZ4_LEGACY_BLOCK_SIZE);
+		if (!out_buf) {
+			error("Could not allocate output buffer");
+			goto exit;
+		}
+	}
+
+	if (input && fill) {
+		error("Both input pointer and fill function provided, don't know what to do");
+		goto exit_1;
+	} else if (input) {
+		in_buf = input;
+	} else if (!fill) {
+		error("NULL input pointer and missing fill function");
+		goto exit_1;
+	} else {
+		in_buf = large_malloc(lz4_compressbound(LZ4_LEGACY_BLOCK_SIZE));
+		if (!in_buf) {
+			error("Could not allocate input buffer");
+			goto exit_1;
+		}
+	}
+
+	if (posp)
+		*posp = 0;
+
+	if (fill)
+		in_len = fill(in_buf, 4);
+	if (in_len < 4 || get_unaligned_le32(in_buf) != LZ4_LEGACY_MAGIC) {
+		error("invalid header");
+		goto exit_2;
+	}
+	size = in_len - 4;
+	if (!fill)
+		in_buf += 4;
+	if (posp)
+		*posp += 4;
+
+	for (;;) {
+		/* read compressed block size */
+		if (fill)
+			size = fill(in_buf, 4);
+		if (size == 0)
+			break;
+		/*
+		 * Images built by the kernel carry their uncompressed size
+		 * in the last four bytes, too short to be another block.
+		 */
+		if (!fill && blocks && size <= 4) {
+			if (posp)
+				*posp += size;
+			break;
+		}
+		if (size < 4) {
+			error("file corrupted");
+			goto exit_2;
+		}
+		src_len = get_unaligned_le32(in_buf);
+		if (!fill) {
+			in_buf += 4;
+			size -= 4;
+		}
+		if (posp)
+			*posp += 4;
+
+		/* another stream concatenated to this one */
+		if (src_len == LZ4_LEGACY_MAGIC)
+			continue;
+
+		if (src_len > lz4_compressbound(LZ4_LEGACY_BLOCK_SIZE)) {
+			error("file corrupted");
+			goto exit_2;
+		}
+
+		if (fill)
+			size = fill(in_buf, src_len);
+		if (size < 0 || (u32)size < src_len) {
+			error("file corrupted");
+			goto exit_2;
+		}
+
+		dst_len = LZ4_LEGACY_BLOCK_SIZE;
+		if (lz4_decompress_safe(in_buf, src_len, out_buf,
+					&dst_len) != LZ4_E_OK) {
+			error("Compressed data violation");
+			goto exit_2;
+		}
+		blocks++;
+
+		if (flush && flush(out_buf, dst_len) != dst_len)
+			goto exit_2;
+		if (output)
+			out_buf += dst_len;
+		if (posp)
+			*posp += src_len;
+
+		if (!fill) {
+			in_buf += src_len;
+			size -= src_len;
+		}
+	}
+
+	ret = 0;
+exit_2:
+	if (!input)
+		large_free(in_buf);
+exit_1:
+	if (!output)
+		large_free(out_buf);
+exit:
+	return ret;
+}
+
+#define decompress unlz4
@@ -0,0 +1,94 @@
+/*
+ *  LZ4 fast compressor
+ *
+ *  Looks for matches through a single hash table of the last position
+ *  each 4-byte sequence was seen at, and takes the first one found.  The
+ *  longer a search goes without a match, the more positions it skips,
+ *  so incompressible input passes through quickly.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+#define LZ4_HASHLOG	12
+#define LZ4_HASHSIZE	(1 << LZ4_HASHLOG)
+
+/* After 2^SKIPSTRENGTH failed attempts, the search step grows by one */
+#define SKIPSTRENGTH	6
+
+static inline u32 lz4_hash(const u8 *p)
+{
+	return (LZ4_READ32(p) * 2654435761U) >> (32 - LZ4_HASHLOG);
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	const u8 **hash_table = wrkmem;
+	const u8 *ip = src, *anchor = src;
+	const u8 *const iend = src + src_len;
+	const u8 *mflimit, *matchlimit;
+	u8 *op = dst;
+
+	BUILD_BUG_ON(LZ4_HASHSIZE * sizeof(*hash_table) > LZ4_MEM_COMPRESS);
+
+	if (src_len < MINLENGTH)
+		goto last_literals;
+
+	mflimit = iend - MFLIMIT;
+	matchlimit = iend - LASTLITERALS;
+	memset(hash_table, 0, LZ4_HASHSIZE * sizeof(*hash_table));
+
+	for (;;) {
+		unsigned int attempts = 1 << SKIPSTRENGTH;
+		const u8 *ref;
+		size_t len;
+
+		/* find a match */
+		for (;;) {
+			u32 h;
+
+			if (ip > mflimit)
+				goto last_literals;
+
+			h = lz4_hash(ip);
+			ref = hash_table[h];
+			hash_table[h] = ip;
+			if (ref && ip - ref <= MAX_DISTANCE &&
+			    LZ4_READ32(ref) == LZ4_READ32(ip))
+				break;
+
+			ip += attempts++ >> SKIPSTRENGTH;
+		}
+
+		/* extend it backwards over the pending literals */
+		while (ip > anchor && ref > (const u8 *)src &&
+		       ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		len = MINMATCH + lz4_count(ip + MINMATCH, ref + MINMATCH,
+					   matchlimit);
+		op = lz4_write_sequence(op, anchor, ip, ip - ref, len);
+		ip += len;
+		anchor = ip;
+
+		if (ip > mflimit)
+			break;
+
+		/* remember a position inside the match */
+		hash_table[lz4_hash(ip - 2)] = ip - 2;
+	}
+
+last_literals:
+	op = lz4_write_sequence(op, anchor, iend, 0, 0);
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
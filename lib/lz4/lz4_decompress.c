@@ -0,0 +1,127 @@
+/*
+ *  LZ4 decompressor
+ *
+ *  Every length, offset and copy is checked against the ends of the
+ *  input and output buffers, so corrupted or hostile input can only make
+ *  decompression fail.  Matches that do not overlap their own output by
+ *  less than a word, and have some room left after them in the output,
+ *  are copied a word at a time.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#endif
+
+#include <asm/unaligned.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+#define COPY8(dst, src)	\
+		put_unaligned(get_unaligned((const u64 *)(src)), (u64 *)(dst))
+
+/* Read a length continued by 255 bytes; false if input runs out. */
+static inline int lz4_read_length(const u8 **ipp, const u8 *iend,
+				  size_t *len)
+{
+	const u8 *ip = *ipp;
+	unsigned int s;
+
+	do {
+		if (ip >= iend)
+			return 0;
+		s = *ip++;
+		*len += s;
+	} while (s == 255);
+
+	*ipp = ip;
+	return 1;
+}
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len)
+{
+	const u8 *ip = src;
+	const u8 *const iend = src + src_len;
+	u8 *op = dst;
+	u8 *const oend = dst + *dst_len;
+
+	for (;;) {
+		unsigned int token;
+		size_t len, offset;
+		const u8 *ref;
+		u8 *cpy;
+
+		if (ip >= iend)
+			goto input_overrun;
+		token = *ip++;
+
+		/* literals */
+		len = token >> ML_BITS;
+		if (len == RUN_MASK && !lz4_read_length(&ip, iend, &len))
+			goto input_overrun;
+		if (len > (size_t)(iend - ip))
+			goto input_overrun;
+		if (len > (size_t)(oend - op))
+			goto output_overrun;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* the last sequence has no match */
+		if (ip == iend)
+			break;
+
+		/* match */
+		if (iend - ip < 2)
+			goto input_overrun;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (!offset || offset > (size_t)(op - dst))
+			goto lookbehind_overrun;
+		ref = op - offset;
+
+		len = token & ML_MASK;
+		if (len == ML_MASK && !lz4_read_length(&ip, iend, &len))
+			goto input_overrun;
+		len += MINMATCH;
+		if (len > (size_t)(oend - op))
+			goto output_overrun;
+
+		cpy = op + len;
+		if (offset >= 8 && oend - cpy >= 8) {
+			/* may write up to 7 bytes past cpy, still in dst */
+			do {
+				COPY8(op, ref);
+				op += 8;
+				ref += 8;
+			} while (op < cpy);
+			op = cpy;
+		} else {
+			while (op < cpy)
+				*op++ = *ref++;
+		}
+	}
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+
+input_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_INPUT_OVERRUN;
+
+output_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_OUTPUT_OVERRUN;
+
+lookbehind_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_LOOKBEHIND_OVERRUN;
+}
+#ifndef STATIC
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+
+#endif
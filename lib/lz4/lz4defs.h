@@ -0,0 +1,116 @@
+/*
+ *  LZ4 block format definitions
+ *
+ *  A block is a series of sequences.  Each starts with a token whose high
+ *  nibble is the number of literals that follow and whose low nibble is
+ *  the match length minus MINMATCH.  A nibble of 15 is continued by
+ *  bytes that are added to it, for as long as they are 255.  The literals
+ *  come next, then the match offset as a little-endian 16-bit value, then
+ *  the match length continuation bytes.  The last sequence carries only
+ *  literals.
+ */
+
+#define MINMATCH	4
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define MAX_DISTANCE	65535
+
+/*
+ * The last LASTLITERALS bytes of a block are always literals, and no
+ * match starts within MFLIMIT bytes of the end.  Blocks shorter than
+ * MINLENGTH are stored as literals only.
+ */
+#define COPYLENGTH	8
+#define LASTLITERALS	5
+#define MFLIMIT		(COPYLENGTH + MINMATCH)
+#define MINLENGTH	(MFLIMIT + 1)
+
+#ifndef STATIC
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <asm/unaligned.h>
+
+#define LZ4_READ32(p)	get_unaligned((const u32 *)(p))
+
+/* Number of leading bytes that are equal in two words that differ */
+static inline unsigned int lz4_nbcommonbytes(unsigned long diff)
+{
+#ifdef __LITTLE_ENDIAN
+	return __ffs(diff) >> 3;
+#else
+	return (BITS_PER_LONG - 1 - __fls(diff)) >> 3;
+#endif
+}
+
+/* Length of the common prefix of @ip and @ref, stopping at @limit */
+static inline unsigned int lz4_count(const u8 *ip, const u8 *ref,
+				     const u8 *limit)
+{
+	const u8 *start = ip;
+
+	while (ip < limit - (sizeof(unsigned long) - 1)) {
+		unsigned long diff = get_unaligned((const unsigned long *)ref) ^
+			get_unaligned((const unsigned long *)ip);
+
+		if (diff)
+			return ip - start + lz4_nbcommonbytes(diff);
+		ip += sizeof(unsigned long);
+		ref += sizeof(unsigned long);
+	}
+	while (ip < limit && *ip == *ref) {
+		ip++;
+		ref++;
+	}
+	return ip - start;
+}
+
+static inline u8 *lz4_write_length(u8 *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+/*
+ * Emit the literals from @anchor to @ip, followed by a match of @len
+ * bytes at @offset, or by nothing if @len is zero.
+ */
+static inline u8 *lz4_write_sequence(u8 *op, const u8 *anchor, const u8 *ip,
+				     unsigned int offset, size_t len)
+{
+	size_t lit = ip - anchor;
+	u8 *token = op++;
+
+	if (lit >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_write_length(op, lit - RUN_MASK);
+	} else
+		*token = lit << ML_BITS;
+
+	memcpy(op, anchor, lit);
+	op += lit;
+
+	if (!len)
+		return op;
+
+	put_unaligned_le16(offset, op);
+	op += 2;
+
+	len -= MINMATCH;
+	if (len >= ML_MASK) {
+		*token |= ML_MASK;
+		op = lz4_write_length(op, len - ML_MASK);
+	} else
+		*token |= len;
+
+	return op;
+}
+
+#endif
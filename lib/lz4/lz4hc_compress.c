@@ -0,0 +1,130 @@
+/*
+ *  LZ4 high compression
+ *
+ *  Produces the same format as lz4_compress(), but every position is
+ *  entered into hash chains and up to MAX_NB_ATTEMPTS earlier positions
+ *  with the same hash are compared to find the longest match.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+#define HASH_LOG		15
+#define HASHTABLESIZE		(1 << HASH_LOG)
+#define MAXD_LOG		16
+#define MAXD			(1 << MAXD_LOG)
+#define MAXD_MASK		(MAXD - 1)
+#define MAX_NB_ATTEMPTS		256
+
+struct lz4hc_data {
+	/* last position + 1 of each hash, 0 if none */
+	u32 hash_table[HASHTABLESIZE];
+	/* distance to the previous position with the same hash, 0 if none */
+	u16 chain_table[MAXD];
+};
+
+static inline u32 lz4hc_hash(const u8 *p)
+{
+	return (LZ4_READ32(p) * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static inline void lz4hc_insert(struct lz4hc_data *ctx, const u8 *base,
+				u32 pos)
+{
+	u32 h = lz4hc_hash(base + pos);
+	u32 prev = ctx->hash_table[h];
+	u32 delta = pos + 1 - prev;
+
+	ctx->chain_table[pos & MAXD_MASK] =
+		(prev && delta <= MAX_DISTANCE) ? delta : 0;
+	ctx->hash_table[h] = pos + 1;
+}
+
+/* The longest match for @ip among earlier positions, 0 if none. */
+static size_t lz4hc_find_match(struct lz4hc_data *ctx, const u8 *base,
+			       const u8 *ip, const u8 *matchlimit,
+			       const u8 **matchpos)
+{
+	u32 pos = ip - base;
+	u32 cand = ctx->hash_table[lz4hc_hash(ip)];
+	int attempts = MAX_NB_ATTEMPTS;
+	size_t best = 0;
+
+	while (cand && attempts--) {
+		u32 cpos = cand - 1;
+		const u8 *ref = base + cpos;
+		u16 delta;
+
+		if (pos - cpos > MAX_DISTANCE)
+			break;
+
+		if (ref[best] == ip[best] && LZ4_READ32(ref) == LZ4_READ32(ip)) {
+			size_t len = MINMATCH + lz4_count(ip + MINMATCH,
+							  ref + MINMATCH,
+							  matchlimit);
+
+			if (len > best) {
+				best = len;
+				*matchpos = ref;
+				if (ip + len >= matchlimit)
+					break;
+			}
+		}
+
+		delta = ctx->chain_table[cpos & MAXD_MASK];
+		if (!delta)
+			break;
+		cand -= delta;
+	}
+
+	return best;
+}
+
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	struct lz4hc_data *ctx = wrkmem;
+	const u8 *ip = src, *anchor = src;
+	const u8 *const iend = src + src_len;
+	const u8 *mflimit, *matchlimit;
+	u32 next_to_update = 0;
+	u8 *op = dst;
+
+	BUILD_BUG_ON(sizeof(struct lz4hc_data) > LZ4HC_MEM_COMPRESS);
+
+	if (src_len < MINLENGTH)
+		goto last_literals;
+
+	mflimit = iend - MFLIMIT;
+	matchlimit = iend - LASTLITERALS;
+	memset(ctx->hash_table, 0, sizeof(ctx->hash_table));
+
+	while (ip <= mflimit) {
+		const u8 *ref = NULL;
+		size_t len;
+
+		while (next_to_update < (u32)(ip - src))
+			lz4hc_insert(ctx, src, next_to_update++);
+
+		len = lz4hc_find_match(ctx, src, ip, matchlimit, &ref);
+		if (len < MINMATCH) {
+			ip++;
+			continue;
+		}
+
+		op = lz4_write_sequence(op, anchor, ip, ip - ref, len);
+		ip += len;
+		anchor = ip;
+	}
+
+last_literals:
+	op = lz4_write_sequence(op, anchor, iend, 0, 0);
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4hc_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4HC Compressor");
@@ -15,10 +15,27 @@
 #define LZO_VERSION_STRING	"2.02"
 #define LZO_VERSION_DATE	"Oct 17 2005"
 
+/*
+ * Copy 4 or 8 bytes through possibly unaligned pointers.  Where unaligned
+ * access is cheap these are single loads and stores, and the fast paths
+ * built on them overrun the exact copy length by up to a word into space
+ * the bounds checks have reserved.
+ */
+#define COPY4(dst, src)	\
+		put_unaligned(get_unaligned((const u32 *)(src)), (u32 *)(dst))
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) && defined(CONFIG_64BIT)
+#define COPY8(dst, src)	\
+		put_unaligned(get_unaligned((const u64 *)(src)), (u64 *)(dst))
+#else
+#define COPY8(dst, src)	\
+		do { COPY4(dst, src); COPY4((dst) + 4, (src) + 4); } while (0)
+#endif
+
 #define M1_MAX_OFFSET	0x0400
 #define M2_MAX_OFFSET	0x0800
 #define M3_MAX_OFFSET	0x4000
-#define M4_MAX_OFFSET	0xbfff
+#define M4_MAX_OFFSET_V0	0xbfff
+#define M4_MAX_OFFSET_V1	0xbffe
 
 #define M1_MIN_LEN	2
 #define M1_MAX_LEN	2
@@ -34,10 +51,22 @@
 #define M3_MARKER	32
 #define M4_MARKER	16
 
-#define D_BITS		14
-#define D_MASK		((1u << D_BITS) - 1)
-#define D_HIGH		((D_MASK >> 1) + 1)
+/*
+ * Bitstream version 1 ("lzo-rle") starts with the two bytes 17, 1, which
+ * version 0 streams never do, and adds a zero run instruction.  It is a
+ * short M4 instruction with bit 3 of the marker set and a distance field
+ * of all ones, a distance version 1 compressors never use:
+ *
+ *	16 | 8 | (1 + L % 7),  0xfc | state,  0xff,  L / 7
+ *
+ * which stands for MIN_ZERO_RUN_LENGTH + L zero bytes, followed by 'state'
+ * literals as after any other match.
+ */
+#define LZO_RLE_VERSION		1
+#define MIN_ZERO_RUN_LENGTH	4
+#define MAX_ZERO_RUN_LENGTH	(MIN_ZERO_RUN_LENGTH + 255 * 7 + 6)
 
-#define DX2(p, s1, s2)	(((((size_t)((p)[2]) << (s2)) ^ (p)[1]) \
-							<< (s1)) ^ (p)[0])
-#define DX3(p, s1, s2, s3)	((DX2((p)+1, s2, s3) << (s1)) ^ (p)[0])
+#define lzo_dict_t	unsigned short
+#define D_BITS		13
+#define D_SIZE		(1u << D_BITS)
+#define D_MASK		(D_SIZE - 1)
@@ -0,0 +1,810 @@
+/*
+ * Test and benchmark for the LZO1X compressor and decompressor
+ *
+ * lzo1x_1_compress(), lzorle1x_1_compress() and lzo1x_decompress_safe()
+ * are checked against the byte at a time LZO1X-1 code they replaced, on
+ * two kinds of synthetic page data: anonymous memory as zram and zswap
+ * compress it, and file contents as btrfs compresses them, a page at a
+ * time.  Every stream has to decode to the original page with each
+ * decompressor that understands its format, and truncated, corrupted or
+ * too large streams have to be rejected without writing past the output
+ * buffer.  The compression ratio and throughput of the old and new code
+ * are reported afterwards.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/lzo.h>
+#include <asm/unaligned.h>
+
+static unsigned int pages = 256;
+module_param(pages, uint, 0444);
+MODULE_PARM_DESC(pages, "Number of pages of each kind of data");
+
+static unsigned int iterations = 20;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Number of benchmark passes over the data");
+
+/*
+ * The LZO1X-1 compressor and safe decompressor from miniLZO 2.02, as they
+ * were in lib/lzo before the word at a time rewrite.
+ */
+
+#define REF_MEM_COMPRESS	(16384 * sizeof(unsigned char *))
+
+#define M1_MAX_OFFSET	0x0400
+#define M2_MAX_OFFSET	0x0800
+#define M3_MAX_OFFSET	0x4000
+#define M4_MAX_OFFSET	0xbfff
+
+#define M1_MIN_LEN	2
+#define M1_MAX_LEN	2
+#define M2_MIN_LEN	3
+#define M2_MAX_LEN	8
+#define M3_MIN_LEN	3
+#define M3_MAX_LEN	33
+#define M4_MIN_LEN	3
+#define M4_MAX_LEN	9
+
+#define M1_MARKER	0
+#define M2_MARKER	64
+#define M3_MARKER	32
+#define M4_MARKER	16
+
+#define D_BITS		14
+#define D_MASK		((1u << D_BITS) - 1)
+#define D_HIGH		((D_MASK >> 1) + 1)
+
+#define DX2(p, s1, s2)	(((((size_t)((p)[2]) << (s2)) ^ (p)[1]) \
+							<< (s1)) ^ (p)[0])
+#define DX3(p, s1, s2, s3)	((DX2((p)+1, s2, s3) << (s1)) ^ (p)[0])
+
+static noinline size_t
+ref_do_compress(const unsigned char *in, size_t in_len,
+		unsigned char *out, size_t *out_len, void *wrkmem)
+{
+	const unsigned char * const in_end = in + in_len;
+	const unsigned char * const ip_end = in + in_len - M2_MAX_LEN - 5;
+	const unsigned char ** const dict = wrkmem;
+	const unsigned char *ip = in, *ii = ip;
+	const unsigned char *end, *m, *m_pos;
+	size_t m_off, m_len, dindex;
+	unsigned char *op = out;
+
+	ip += 4;
+
+	for (;;) {
+		dindex = ((size_t)(0x21 * DX3(ip, 5, 5, 6)) >> 5) & D_MASK;
+		m_pos = dict[dindex];
+
+		if (m_pos < in)
+			goto literal;
+
+		if (ip == m_pos || ((size_t)(ip - m_pos) > M4_MAX_OFFSET))
+			goto literal;
+
+		m_off = ip - m_pos;
+		if (m_off <= M2_MAX_OFFSET || m_pos[3] == ip[3])
+			goto try_match;
+
+		dindex = (dindex & (D_MASK & 0x7ff)) ^ (D_HIGH | 0x1f);
+		m_pos = dict[dindex];
+
+		if (m_pos < in)
+			goto literal;
+
+		if (ip == m_pos || ((size_t)(ip - m_pos) > M4_MAX_OFFSET))
+			goto literal;
+
+		m_off = ip - m_pos;
+		if (m_off <= M2_MAX_OFFSET || m_pos[3] == ip[3])
+			goto try_match;
+
+		goto literal;
+
+try_match:
+		if (get_unaligned((const unsigned short *)m_pos)
+				== get_unaligned((const unsigned short *)ip)) {
+			if (likely(m_pos[2] == ip[2]))
+					goto match;
+		}
+
+literal:
+		dict[dindex] = ip;
+		++ip;
+		if (unlikely(ip >= ip_end))
+			break;
+		continue;
+
+match:
+		dict[dindex] = ip;
+		if (ip != ii) {
+			size_t t = ip - ii;
+
+			if (t <= 3) {
+				op[-2] |= t;
+			} else if (t <= 18) {
+				*op++ = (t - 3);
+			} else {
+				size_t tt = t - 18;
+
+				*op++ = 0;
+				while (tt > 255) {
+					tt -= 255;
+					*op++ = 0;
+				}
+				*op++ = tt;
+			}
+			do {
+				*op++ = *ii++;
+			} while (--t > 0);
+		}
+
+		ip += 3;
+		if (m_pos[3] != *ip++ || m_pos[4] != *ip++
+				|| m_pos[5] != *ip++ || m_pos[6] != *ip++
+				|| m_pos[7] != *ip++ || m_pos[8] != *ip++) {
+			--ip;
+			m_len = ip - ii;
+
+			if (m_off <= M2_MAX_OFFSET) {
+				m_off -= 1;
+				*op++ = (((m_len - 1) << 5)
+						| ((m_off & 7) << 2));
+				*op++ = (m_off >> 3);
+			} else if (m_off <= M3_MAX_OFFSET) {
+				m_off -= 1;
+				*op++ = (M3_MARKER | (m_len - 2));
+				goto m3_m4_offset;
+			} else {
+				m_off -= 0x4000;
+
+				*op++ = (M4_MARKER | ((m_off & 0x4000) >> 11)
+						| (m_len - 2));
+				goto m3_m4_offset;
+			}
+		} else {
+			end = in_end;
+			m = m_pos + M2_MAX_LEN + 1;
+
+			while (ip < end && *m == *ip) {
+				m++;
+				ip++;
+			}
+			m_len = ip - ii;
+
+			if (m_off <= M3_MAX_OFFSET) {
+				m_off -= 1;
+				if (m_len <= 33) {
+					*op++ = (M3_MARKER | (m_len - 2));
+				} else {
+					m_len -= 33;
+					*op++ = M3_MARKER | 0;
+					goto m3_m4_len;
+				}
+			} else {
+				m_off -= 0x4000;
+				if (m_len <= M4_MAX_LEN) {
+					*op++ = (M4_MARKER
+						| ((m_off & 0x4000) >> 11)
+						| (m_len - 2));
+				} else {
+					m_len -= M4_MAX_LEN;
+					*op++ = (M4_MARKER
+						| ((m_off & 0x4000) >> 11));
+m3_m4_len:
+					while (m_len > 255) {
+						m_len -= 255;
+						*op++ = 0;
+					}
+
+					*op++ = (m_len);
+				}
+			}
+m3_m4_offset:
+			*op++ = ((m_off & 63) << 2);
+			*op++ = (m_off >> 6);
+		}
+
+		ii = ip;
+		if (unlikely(ip >= ip_end))
+			break;
+	}
+
+	*out_len = op - out;
+	return in_end - ii;
+}
+
+static int ref_lzo1x_1_compress(const unsigned char *in, size_t in_len,
+		unsigned char *out, size_t *out_len, void *wrkmem)
+{
+	const unsigned char *ii;
+	unsigned char *op = out;
+	size_t t;
+
+	if (unlikely(in_len <= M2_MAX_LEN + 5)) {
+		t = in_len;
+	} else {
+		t = ref_do_compress(in, in_len, op, out_len, wrkmem);
+		op += *out_len;
+	}
+
+	if (t > 0) {
+		ii = in + in_len - t;
+
+		if (op == out && t <= 238) {
+			*op++ = (17 + t);
+		} else if (t <= 3) {
+			op[-2] |= t;
+		} else if (t <= 18) {
+			*op++ = (t - 3);
+		} else {
+			size_t tt = t - 18;
+
+			*op++ = 0;
+			while (tt > 255) {
+				tt -= 255;
+				*op++ = 0;
+			}
+
+			*op++ = tt;
+		}
+		do {
+			*op++ = *ii++;
+		} while (--t > 0);
+	}
+
+	*op++ = M4_MARKER | 1;
+	*op++ = 0;
+	*op++ = 0;
+
+	*out_len = op - out;
+	return LZO_E_OK;
+}
+
+#define HAVE_IP(x, ip_end, ip) ((size_t)(ip_end - ip) < (x))
+#define HAVE_OP(x, op_end, op) ((size_t)(op_end - op) < (x))
+#define HAVE_LB(m_pos, out, op) (m_pos < out || m_pos >= op)
+
+#define COPY4(dst, src)	\
+		put_unaligned(get_unaligned((const u32 *)(src)), (u32 *)(dst))
+
+static int ref_lzo1x_decompress_safe(const unsigned char *in,
+		size_t in_len, unsigned char *out, size_t *out_len)
+{
+	const unsigned char * const ip_end = in + in_len;
+	unsigned char * const op_end = out + *out_len;
+	const unsigned char *ip = in, *m_pos;
+	unsigned char *op = out;
+	size_t t;
+
+	*out_len = 0;
+
+	if (*ip > 17) {
+		t = *ip++ - 17;
+		if (t < 4)
+			goto match_next;
+		if (HAVE_OP(t, op_end, op))
+			goto output_overrun;
+		if (HAVE_IP(t + 1, ip_end, ip))
+			goto input_overrun;
+		do {
+			*op++ = *ip++;
+		} while (--t > 0);
+		goto first_literal_run;
+	}
+
+	while ((ip < ip_end)) {
+		t = *ip++;
+		if (t >= 16)
+			goto match;
+		if (t == 0) {
+			if (HAVE_IP(1, ip_end, ip))
+				goto input_overrun;
+			while (*ip == 0) {
+				t += 255;
+				ip++;
+				if (HAVE_IP(1, ip_end, ip))
+					goto input_overrun;
+			}
+			t += 15 + *ip++;
+		}
+		if (HAVE_OP(t + 3, op_end, op))
+			goto output_overrun;
+		if (HAVE_IP(t + 4, ip_end, ip))
+			goto input_overrun;
+
+		COPY4(op, ip);
+		op += 4;
+		ip += 4;
+		if (--t > 0) {
+			if (t >= 4) {
+				do {
+					COPY4(op, ip);
+					op += 4;
+					ip += 4;
+					t -= 4;
+				} while (t >= 4);
+				if (t > 0) {
+					do {
+						*op++ = *ip++;
+					} while (--t > 0);
+				}
+			} else {
+				do {
+					*op++ = *ip++;
+				} while (--t > 0);
+			}
+		}
+
+first_literal_run:
+		t = *ip++;
+		if (t >= 16)
+			goto match;
+		m_pos = op - (1 + M2_MAX_OFFSET);
+		m_pos -= t >> 2;
+		m_pos -= *ip++ << 2;
+
+		if (HAVE_LB(m_pos, out, op))
+			goto lookbehind_overrun;
+
+		if (HAVE_OP(3, op_end, op))
+			goto output_overrun;
+		*op++ = *m_pos++;
+		*op++ = *m_pos++;
+		*op++ = *m_pos;
+
+		goto match_done;
+
+		do {
+match:
+			if (t >= 64) {
+				m_pos = op - 1;
+				m_pos -= (t >> 2) & 7;
+				m_pos -= *ip++ << 3;
+				t = (t >> 5) - 1;
+				if (HAVE_LB(m_pos, out, op))
+					goto lookbehind_overrun;
+				if (HAVE_OP(t + 3 - 1, op_end, op))
+					goto output_overrun;
+				goto copy_match;
+			} else if (t >= 32) {
+				t &= 31;
+				if (t == 0) {
+					if (HAVE_IP(1, ip_end, ip))
+						goto input_overrun;
+					while (*ip == 0) {
+						t += 255;
+						ip++;
+						if (HAVE_IP(1, ip_end, ip))
+							goto input_overrun;
+					}
+					t += 31 + *ip++;
+				}
+				m_pos = op - 1;
+				m_pos -= get_unaligned_le16(ip) >> 2;
+				ip += 2;
+			} else if (t >= 16) {
+				m_pos = op;
+				m_pos -= (t & 8) << 11;
+
+				t &= 7;
+				if (t == 0) {
+					if (HAVE_IP(1, ip_end, ip))
+						goto input_overrun;
+					while (*ip == 0) {
+						t += 255;
+						ip++;
+						if (HAVE_IP(1, ip_end, ip))
+							goto input_overrun;
+					}
+					t += 7 + *ip++;
+				}
+				m_pos -= get_unaligned_le16(ip) >> 2;
+				ip += 2;
+				if (m_pos == op)
+					goto eof_found;
+				m_pos -= 0x4000;
+			} else {
+				m_pos = op - 1;
+				m_pos -= t >> 2;
+				m_pos -= *ip++ << 2;
+
+				if (HAVE_LB(m_pos, out, op))
+					goto lookbehind_overrun;
+				if (HAVE_OP(2, op_end, op))
+					goto output_overrun;
+
+				*op++ = *m_pos++;
+				*op++ = *m_pos;
+				goto match_done;
+			}
+
+			if (HAVE_LB(m_pos, out, op))
+				goto lookbehind_overrun;
+			if (HAVE_OP(t + 3 - 1, op_end, op))
+				goto output_overrun;
+
+			if (t >= 2 * 4 - (3 - 1) && (op - m_pos) >= 4) {
+				COPY4(op, m_pos);
+				op += 4;
+				m_pos += 4;
+				t -= 4 - (3 - 1);
+				do {
+					COPY4(op, m_pos);
+					op += 4;
+					m_pos += 4;
+					t -= 4;
+				} while (t >= 4);
+				if (t > 0)
+					do {
+						*op++ = *m_pos++;
+					} while (--t > 0);
+			} else {
+copy_match:
+				*op++ = *m_pos++;
+				*op++ = *m_pos++;
+				do {
+					*op++ = *m_pos++;
+				} while (--t > 0);
+			}
+match_done:
+			t = ip[-2] & 3;
+			if (t == 0)
+				break;
+match_next:
+			if (HAVE_OP(t, op_end, op))
+				goto output_overrun;
+			if (HAVE_IP(t + 1, ip_end, ip))
+				goto input_overrun;
+
+			*op++ = *ip++;
+			if (t > 1) {
+				*op++ = *ip++;
+				if (t > 2)
+					*op++ = *ip++;
+			}
+
+			t = *ip++;
+		} while (ip < ip_end);
+	}
+
+	*out_len = op - out;
+	return LZO_E_EOF_NOT_FOUND;
+
+eof_found:
+	*out_len = op - out;
+	return (ip == ip_end ? LZO_E_OK :
+		(ip < ip_end ? LZO_E_INPUT_NOT_CONSUMED : LZO_E_INPUT_OVERRUN));
+input_overrun:
+	*out_len = op - out;
+	return LZO_E_INPUT_OVERRUN;
+
+output_overrun:
+	*out_len = op - out;
+	return LZO_E_OUTPUT_OVERRUN;
+
+lookbehind_overrun:
+	*out_len = op - out;
+	return LZO_E_LOOKBEHIND_OVERRUN;
+}
+
+#define OUT_GUARD	64
+#define CBUF_SIZE	lzo1x_worst_compress(PAGE_SIZE)
+
+typedef int (*compress_fn)(const unsigned char *, size_t, unsigned char *,
+			   size_t *, void *);
+typedef int (*decompress_fn)(const unsigned char *, size_t, unsigned char *,
+			     size_t *);
+
+static const struct lzo_impl {
+	const char *name;
+	compress_fn compress;
+	decompress_fn decompress;
+} impls[] = {
+	{ "lzo (old)", ref_lzo1x_1_compress, ref_lzo1x_decompress_safe },
+	{ "lzo", lzo1x_1_compress, lzo1x_decompress_safe },
+	{ "lzo-rle", lzorle1x_1_compress, lzo1x_decompress_safe },
+};
+
+static struct rnd_state rnd;
+
+static const char * const words[] = {
+	"the", "page", "struct", "return", "if", "int", "static", "void",
+	"of", "memory", "lock", "for", "while", "NULL", "unsigned", "long",
+	"and", "a", "to", "is", "mapping", "data", "buffer", "size", "err",
+	"goto", "out", "free", "->", "=", "==", "(", ")", ";\n\t", "{\n", "}\n",
+};
+
+static void __init fill_text(u8 *p, size_t len)
+{
+	size_t pos = 0;
+
+	while (pos < len) {
+		const char *w = words[prandom32(&rnd) % ARRAY_SIZE(words)];
+
+		while (*w && pos < len)
+			p[pos++] = *w++;
+		if (pos < len)
+			p[pos++] = ' ';
+	}
+}
+
+/* Anonymous memory: zero, sparse, slab-like, text or incompressible */
+static void __init fill_zram_page(u8 *p)
+{
+	unsigned int i, kind = prandom32(&rnd) % 8;
+
+	memset(p, 0, PAGE_SIZE);
+	switch (kind) {
+	case 0:
+		break;
+	case 1:
+	case 2:
+		for (i = prandom32(&rnd) % 64; i; i--) {
+			unsigned int off = prandom32(&rnd) % (PAGE_SIZE - 16);
+			unsigned int len = 1 + prandom32(&rnd) % 16;
+
+			while (len--)
+				p[off++] = prandom32(&rnd);
+		}
+		break;
+	case 3:
+	case 4:
+	case 5:
+		for (i = 0; i < PAGE_SIZE / sizeof(u64); i++) {
+			u32 r = prandom32(&rnd);
+			u64 v = 0;
+
+			if (r % 8 < 4)
+				v = 0xffff880000000000ULL | (u64)(r >> 8) << 6;
+			else if (r % 8 < 6)
+				v = r >> 24;
+			((u64 *)p)[i] = v;
+		}
+		break;
+	case 6:
+		fill_text(p, PAGE_SIZE);
+		break;
+	default:
+		for (i = 0; i < PAGE_SIZE; i += sizeof(u32))
+			put_unaligned(prandom32(&rnd), (u32 *)(p + i));
+		break;
+	}
+}
+
+/* File contents: text, binary with repeated fragments, or records */
+static void __init fill_btrfs_page(u8 *p)
+{
+	unsigned int i, kind = prandom32(&rnd) % 4;
+
+	switch (kind) {
+	case 0:
+	case 1:
+		fill_text(p, PAGE_SIZE);
+		break;
+	case 2:
+		i = 0;
+		while (i < PAGE_SIZE) {
+			unsigned int len;
+
+			if (i >= 64 && prandom32(&rnd) % 2) {
+				unsigned int from = prandom32(&rnd) % (i - 32);
+
+				len = min_t(unsigned int, 4 + prandom32(&rnd) % 28,
+					    PAGE_SIZE - i);
+				while (len--)
+					p[i++] = p[from++];
+			} else {
+				len = min_t(unsigned int, 1 + prandom32(&rnd) % 8,
+					    PAGE_SIZE - i);
+				while (len--)
+					p[i++] = prandom32(&rnd);
+			}
+		}
+		break;
+	default:
+		for (i = 0; i < PAGE_SIZE; i += 64) {
+			memset(p + i, 0, 64);
+			put_unaligned_le32(i / 64 + 1000, p + i);
+			put_unaligned_le32(prandom32(&rnd) % 100, p + i + 4);
+			fill_text(p + i + 8, 8 + prandom32(&rnd) % 32);
+		}
+		break;
+	}
+}
+
+static int __init decode_ok(decompress_fn decompress, const u8 *c,
+			    size_t clen, const u8 *page, u8 *dbuf)
+{
+	size_t dlen = PAGE_SIZE;
+
+	if (decompress(c, clen, dbuf, &dlen) != LZO_E_OK)
+		return 0;
+	return dlen == PAGE_SIZE && !memcmp(dbuf, page, PAGE_SIZE);
+}
+
+/* Decode a broken stream; only the output buffer may be written */
+static int __init decode_bad(const u8 *c, size_t clen, size_t dlen, u8 *dbuf)
+{
+	size_t len = dlen;
+	int i, ret;
+
+	memset(dbuf + dlen, 0xa5, OUT_GUARD);
+	ret = lzo1x_decompress_safe(c, clen, dbuf, &len);
+	for (i = 0; i < OUT_GUARD; i++)
+		if (dbuf[dlen + i] != 0xa5)
+			return -EFAULT;
+	if (len > dlen)
+		return -EFAULT;
+	return ret;
+}
+
+static int __init check_page(const u8 *page, u8 *cbuf, u8 *dbuf,
+			     void *wrkmem)
+{
+	int i, err = 0;
+
+	for (i = 0; i < ARRAY_SIZE(impls); i++) {
+		const struct lzo_impl *impl = &impls[i];
+		size_t clen;
+		int ret;
+
+		impl->compress(page, PAGE_SIZE, cbuf, &clen, wrkmem);
+		if (clen > CBUF_SIZE) {
+			pr_err("%s: %zu bytes exceed the worst case\n",
+			       impl->name, clen);
+			return -EINVAL;
+		}
+
+		/* every decoder that knows the format must agree */
+		if (!decode_ok(lzo1x_decompress_safe, cbuf, clen, page, dbuf) ||
+		    (impl->compress != lzorle1x_1_compress &&
+		     !decode_ok(ref_lzo1x_decompress_safe, cbuf, clen, page,
+				dbuf))) {
+			pr_err("%s: round trip failed\n", impl->name);
+			err = -EINVAL;
+		}
+
+		ret = decode_bad(cbuf, clen, PAGE_SIZE - 1, dbuf);
+		if (ret != LZO_E_OUTPUT_OVERRUN) {
+			pr_err("%s: short output buffer: %d\n", impl->name, ret);
+			err = -EINVAL;
+		}
+
+		ret = decode_bad(cbuf, clen - 1, PAGE_SIZE, dbuf);
+		if (ret == LZO_E_OK || ret == -EFAULT) {
+			pr_err("%s: truncated stream: %d\n", impl->name, ret);
+			err = -EINVAL;
+		}
+
+		cbuf[prandom32(&rnd) % clen] ^= 1 << (prandom32(&rnd) % 8);
+		if (decode_bad(cbuf, clen, PAGE_SIZE, dbuf) == -EFAULT) {
+			pr_err("%s: corrupted stream overran\n", impl->name);
+			err = -EINVAL;
+		}
+	}
+	return err;
+}
+
+static u64 __init mb_per_sec(u64 bytes, s64 ns)
+{
+	return ns > 0 ? div64_u64(bytes * 1000, ns) : 0;
+}
+
+static void __init benchmark(const char *set, const u8 *data, u8 *cdata,
+			     size_t *clens, u8 *dbuf, void *wrkmem)
+{
+	u64 bytes = (u64)pages * PAGE_SIZE * iterations;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(impls); i++) {
+		const struct lzo_impl *impl = &impls[i];
+		u64 total = 0;
+		ktime_t start;
+		s64 cns, dns;
+		unsigned int it, n;
+
+		start = ktime_get();
+		for (it = 0; it < iterations; it++) {
+			for (n = 0; n < pages; n++)
+				impl->compress(data + n * PAGE_SIZE, PAGE_SIZE,
+					       cdata + n * CBUF_SIZE,
+					       &clens[n], wrkmem);
+			cond_resched();
+		}
+		cns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		start = ktime_get();
+		for (it = 0; it < iterations; it++) {
+			for (n = 0; n < pages; n++) {
+				size_t dlen = PAGE_SIZE;
+
+				impl->decompress(cdata + n * CBUF_SIZE,
+						 clens[n], dbuf, &dlen);
+			}
+			cond_resched();
+		}
+		dns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		for (n = 0; n < pages; n++)
+			total += clens[n];
+		pr_info("%-6s %-10s ratio %3llu%%  compress %5llu MB/s  decompress %5llu MB/s\n",
+			set, impl->name,
+			div64_u64(total * 100, (u64)pages * PAGE_SIZE),
+			mb_per_sec(bytes, cns), mb_per_sec(bytes, dns));
+	}
+}
+
+static int __init test_lzo_init(void)
+{
+	static const struct {
+		const char *name;
+		void (*fill)(u8 *);
+	} sets[] = {
+		{ "zram", fill_zram_page },
+		{ "btrfs", fill_btrfs_page },
+	};
+	u8 *data, *cdata, *dbuf;
+	size_t *clens;
+	void *wrkmem;
+	int i, err = -ENOMEM;
+	unsigned int n, failed = 0;
+
+	if (!pages || !iterations)
+		return -EINVAL;
+
+	data = vmalloc(pages * PAGE_SIZE);
+	cdata = vmalloc(pages * CBUF_SIZE);
+	clens = vmalloc(pages * sizeof(*clens));
+	dbuf = vmalloc(PAGE_SIZE + OUT_GUARD);
+	/* large enough for the old compressor's dictionary too */
+	wrkmem = vmalloc(REF_MEM_COMPRESS);
+	if (!data || !cdata || !clens || !dbuf || !wrkmem)
+		goto out;
+
+	prandom32_seed(&rnd, 42);
+	for (i = 0; i < ARRAY_SIZE(sets); i++) {
+		for (n = 0; n < pages; n++)
+			sets[i].fill(data + n * PAGE_SIZE);
+
+		for (n = 0; n < pages; n++)
+			if (check_page(data + n * PAGE_SIZE, cdata, dbuf,
+				       wrkmem))
+				failed++;
+		if (failed) {
+			pr_err("%s: %u of %u pages failed\n", sets[i].name,
+			       failed, pages);
+			err = -EINVAL;
+			goto out;
+		}
+
+		benchmark(sets[i].name, data, cdata, clens, dbuf, wrkmem);
+	}
+	pr_info("all tests passed\n");
+	err = 0;
+out:
+	vfree(wrkmem);
+	vfree(dbuf);
+	vfree(clens);
+	vfree(cdata);
+	vfree(data);
+	return err;
+}
+
+static void __exit test_lzo_exit(void)
+{
+}
+
+module_init(test_lzo_init);
+module_exit(test_lzo_exit);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZO1X test and benchmark");
@@ -0,0 +1,203 @@
+/*
+ * Test and benchmark for kmem_cache_alloc_bulk() and kmem_cache_free_bulk()
+ *
+ * Objects are allocated and freed in batches of 1 to 256, once with one
+ * kmem_cache_alloc()/kmem_cache_free() call per object and once with one
+ * bulk call per batch, and the cost per object of each is reported.  The
+ * bulk calls are also checked to hand out distinct, usable and, with
+ * __GFP_ZERO, cleared objects, and to take back objects freed in an order
+ * unrelated to the one they were allocated in.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/sort.h>
+
+#define MAX_BATCH	256
+
+static unsigned int size = 256;
+module_param(size, uint, 0444);
+MODULE_PARM_DESC(size, "Object size of the test cache");
+
+static unsigned int objects = 1 << 20;
+module_param(objects, uint, 0444);
+MODULE_PARM_DESC(objects, "Number of objects allocated and freed per measurement");
+
+static int cmp_ptr(const void *a, const void *b)
+{
+	unsigned long x = *(unsigned long *)a, y = *(unsigned long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Swap the halves of @p so that objects are not freed in allocation order */
+static void shuffle(void **p, unsigned int nr)
+{
+	unsigned int i, half = nr / 2;
+
+	for (i = 0; i < half; i++)
+		swap(p[i], p[i + half]);
+}
+
+static int check_batch(struct kmem_cache *s, void **p, unsigned int nr,
+		       gfp_t gfp)
+{
+	unsigned long *sorted = (unsigned long *)(p + MAX_BATCH);
+	unsigned int i, j;
+	int err = 0;
+
+	if (kmem_cache_alloc_bulk(s, gfp, nr, p) != nr) {
+		pr_err("batch %u: allocation failed\n", nr);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < nr; i++) {
+		unsigned char *obj = p[i];
+
+		if (gfp & __GFP_ZERO) {
+			for (j = 0; j < size; j++)
+				if (obj[j])
+					break;
+			if (j < size) {
+				pr_err("batch %u: object %u not zeroed\n",
+				       nr, i);
+				err = -EINVAL;
+			}
+		}
+		memset(obj, 0x5a, size);
+		sorted[i] = (unsigned long)obj;
+	}
+
+	sort(sorted, nr, sizeof(*sorted), cmp_ptr, NULL);
+	for (i = 1; i < nr; i++) {
+		if (sorted[i] - sorted[i - 1] < size) {
+			pr_err("batch %u: overlapping objects\n", nr);
+			err = -EINVAL;
+			break;
+		}
+	}
+
+	shuffle(p, nr);
+	kmem_cache_free_bulk(s, nr, p);
+	return err;
+}
+
+/* Both benchmarks store the cost per object in *ns, or return -ENOMEM */
+static int bench_single(struct kmem_cache *s, void **p, unsigned int nr,
+			u64 *ns)
+{
+	unsigned int rounds = max(objects / nr, 1U);
+	unsigned int r, i;
+	ktime_t start;
+
+	start = ktime_get();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nr; i++) {
+			p[i] = kmem_cache_alloc(s, GFP_KERNEL);
+			if (!p[i])
+				goto fail;
+		}
+		for (i = 0; i < nr; i++)
+			kmem_cache_free(s, p[i]);
+	}
+	*ns = div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		      rounds * nr);
+	return 0;
+
+fail:
+	while (i--)
+		kmem_cache_free(s, p[i]);
+	return -ENOMEM;
+}
+
+static int bench_bulk(struct kmem_cache *s, void **p, unsigned int nr,
+		      u64 *ns)
+{
+	unsigned int rounds = max(objects / nr, 1U);
+	unsigned int r;
+	ktime_t start;
+
+	start = ktime_get();
+	for (r = 0; r < rounds; r++) {
+		if (!kmem_cache_alloc_bulk(s, GFP_KERNEL, nr, p))
+			return -ENOMEM;
+		kmem_cache_free_bulk(s, nr, p);
+	}
+	*ns = div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		      rounds * nr);
+	return 0;
+}
+
+static int __init test_slab_bulk_init(void)
+{
+	static const unsigned int batches[] = {
+		1, 2, 3, 4, 8, 16, 30, 32, 64, 128, 158, 250, 256,
+	};
+	struct kmem_cache *s;
+	unsigned int i;
+	void **p;
+	int err = -ENOMEM;
+
+	if (size < sizeof(void *))
+		size = sizeof(void *);
+
+	/* room for a batch and, behind it, its sorted copy */
+	p = vmalloc(2 * MAX_BATCH * sizeof(void *));
+	if (!p)
+		return -ENOMEM;
+	s = kmem_cache_create("test_slab_bulk", size, 0, 0, NULL);
+	if (!s)
+		goto out;
+
+	for (i = 0; i < ARRAY_SIZE(batches); i++) {
+		err = check_batch(s, p, batches[i], GFP_KERNEL);
+		if (!err)
+			err = check_batch(s, p, batches[i],
+					  GFP_KERNEL | __GFP_ZERO);
+		if (err)
+			goto out_destroy;
+		cond_resched();
+	}
+
+	for (i = 0; i < ARRAY_SIZE(batches); i++) {
+		unsigned int nr = batches[i];
+		u64 single, bulk;
+
+		err = bench_single(s, p, nr, &single);
+		cond_resched();
+		if (!err)
+			err = bench_bulk(s, p, nr, &bulk);
+		cond_resched();
+		if (err) {
+			pr_err("batch %u: allocation failed, no timing\n", nr);
+			goto out_destroy;
+		}
+		pr_info("batch %3u: single %4llu ns/object  bulk %4llu ns/object\n",
+			nr, single, bulk);
+	}
+	pr_info("all tests passed\n");
+	err = 0;
+
+out_destroy:
+	kmem_cache_destroy(s);
+out:
+	vfree(p);
+	return err;
+}
+
+static void __exit test_slab_bulk_exit(void)
+{
+}
+
+module_init(test_slab_bulk_init);
+module_exit(test_slab_bulk_exit);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Slab bulk allocation test and benchmark");
@@ -1776,8 +1776,121 @@ page_not_uptodate:
 }
 EXPORT_SYMBOL(filemap_fault);
 
+#define FAULT_AROUND_BATCH	16
+
+/**
+ * filemap_map_pages - map pagecache pages around a read fault
+ * @vma:	vma in which the fault was taken
+ * @vmf:	struct vm_fault describing the window to map
+ *
+ * Called with the page table lock held, from the fault-around path, to
+ * map the pages between @vmf->pgoff and @vmf->max_pgoff that are already
+ * uptodate in the page cache into empty ptes starting at @vmf->pte.
+ * Nothing here may sleep: pages that are not cached, not uptodate, or
+ * locked by someone else are left for the regular fault path.
+ */
+void filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	struct file_ra_state *ra = &file->f_ra;
+	void **slots[FAULT_AROUND_BATCH];
+	unsigned long indices[FAULT_AROUND_BATCH];
+	struct page *pages[FAULT_AROUND_BATCH];
+	pgoff_t start = vmf->pgoff;
+	unsigned long mapped = 0;
+	pgoff_t size;
+	unsigned int nr, i;
+
+	while (start <= vmf->max_pgoff) {
+		unsigned int want = min_t(unsigned long, FAULT_AROUND_BATCH,
+					  vmf->max_pgoff - start + 1);
+
+		rcu_read_lock();
+restart:
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, start, want);
+		for (i = 0; i < nr; i++) {
+			struct page *page;
+repeat:
+			page = radix_tree_deref_slot(slots[i]);
+			if (unlikely(!page) || indices[i] > vmf->max_pgoff)
+				goto skip;
+			if (radix_tree_exception(page)) {
+				if (radix_tree_deref_retry(page)) {
+					/* drop what we have and retry */
+					while (i--)
+						if (pages[i])
+							page_cache_release(pages[i]);
+					goto restart;
+				}
+				/* a shmem/tmpfs swap entry: not for us */
+				goto skip;
+			}
+			if (!page_cache_get_speculative(page))
+				goto repeat;
+			if (unlikely(page != *slots[i])) {
+				page_cache_release(page);
+				goto repeat;
+			}
+			pages[i] = page;
+			continue;
+skip:
+			pages[i] = NULL;
+		}
+		rcu_read_unlock();
+
+		if (!nr)
+			break;
+
+		for (i = 0; i < nr; i++) {
+			struct page *page = pages[i];
+			unsigned long address;
+			pte_t *pte;
+
+			if (!page)
+				continue;
+			if (!PageUptodate(page) || PageReadahead(page) ||
+			    PageHWPoison(page))
+				goto release;
+			if (!trylock_page(page))
+				goto release;
+			if (page->mapping != mapping || !PageUptodate(page) ||
+			    page->index != indices[i])
+				goto unlock;
+			size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1)
+					>> PAGE_CACHE_SHIFT;
+			if (page->index >= size)
+				goto unlock;
+
+			pte = vmf->pte + (page->index - vmf->pgoff);
+			if (!pte_none(*pte))
+				goto unlock;
+
+			if (ra->mmap_miss > 0)
+				ra->mmap_miss--;
+			address = (unsigned long)vmf->virtual_address +
+				((page->index - vmf->pgoff) << PAGE_SHIFT);
+			do_set_pte(vma, address, page, pte);
+			mapped++;
+			unlock_page(page);
+			continue;
+unlock:
+			unlock_page(page);
+release:
+			page_cache_release(page);
+		}
+		start = indices[nr - 1] + 1;
+		if (!start)
+			break;
+	}
+	count_vm_events(PGFAULT_AROUND, mapped);
+}
+EXPORT_SYMBOL(filemap_map_pages);
+
 const struct vm_operations_struct generic_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
 };
 
 /* This is used for a general mmap of a disk file */
@@ -210,6 +210,17 @@ SYSCALL_DEFINE5(remap_file_pages, unsigned long, start, unsigned long, size,
 			}
 			goto out;
 		}
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		/* rmap cannot find huge pmds in a nonlinear vma */
+		if (vma->vm_ops && vma->vm_ops->pmd_fault) {
+			unsigned long addr;
+
+			for (addr = ALIGN(vma->vm_start, HPAGE_PMD_SIZE);
+			     addr + HPAGE_PMD_SIZE <= vma->vm_end;
+			     addr += HPAGE_PMD_SIZE)
+				split_huge_page_address(vma, addr);
+		}
+#endif
 		mutex_lock(&mapping->i_mmap_mutex);
 		flush_dcache_mmap_lock(mapping);
 		vma->vm_flags |= VM_NONLINEAR;
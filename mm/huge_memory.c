@@ -17,6 +17,9 @@
 #include <linux/khugepaged.h>
 #include <linux/freezer.h>
 #include <linux/mman.h>
+#include <linux/pagemap.h>
+#include <linux/file.h>
+#include <linux/shmem_fs.h>
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
 #include "internal.h"
@@ -317,6 +320,9 @@ static struct attribute *hugepage_attr[] = {
 	&defrag_attr.attr,
 #ifdef CONFIG_DEBUG_VM
 	&debug_cow_attr.attr,
+#endif
+#ifdef CONFIG_SHMEM
+	&shmem_enabled_attr.attr,
 #endif
 	NULL,
 };
@@ -718,6 +724,108 @@ out:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+static pmd_t *mm_find_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+
+	return pmd_offset(pud, address);
+}
+
+/*
+ * Map the HPAGE_PMD_NR page cache pages starting at @page, which the caller
+ * holds locked, with a single huge pmd.  That takes a naturally aligned
+ * physically contiguous block of uptodate pages, as shmem allocates them;
+ * they stay small pages to the rest of the VM, each mapped once.  If they
+ * are not, or one of them is locked, VM_FAULT_FALLBACK sends the fault
+ * down the pte path.  On success the mapping keeps the caller's reference
+ * on @page.
+ */
+int do_huge_pmd_file_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			  unsigned long address, pmd_t *pmd,
+			  struct page *page, unsigned int flags)
+{
+	struct address_space *mapping = page->mapping;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgtable_t pgtable;
+	pgoff_t size;
+	pmd_t entry;
+	int i, ret = VM_FAULT_FALLBACK;
+
+	if (page_to_pfn(page) & (HPAGE_PMD_NR - 1))
+		return VM_FAULT_FALLBACK;
+
+	for (i = 1; i < HPAGE_PMD_NR; i++) {
+		struct page *p = find_get_page(mapping, page->index + i);
+
+		if (p != page + i) {
+			if (p && !radix_tree_exceptional_entry(p))
+				page_cache_release(p);
+			goto release;
+		}
+		if (!trylock_page(p)) {
+			page_cache_release(p);
+			goto release;
+		}
+		if (p->mapping != mapping || !PageUptodate(p) ||
+		    PageHWPoison(p)) {
+			unlock_page(p);
+			page_cache_release(p);
+			goto release;
+		}
+	}
+
+	/* with all pages locked, truncation must wait for the pmd */
+	size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1) >>
+		PAGE_CACHE_SHIFT;
+	if (page->index + HPAGE_PMD_NR > size)
+		goto release;
+
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable)) {
+		ret = VM_FAULT_OOM;
+		goto release;
+	}
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pgtable);
+		goto release;
+	}
+	entry = mk_pmd(page, vma->vm_page_prot);
+	if (flags & FAULT_FLAG_WRITE)
+		entry = pmd_mkdirty(entry);
+	entry = pmd_mkhuge(entry);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_file_rmap(page + i);
+	add_mm_counter(mm, MM_FILEPAGES, HPAGE_PMD_NR);
+	set_pmd_at(mm, haddr, pmd, entry);
+	prepare_pmd_huge_pte(pgtable, mm);
+	spin_unlock(&mm->page_table_lock);
+	count_vm_event(THP_FILE_MAPPED);
+
+	/* the references taken above are the mapping's now */
+	for (i = 1; i < HPAGE_PMD_NR; i++)
+		unlock_page(page + i);
+	return 0;
+
+release:
+	while (--i > 0) {
+		unlock_page(page + i);
+		page_cache_release(page + i);
+	}
+	return ret;
+}
+
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 		  struct vm_area_struct *vma)
@@ -727,6 +835,10 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	pgtable_t pgtable;
 	int ret;
 
+	/* page cache mapped by a huge pmd is just faulted in by the child */
+	if (vma->vm_ops)
+		return 0;
+
 	ret = -ENOMEM;
 	pgtable = pte_alloc_one(dst_mm, addr);
 	if (unlikely(!pgtable))
@@ -889,6 +1001,12 @@ int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	struct page *page, *new_page;
 	unsigned long haddr;
 
+	if (vma->vm_ops) {
+		/* page cache: let the write fault go through the ptes */
+		split_huge_pmd(vma, address, pmd);
+		return 0;
+	}
+
 	VM_BUG_ON(!vma->anon_vma);
 	spin_lock(&mm->page_table_lock);
 	if (unlikely(!pmd_same(*pmd, orig_pmd)))
@@ -960,12 +1078,46 @@ out:
 	return ret;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * NUMA hinting fault on a huge pmd made inaccessible by change_prot_numa().
+ * Huge pages cannot be migrated, so the fault only restores access and
+ * tells the scheduler which node the task's memory is on.
+ */
+int do_huge_pmd_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			  unsigned long address, pmd_t *pmd, pmd_t orig_pmd)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pmd_t entry;
+	int nid;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_same(*pmd, orig_pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		return 0;
+	}
+
+	entry = pmd_mkyoung(pmd_modify(orig_pmd, vma->vm_page_prot));
+	set_pmd_at(mm, haddr, pmd, entry);
+	update_mmu_cache(vma, address, entry);
+	nid = page_to_nid(pmd_page(entry));
+	spin_unlock(&mm->page_table_lock);
+
+	count_vm_event(NUMA_HINT_FAULTS);
+	if (nid == numa_node_id())
+		count_vm_event(NUMA_HINT_FAULTS_LOCAL);
+	task_numa_fault(nid, HPAGE_PMD_NR, false);
+	return 0;
+}
+#endif
+
 struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 				   unsigned long addr,
 				   pmd_t *pmd,
 				   unsigned int flags)
 {
 	struct page *page = NULL;
+	bool file;
 
 	assert_spin_locked(&mm->page_table_lock);
 
@@ -973,7 +1125,8 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		goto out;
 
 	page = pmd_page(*pmd);
-	VM_BUG_ON(!PageHead(page));
+	file = !PageAnon(page);
+	VM_BUG_ON(!file && !PageHead(page));
 	if (flags & FOLL_TOUCH) {
 		pmd_t _pmd;
 		/*
@@ -983,12 +1136,17 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		 * we'll only set it with FOLL_WRITE, an atomic
 		 * set_bit will be required on the pmd to set the
 		 * young bit, instead of the current set_pmd_at.
+		 *
+		 * The dirty bit of a pmd mapping page cache is
+		 * meaningful: zap_huge_pmd() dirties the pages.
 		 */
-		_pmd = pmd_mkyoung(pmd_mkdirty(*pmd));
+		_pmd = pmd_mkyoung(*pmd);
+		if (!file || (flags & FOLL_WRITE))
+			_pmd = pmd_mkdirty(_pmd);
 		set_pmd_at(mm, addr & HPAGE_PMD_MASK, pmd, _pmd);
 	}
 	page += (addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
-	VM_BUG_ON(!PageCompound(page));
+	VM_BUG_ON(!file && !PageCompound(page));
 	if (flags & FOLL_GET)
 		get_page_foll(page);
 
@@ -996,6 +1154,34 @@ out:
 	return page;
 }
 
+/*
+ * Unmap the HPAGE_PMD_NR page cache pages mapped by @pmd, passing their
+ * dirty and young bits on like zap_pte_range() does.
+ */
+static void zap_file_huge_pmd(struct mmu_gather *tlb,
+			      struct vm_area_struct *vma, pmd_t *pmd,
+			      struct page *page, pgtable_t pgtable)
+	__releases(&tlb->mm->page_table_lock)
+{
+	pmd_t orig_pmd = *pmd;
+	int i;
+
+	pmd_clear(pmd);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (pmd_dirty(orig_pmd))
+			set_page_dirty(page + i);
+		if (pmd_young(orig_pmd) &&
+		    likely(!VM_SequentialReadHint(vma)))
+			mark_page_accessed(page + i);
+		page_remove_rmap(page + i);
+	}
+	add_mm_counter(tlb->mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+	spin_unlock(&tlb->mm->page_table_lock);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		tlb_remove_page(tlb, page + i);
+	pte_free(tlb->mm, pgtable);
+}
+
 int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 		 pmd_t *pmd)
 {
@@ -1012,6 +1198,10 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 			pgtable_t pgtable;
 			pgtable = get_pmd_huge_pte(tlb->mm);
 			page = pmd_page(*pmd);
+			if (!PageAnon(page)) {
+				zap_file_huge_pmd(tlb, vma, pmd, page, pgtable);
+				return 1;
+			}
 			pmd_clear(pmd);
 			page_remove_rmap(page);
 			VM_BUG_ON(page_mapcount(page) < 0);
@@ -1063,10 +1253,14 @@ int move_huge_pmd(struct vm_area_struct *vma, struct vm_area_struct *new_vma,
 
 	struct mm_struct *mm = vma->vm_mm;
 
+	/*
+	 * Page cache must be moved under the i_mmap_mutex to keep
+	 * truncation out, as move_ptes() does: split it instead.
+	 */
 	if ((old_addr & ~HPAGE_PMD_MASK) ||
 	    (new_addr & ~HPAGE_PMD_MASK) ||
 	    old_end - old_addr < HPAGE_PMD_SIZE ||
-	    (new_vma->vm_flags & VM_NOHUGEPAGE))
+	    (new_vma->vm_flags & VM_NOHUGEPAGE) || vma->vm_ops)
 		goto out;
 
 	/*
@@ -1098,8 +1292,12 @@ out:
 	return ret;
 }
 
+/*
+ * Returns 0 if @pmd is no longer huge, HPAGE_PMD_NR if its protection was
+ * changed, and 1 if NUMA hinting left it alone: see change_pte_range().
+ */
 int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
-		unsigned long addr, pgprot_t newprot)
+		unsigned long addr, pgprot_t newprot, int prot_numa)
 {
 	struct mm_struct *mm = vma->vm_mm;
 	int ret = 0;
@@ -1109,6 +1307,11 @@ int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 		if (unlikely(pmd_trans_splitting(*pmd))) {
 			spin_unlock(&mm->page_table_lock);
 			wait_split_huge_page(vma->anon_vma, pmd);
+		} else if (prot_numa &&
+			   (page_mapcount(pmd_page(*pmd)) != 1 ||
+			    pmd_same(*pmd, pmd_modify(*pmd, newprot)))) {
+			spin_unlock(&mm->page_table_lock);
+			ret = 1;
 		} else {
 			pmd_t entry;
 
@@ -1117,7 +1320,7 @@ int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 			set_pmd_at(mm, addr, pmd, entry);
 			spin_unlock(&vma->vm_mm->page_table_lock);
 			flush_tlb_range(vma, addr, addr + HPAGE_PMD_SIZE);
-			ret = 1;
+			ret = HPAGE_PMD_NR;
 		}
 	} else
 		spin_unlock(&vma->vm_mm->page_table_lock);
@@ -1134,9 +1337,6 @@ pmd_t *page_check_address_pmd(struct page *page,
 	pud_t *pud;
 	pmd_t *pmd, *ret = NULL;
 
-	if (address & ~HPAGE_PMD_MASK)
-		goto out;
-
 	pgd = pgd_offset(mm, address);
 	if (!pgd_present(*pgd))
 		goto out;
@@ -1148,7 +1348,12 @@ pmd_t *page_check_address_pmd(struct page *page,
 	pmd = pmd_offset(pud, address);
 	if (pmd_none(*pmd))
 		goto out;
-	if (pmd_page(*pmd) != page)
+	/*
+	 * An anonymous huge page is mapped at an aligned @address, page
+	 * cache pages anywhere within the huge pmd mapping their block.
+	 */
+	if (pmd_page(*pmd) + ((address & ~HPAGE_PMD_MASK) >> PAGE_SHIFT) !=
+	    page)
 		goto out;
 	/*
 	 * split_vma() may create temporary aliased mappings. There is
@@ -1475,28 +1680,39 @@ out:
 int hugepage_madvise(struct vm_area_struct *vma,
 		     unsigned long *vm_flags, int advice)
 {
+	unsigned long no_thp = VM_NO_THP;
+
+	/* shared shmem mappings follow the advice in shmem_huge_enabled() */
+	if (vma->vm_file && shmem_mapping(vma->vm_file->f_mapping))
+		no_thp &= ~(VM_SHARED | VM_MAYSHARE);
+
 	switch (advice) {
 	case MADV_HUGEPAGE:
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_HUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_HUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_NOHUGEPAGE;
 		*vm_flags |= VM_HUGEPAGE;
 		/*
 		 * If the vma become good for khugepaged to scan,
 		 * register it here without waiting a page fault that
-		 * may not happen any time soon.
+		 * may not happen any time soon.  The shmem policy
+		 * cannot see the new flags yet: khugepaged checks it.
 		 */
-		if (unlikely(khugepaged_enter_vma_merge(vma)))
+		if (no_thp != VM_NO_THP) {
+			if (!test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags) &&
+			    unlikely(__khugepaged_enter(vma->vm_mm)))
+				return -ENOMEM;
+		} else if (unlikely(khugepaged_enter_vma_merge(vma)))
 			return -ENOMEM;
 		break;
 	case MADV_NOHUGEPAGE:
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_NOHUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_NOHUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_HUGEPAGE;
 		*vm_flags |= VM_NOHUGEPAGE;
@@ -1624,6 +1840,12 @@ int __khugepaged_enter(struct mm_struct *mm)
 int khugepaged_enter_vma_merge(struct vm_area_struct *vma)
 {
 	unsigned long hstart, hend;
+	if (vma->vm_file && shmem_mapping(vma->vm_file->f_mapping)) {
+		if (shmem_huge_enabled(vma) &&
+		    !test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags))
+			return __khugepaged_enter(vma->vm_mm);
+		return 0;
+	}
 	if (!vma->anon_vma)
 		/*
 		 * Not yet faulted in so we will register later in the
@@ -1728,13 +1950,17 @@ static int __collapse_huge_page_isolate(struct vm_area_struct *vma,
 		}
 		VM_BUG_ON(PageCompound(page));
 		BUG_ON(!PageAnon(page));
-		VM_BUG_ON(!PageSwapBacked(page));
 
 		/* cannot use mapcount: can't collapse if there's a gup pin */
 		if (page_count(page) != 1) {
 			release_pte_pages(pte, _pte);
 			goto out;
 		}
+		/* nor worth it for pages MADV_FREE gave up */
+		if (!PageSwapBacked(page)) {
+			release_pte_pages(pte, _pte);
+			goto out;
+		}
 		/*
 		 * We can do it before isolate_lru_page because the
 		 * page can't be freed from under us. NOTE: PG_lock
@@ -1911,6 +2137,8 @@ static void collapse_huge_page(struct mm_struct *mm,
 		goto out;
 
 	anon_vma_lock(vma->anon_vma);
+	/* and speculative page faults out of the page table */
+	vm_write_begin(vma);
 
 	pte = pte_offset_map(pmd, address);
 	ptl = pte_lockptr(mm, pmd);
@@ -1935,6 +2163,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 		BUG_ON(!pmd_none(*pmd));
 		set_pmd_at(mm, address, pmd, _pmd);
 		spin_unlock(&mm->page_table_lock);
+		vm_write_end(vma);
 		anon_vma_unlock(vma->anon_vma);
 		goto out;
 	}
@@ -1971,6 +2200,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	prepare_pmd_huge_pte(pgtable, mm);
 	mm->nr_ptes--;
 	spin_unlock(&mm->page_table_lock);
+	vm_write_end(vma);
 
 #ifndef CONFIG_NUMA
 	*hpage = NULL;
@@ -2040,7 +2270,8 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 		if (node == -1)
 			node = page_to_nid(page);
 		VM_BUG_ON(PageCompound(page));
-		if (!PageLRU(page) || PageLocked(page) || !PageAnon(page))
+		if (!PageLRU(page) || PageLocked(page) || !PageAnon(page) ||
+		    !PageSwapBacked(page))
 			goto out_unmap;
 		/* cannot use mapcount: can't collapse if there's a gup pin */
 		if (page_count(page) != 1)
@@ -2083,6 +2314,91 @@ static void collect_mm_slot(struct mm_slot *mm_slot)
 	}
 }
 
+/*
+ * The page table that maps @pgoff of @mapping at @address in @mm, in a
+ * shared vma (stored in @vmap) that the whole huge pmd would fit in, or
+ * NULL if there is nothing for khugepaged_scan_file() to free there.
+ * Called with the mmap_sem held, for reading or for writing.
+ */
+static pmd_t *khugepaged_file_pmd(struct mm_struct *mm,
+				  struct address_space *mapping,
+				  unsigned long address, pgoff_t pgoff,
+				  struct vm_area_struct **vmap)
+{
+	struct vm_area_struct *vma;
+	pmd_t *pmd;
+
+	if (unlikely(khugepaged_test_exit(mm)))
+		return NULL;
+	vma = find_vma(mm, address);
+	if (!vma || vma->vm_start > address ||
+	    vma->vm_end < address + HPAGE_PMD_SIZE ||
+	    !vma->vm_file || vma->vm_file->f_mapping != mapping ||
+	    !(vma->vm_flags & VM_SHARED) ||
+	    (vma->vm_flags & (VM_NONLINEAR | VM_LOCKED)) ||
+	    linear_page_index(vma, address) != pgoff)
+		return NULL;
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || !pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return NULL;
+	*vmap = vma;
+	return pmd;
+}
+
+/*
+ * Collapse the shmem page cache at @pgoff into a contiguous block if it is
+ * not one already, then free the page table mapping it at @address in @mm,
+ * for the next fault to map it with a huge pmd.  Other mms get theirs
+ * freed when khugepaged scans them.  Called without the mmap_sem.
+ */
+static void khugepaged_scan_file(struct mm_struct *mm, struct file *file,
+				 unsigned long address, pgoff_t pgoff)
+{
+	struct address_space *mapping = file->f_mapping;
+	struct vm_area_struct *vma;
+	pmd_t *pmd, _pmd;
+	int ret;
+
+	ret = shmem_collapse_huge(mapping->host, pgoff, mm,
+				  khugepaged_max_ptes_none);
+	if (ret < 0)
+		return;
+	if (ret > 0)
+		khugepaged_pages_collapsed++;
+
+	/*
+	 * Most ranges scanned are mapped by a huge pmd already, or not at
+	 * all: find out with the mmap_sem for reading, and only take it for
+	 * writing when there is a page table to free, checking again then.
+	 */
+	down_read(&mm->mmap_sem);
+	pmd = khugepaged_file_pmd(mm, mapping, address, pgoff, &vma);
+	up_read(&mm->mmap_sem);
+	if (!pmd)
+		return;
+
+	down_write(&mm->mmap_sem);
+	pmd = khugepaged_file_pmd(mm, mapping, address, pgoff, &vma);
+	if (!pmd)
+		goto out;
+
+	/*
+	 * The ptes only map page cache, which can simply be faulted in
+	 * again: zap them, keeping truncation and rmap walkers out until
+	 * the page table is gone.  gup_fast is kept out by the TLB flush.
+	 */
+	mutex_lock(&mapping->i_mmap_mutex);
+	zap_page_range(vma, address, HPAGE_PMD_SIZE, NULL);
+	spin_lock(&mm->page_table_lock);
+	_pmd = pmdp_clear_flush(vma, address, pmd);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+	mutex_unlock(&mapping->i_mmap_mutex);
+	pte_free(mm, pmd_pgtable(_pmd));
+out:
+	up_write(&mm->mmap_sem);
+}
+
 static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 					    struct page **hpage)
 	__releases(&khugepaged_mm_lock)
@@ -2116,6 +2432,7 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 	progress++;
 	for (; vma; vma = vma->vm_next) {
 		unsigned long hstart, hend;
+		bool shmem;
 
 		cond_resched();
 		if (unlikely(khugepaged_test_exit(mm))) {
@@ -2123,14 +2440,21 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			break;
 		}
 
-		if ((!(vma->vm_flags & VM_HUGEPAGE) &&
+		shmem = vma->vm_file && shmem_mapping(vma->vm_file->f_mapping);
+		if (shmem ? !shmem_huge_enabled(vma) :
+		    (!(vma->vm_flags & VM_HUGEPAGE) &&
 		     !khugepaged_always()) ||
 		    (vma->vm_flags & VM_NOHUGEPAGE)) {
 		skip:
 			progress++;
 			continue;
 		}
-		if (!vma->anon_vma || vma->vm_ops)
+		if (shmem) {
+			/* page cache offsets must line up with huge pmds */
+			if (((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff) &
+			    (HPAGE_PMD_NR - 1))
+				goto skip;
+		} else if (!vma->anon_vma || vma->vm_ops)
 			goto skip;
 		if (is_vma_temporary_stack(vma))
 			goto skip;
@@ -2138,8 +2462,8 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 		 * If is_pfn_mapping() is true is_learn_pfn_mapping()
 		 * must be true too, verify it here.
 		 */
-		VM_BUG_ON(is_linear_pfn_mapping(vma) ||
-			  vma->vm_flags & VM_NO_THP);
+		VM_BUG_ON(!shmem && (is_linear_pfn_mapping(vma) ||
+				     vma->vm_flags & VM_NO_THP));
 
 		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 		hend = vma->vm_end & HPAGE_PMD_MASK;
@@ -2160,9 +2484,22 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
-						  hpage);
+			if (shmem) {
+				struct file *file = vma->vm_file;
+				pgoff_t pgoff = linear_page_index(vma,
+						khugepaged_scan.address);
+
+				get_file(file);
+				up_read(&mm->mmap_sem);
+				khugepaged_scan_file(mm, file,
+						     khugepaged_scan.address,
+						     pgoff);
+				fput(file);
+				ret = 1;
+			} else
+				ret = khugepaged_scan_pmd(mm, vma,
+							  khugepaged_scan.address,
+							  hpage);
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
@@ -2355,8 +2692,98 @@ static int khugepaged(void *none)
 	return 0;
 }
 
+/*
+ * Replace the huge pmd mapping a block of page cache at @haddr by a page
+ * table mapping the same pages, so that they can be unmapped, reclaimed
+ * and migrated one by one.  Unlike an anonymous huge page, the pages are
+ * no compound page and need no splitting themselves.  Called with the
+ * page_table_lock held.
+ */
+static void __split_file_huge_pmd(struct vm_area_struct *vma,
+				  unsigned long haddr, pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page = pmd_page(*pmd);
+	unsigned long address;
+	pgtable_t pgtable;
+	pmd_t _pmd;
+	int i;
+
+	pgtable = get_pmd_huge_pte(mm);
+	pmd_populate(mm, &_pmd, pgtable);
+
+	for (i = 0, address = haddr; i < HPAGE_PMD_NR;
+	     i++, address += PAGE_SIZE) {
+		pte_t *pte, entry;
+		entry = mk_pte(page + i, vma->vm_page_prot);
+		if (!pmd_write(*pmd))
+			entry = pte_wrprotect(entry);
+		if (pmd_dirty(*pmd))
+			entry = pte_mkdirty(entry);
+		if (!pmd_young(*pmd))
+			entry = pte_mkold(entry);
+		pte = pte_offset_map(&_pmd, address);
+		BUG_ON(!pte_none(*pte));
+		set_pte_at(mm, address, pte, entry);
+		pte_unmap(pte);
+	}
+
+	mm->nr_ptes++;
+	smp_wmb(); /* make pte visible before pmd */
+	/* never both huge and small TLB entries, see __split_huge_page_map() */
+	set_pmd_at(mm, haddr, pmd, pmd_mknotpresent(*pmd));
+	flush_tlb_range(vma, haddr, haddr + HPAGE_PMD_SIZE);
+	pmd_populate(mm, pmd, pgtable);
+}
+
+void __split_huge_pmd(struct vm_area_struct *vma, unsigned long address,
+		      pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		return;
+	}
+	if (PageAnon(pmd_page(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		__split_huge_page_pmd(mm, pmd);
+		return;
+	}
+	__split_file_huge_pmd(vma, address & HPAGE_PMD_MASK, pmd);
+	spin_unlock(&mm->page_table_lock);
+}
+
+/*
+ * Split a huge pmd mapping page cache when the caller does not know its
+ * vma: look it up through the rmap of the first page mapped.
+ */
+static void split_file_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd,
+				     struct address_space *mapping,
+				     struct page *page)
+{
+	struct vm_area_struct *vma;
+	struct prio_tree_iter iter;
+	pgoff_t pgoff = page->index;
+
+	mutex_lock(&mapping->i_mmap_mutex);
+	vma_prio_tree_foreach(vma, &iter, &mapping->i_mmap, pgoff, pgoff) {
+		unsigned long address;
+
+		if (vma->vm_mm != mm)
+			continue;
+		address = vma_address(page, vma);
+		if (address == -EFAULT || mm_find_pmd(mm, address) != pmd)
+			continue;
+		split_huge_pmd(vma, address, pmd);
+	}
+	mutex_unlock(&mapping->i_mmap_mutex);
+}
+
 void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 {
+	struct address_space *mapping = NULL;
 	struct page *page;
 
 	spin_lock(&mm->page_table_lock);
@@ -2367,39 +2794,52 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 	page = pmd_page(*pmd);
 	VM_BUG_ON(!page_count(page));
 	get_page(page);
+	if (!PageAnon(page))
+		mapping = page->mapping;
 	spin_unlock(&mm->page_table_lock);
 
+	if (mapping) {
+		split_file_huge_page_pmd(mm, pmd, mapping, page);
+		put_page(page);
+		return;
+	}
+
 	split_huge_page(page);
 
 	put_page(page);
 	BUG_ON(pmd_trans_huge(*pmd));
 }
 
-static void split_huge_page_address(struct mm_struct *mm,
-				    unsigned long address)
+void split_huge_page_address(struct vm_area_struct *vma,
+			     unsigned long address)
 {
-	pgd_t *pgd;
-	pud_t *pud;
 	pmd_t *pmd;
 
-	VM_BUG_ON(!(address & ~HPAGE_PMD_MASK));
-
-	pgd = pgd_offset(mm, address);
-	if (!pgd_present(*pgd))
-		return;
-
-	pud = pud_offset(pgd, address);
-	if (!pud_present(*pud))
-		return;
-
-	pmd = pmd_offset(pud, address);
-	if (!pmd_present(*pmd))
+	pmd = mm_find_pmd(vma->vm_mm, address);
+	if (!pmd || !pmd_present(*pmd))
 		return;
 	/*
-	 * Caller holds the mmap_sem write mode, so a huge pmd cannot
-	 * materialize from under us.
+	 * With the mmap_sem held in write mode, a huge pmd cannot
+	 * materialize from under us.  rmap walkers splitting page
+	 * cache mappings only hold the i_mmap_mutex: they recheck.
 	 */
-	split_huge_page_pmd(mm, pmd);
+	split_huge_pmd(vma, address, pmd);
+}
+
+/*
+ * Whether @page, if page cache, may be mapped at @address by a huge pmd
+ * instead of a pte: a hint for rmap walkers, who recheck under the
+ * page_table_lock.
+ */
+int page_file_pmd_mapped(struct page *page, struct mm_struct *mm,
+			 unsigned long address)
+{
+	pmd_t *pmd;
+
+	if (PageAnon(page) || !PageSwapBacked(page))
+		return 0;
+	pmd = mm_find_pmd(mm, address);
+	return pmd && pmd_trans_huge(*pmd);
 }
 
 void __vma_adjust_trans_huge(struct vm_area_struct *vma,
@@ -2415,7 +2855,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (start & ~HPAGE_PMD_MASK &&
 	    (start & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (start & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, start);
+		split_huge_page_address(vma, start);
 
 	/*
 	 * If the new end address isn't hpage aligned and it could
@@ -2425,7 +2865,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (end & ~HPAGE_PMD_MASK &&
 	    (end & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (end & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, end);
+		split_huge_page_address(vma, end);
 
 	/*
 	 * If we're also updating the vma->vm_next->vm_start, if the new
@@ -2439,6 +2879,6 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 		if (nstart & ~HPAGE_PMD_MASK &&
 		    (nstart & HPAGE_PMD_MASK) >= next->vm_start &&
 		    (nstart & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= next->vm_end)
-			split_huge_page_address(next->vm_mm, nstart);
+			split_huge_page_address(next, nstart);
 	}
 }
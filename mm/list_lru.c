@@ -0,0 +1,534 @@
+/*
+ * Generic LRU infrastructure
+ *
+ * Every node has its own lists and lock, so that reclaim on one node
+ * neither scans nor contends with the objects cached on the others.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/math64.h>
+#include <linux/memcontrol.h>
+#include <linux/shrinker.h>
+#include <linux/list_lru.h>
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+/*
+ * The memcg aware lists, so that memcgs coming and going can add and
+ * remove their lists.  list_lrus_mutex also serializes the growth of
+ * the memcg_lrus arrays, which are only read under the node lock.
+ */
+static LIST_HEAD(list_lrus);
+static DEFINE_MUTEX(list_lrus_mutex);
+/* one more than the highest kmemcg_id seen by memcg_list_lrus_online */
+static int memcg_nr_lru_ids;
+
+static inline bool list_lru_memcg_aware(struct list_lru *lru)
+{
+	return lru->memcg_aware;
+}
+
+/* The kmemcg_id of the memcg @item is charged to, or -1 */
+static int list_lru_item_memcg_id(const void *item)
+{
+	struct page *page;
+	struct kmem_cache *s;
+
+	if (!memcg_kmem_enabled())
+		return -1;
+	page = virt_to_head_page(item);
+	if (!PageSlab(page))
+		return -1;
+	s = page->slab;
+	if (!s->memcg_params)
+		return -1;
+	return memcg_cache_id(s->memcg_params->memcg);
+}
+
+static inline struct list_lru_one *
+list_lru_from_memcg_id(struct list_lru_node *nlru, int memcg_id)
+{
+	struct list_lru_one *l = NULL;
+
+	if (memcg_id >= 0 && memcg_id < nlru->nr_memcg_lrus)
+		l = nlru->memcg_lrus[memcg_id];
+	return l ? l : &nlru->lru;
+}
+
+/* Lists of dead memcgs are walked as part of the ancestor's list */
+static inline bool list_lru_owns(struct list_lru_one *l, int memcg_id)
+{
+	return l->memcg_id == memcg_id;
+}
+#else
+static inline bool list_lru_memcg_aware(struct list_lru *lru)
+{
+	return false;
+}
+
+static inline int list_lru_item_memcg_id(const void *item)
+{
+	return -1;
+}
+
+static inline struct list_lru_one *
+list_lru_from_memcg_id(struct list_lru_node *nlru, int memcg_id)
+{
+	return &nlru->lru;
+}
+
+static inline bool list_lru_owns(struct list_lru_one *l, int memcg_id)
+{
+	return true;
+}
+#endif /* CONFIG_CGROUP_MEM_RES_CTLR_KMEM */
+
+static inline struct list_lru_one *
+list_lru_from_item(struct list_lru *lru, struct list_lru_node *nlru,
+		   struct list_head *item)
+{
+	int memcg_id = -1;
+
+	if (list_lru_memcg_aware(lru))
+		memcg_id = list_lru_item_memcg_id(item);
+	return list_lru_from_memcg_id(nlru, memcg_id);
+}
+
+bool list_lru_add(struct list_lru *lru, struct list_head *item)
+{
+	int nid = page_to_nid(virt_to_page(item));
+	struct list_lru_node *nlru = &lru->node[nid];
+	struct list_lru_one *l;
+
+	spin_lock(&nlru->lock);
+	if (list_empty(item)) {
+		l = list_lru_from_item(lru, nlru, item);
+		list_add_tail(item, &l->list);
+		l->nr_items++;
+		if (nlru->nr_items++ == 0)
+			node_set(nid, lru->active_nodes);
+		spin_unlock(&nlru->lock);
+		return true;
+	}
+	spin_unlock(&nlru->lock);
+	return false;
+}
+EXPORT_SYMBOL_GPL(list_lru_add);
+
+bool list_lru_del(struct list_lru *lru, struct list_head *item)
+{
+	int nid = page_to_nid(virt_to_page(item));
+	struct list_lru_node *nlru = &lru->node[nid];
+	struct list_lru_one *l;
+
+	spin_lock(&nlru->lock);
+	if (!list_empty(item)) {
+		l = list_lru_from_item(lru, nlru, item);
+		list_del_init(item);
+		l->nr_items--;
+		if (--nlru->nr_items == 0)
+			node_clear(nid, lru->active_nodes);
+		WARN_ON_ONCE(l->nr_items < 0);
+		spin_unlock(&nlru->lock);
+		return true;
+	}
+	spin_unlock(&nlru->lock);
+	return false;
+}
+EXPORT_SYMBOL_GPL(list_lru_del);
+
+/* The items on the list of @memcg_id itself, -1 for the node's own list */
+static unsigned long __list_lru_count_one(struct list_lru_node *nlru,
+					  int memcg_id)
+{
+	struct list_lru_one *l;
+	long count = 0;
+
+	spin_lock(&nlru->lock);
+	l = list_lru_from_memcg_id(nlru, memcg_id);
+	if (list_lru_owns(l, memcg_id))
+		count = l->nr_items;
+	spin_unlock(&nlru->lock);
+
+	return count > 0 ? count : 0;
+}
+
+unsigned long list_lru_count_one(struct list_lru *lru, int nid,
+				 struct mem_cgroup *memcg)
+{
+	struct list_lru_node *nlru = &lru->node[nid];
+	long count;
+
+	if (memcg && list_lru_memcg_aware(lru))
+		return __list_lru_count_one(nlru, memcg_cache_id(memcg));
+
+	spin_lock(&nlru->lock);
+	count = nlru->nr_items;
+	spin_unlock(&nlru->lock);
+
+	return count > 0 ? count : 0;
+}
+EXPORT_SYMBOL_GPL(list_lru_count_one);
+
+unsigned long list_lru_shrink_count(struct list_lru *lru,
+				    struct shrink_control *sc)
+{
+	return list_lru_count_one(lru, sc->nid, sc->memcg);
+}
+EXPORT_SYMBOL_GPL(list_lru_shrink_count);
+
+static unsigned long
+__list_lru_walk_one(struct list_lru *lru, int nid, int memcg_id,
+		    list_lru_walk_cb isolate, void *cb_arg,
+		    unsigned long *nr_to_walk)
+{
+	struct list_lru_node *nlru = &lru->node[nid];
+	struct list_lru_one *l;
+	struct list_head *item, *n;
+	unsigned long isolated = 0;
+
+	spin_lock(&nlru->lock);
+restart:
+	/* the list may have been handed to an ancestor while unlocked */
+	l = list_lru_from_memcg_id(nlru, memcg_id);
+	if (!list_lru_owns(l, memcg_id))
+		goto out;
+
+	list_for_each_safe(item, n, &l->list) {
+		enum lru_status ret;
+
+		/*
+		 * decrement nr_to_walk first so that we don't livelock if we
+		 * get stuck on large numbers of LRU_RETRY items
+		 */
+		if (!*nr_to_walk)
+			break;
+		--*nr_to_walk;
+
+		ret = isolate(item, &nlru->lock, cb_arg);
+		switch (ret) {
+		case LRU_REMOVED:
+			l->nr_items--;
+			if (--nlru->nr_items == 0)
+				node_clear(nid, lru->active_nodes);
+			WARN_ON_ONCE(l->nr_items < 0);
+			isolated++;
+			break;
+		case LRU_ROTATE:
+			list_move_tail(item, &l->list);
+			break;
+		case LRU_SKIP:
+			break;
+		case LRU_RETRY:
+			/*
+			 * The lru lock has been dropped, our list traversal is
+			 * now invalid and so we have to restart from scratch.
+			 */
+			goto restart;
+		default:
+			BUG();
+		}
+	}
+out:
+	spin_unlock(&nlru->lock);
+	return isolated;
+}
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+/*
+ * Walk all lists on a node, giving each a share of @nr_to_walk in
+ * proportion to its size, so that global reclaim ages the objects of
+ * all memcgs alike.
+ */
+static unsigned long
+list_lru_walk_node_memcg(struct list_lru *lru, int nid,
+			 list_lru_walk_cb isolate, void *cb_arg,
+			 unsigned long *nr_to_walk)
+{
+	struct list_lru_node *nlru = &lru->node[nid];
+	unsigned long isolated = 0;
+	unsigned long budget = *nr_to_walk;
+	unsigned long total, count, share;
+	int memcg_id;
+
+	total = list_lru_count_node(lru, nid);
+	if (!total)
+		return 0;
+
+	for (memcg_id = -1; memcg_id < nlru->nr_memcg_lrus; memcg_id++) {
+		if (!*nr_to_walk)
+			break;
+		count = __list_lru_count_one(nlru, memcg_id);
+		if (!count)
+			continue;
+		if (budget >= total)
+			share = count;
+		else
+			share = div64_u64((u64)budget * count + total - 1,
+					  total);
+		share = min(share, *nr_to_walk);
+		*nr_to_walk -= share;
+		isolated += __list_lru_walk_one(lru, nid, memcg_id, isolate,
+						cb_arg, &share);
+		/* give back what was not walked */
+		*nr_to_walk += share;
+	}
+	return isolated;
+}
+#endif
+
+unsigned long list_lru_walk_one(struct list_lru *lru, int nid,
+				struct mem_cgroup *memcg,
+				list_lru_walk_cb isolate, void *cb_arg,
+				unsigned long *nr_to_walk)
+{
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	if (list_lru_memcg_aware(lru)) {
+		if (memcg)
+			return __list_lru_walk_one(lru, nid,
+						   memcg_cache_id(memcg),
+						   isolate, cb_arg, nr_to_walk);
+		return list_lru_walk_node_memcg(lru, nid, isolate, cb_arg,
+						nr_to_walk);
+	}
+#endif
+	return __list_lru_walk_one(lru, nid, -1, isolate, cb_arg, nr_to_walk);
+}
+EXPORT_SYMBOL_GPL(list_lru_walk_one);
+
+unsigned long list_lru_shrink_walk(struct list_lru *lru,
+				   struct shrink_control *sc,
+				   list_lru_walk_cb isolate, void *cb_arg)
+{
+	return list_lru_walk_one(lru, sc->nid, sc->memcg, isolate, cb_arg,
+				 &sc->nr_to_scan);
+}
+EXPORT_SYMBOL_GPL(list_lru_shrink_walk);
+
+static void init_one_lru(struct list_lru_one *l, int memcg_id)
+{
+	INIT_LIST_HEAD(&l->list);
+	l->nr_items = 0;
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	l->memcg_id = memcg_id;
+#endif
+}
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+/* Make room for the lists of memcgs with ids below @nr */
+static int memcg_grow_lru_node(struct list_lru_node *nlru, int nr)
+{
+	struct list_lru_one **old, **new;
+	int size;
+
+	if (nr <= nlru->nr_memcg_lrus)
+		return 0;
+
+	size = max(nr, 2 * nlru->nr_memcg_lrus);
+	new = kcalloc(size, sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+
+	spin_lock(&nlru->lock);
+	old = nlru->memcg_lrus;
+	if (old)
+		memcpy(new, old, nlru->nr_memcg_lrus * sizeof(*new));
+	nlru->memcg_lrus = new;
+	nlru->nr_memcg_lrus = size;
+	spin_unlock(&nlru->lock);
+
+	kfree(old);
+	return 0;
+}
+
+static int memcg_init_list_lru(struct list_lru *lru, int memcg_id)
+{
+	struct list_lru_node *nlru;
+	struct list_lru_one *l;
+	int i;
+
+	for (i = 0; i < nr_node_ids; i++) {
+		nlru = &lru->node[i];
+		if (memcg_grow_lru_node(nlru, memcg_id + 1))
+			return -ENOMEM;
+
+		l = nlru->memcg_lrus[memcg_id];
+		if (l && list_lru_owns(l, memcg_id))
+			continue;
+		l = kmalloc(sizeof(*l), GFP_KERNEL);
+		if (!l)
+			return -ENOMEM;
+		init_one_lru(l, memcg_id);
+
+		spin_lock(&nlru->lock);
+		nlru->memcg_lrus[memcg_id] = l;
+		spin_unlock(&nlru->lock);
+	}
+	return 0;
+}
+
+/**
+ * memcg_list_lrus_online - add the lists of a new memcg
+ * @memcg_id: the kmemcg_id of the memcg
+ *
+ * Must be called before any object is charged to the memcg.
+ */
+int memcg_list_lrus_online(int memcg_id)
+{
+	struct list_lru *lru;
+	int ret = 0;
+
+	mutex_lock(&list_lrus_mutex);
+	list_for_each_entry(lru, &list_lrus, list) {
+		ret = memcg_init_list_lru(lru, memcg_id);
+		if (ret)
+			break;
+	}
+	if (!ret && memcg_id >= memcg_nr_lru_ids)
+		memcg_nr_lru_ids = memcg_id + 1;
+	mutex_unlock(&list_lrus_mutex);
+
+	return ret;
+}
+
+static void memcg_drain_list_lru_node(struct list_lru_node *nlru,
+				      int memcg_id, int parent_id)
+{
+	struct list_lru_one *src, *dst;
+	int i;
+
+	spin_lock(&nlru->lock);
+	src = list_lru_from_memcg_id(nlru, memcg_id);
+	if (!list_lru_owns(src, memcg_id)) {
+		spin_unlock(&nlru->lock);
+		return;
+	}
+	dst = list_lru_from_memcg_id(nlru, parent_id);
+
+	list_splice_tail_init(&src->list, &dst->list);
+	dst->nr_items += src->nr_items;
+	/* the objects of @memcg_id and its dead descendants now go to @dst */
+	for (i = 0; i < nlru->nr_memcg_lrus; i++)
+		if (nlru->memcg_lrus[i] == src)
+			nlru->memcg_lrus[i] = dst;
+	spin_unlock(&nlru->lock);
+
+	kfree(src);
+}
+
+/**
+ * memcg_list_lrus_offline - hand the objects of a dying memcg to its parent
+ * @memcg_id: the kmemcg_id of the dying memcg
+ * @parent_id: the kmemcg_id of the memcg that inherits its charges, or -1
+ *
+ * Objects still charged to the memcg stay on the lists of @parent_id,
+ * where they are found by reclaim of the parent.
+ */
+void memcg_list_lrus_offline(int memcg_id, int parent_id)
+{
+	struct list_lru *lru;
+	int i;
+
+	mutex_lock(&list_lrus_mutex);
+	list_for_each_entry(lru, &list_lrus, list)
+		for (i = 0; i < nr_node_ids; i++)
+			memcg_drain_list_lru_node(&lru->node[i], memcg_id,
+						  parent_id);
+	mutex_unlock(&list_lrus_mutex);
+}
+
+static void memcg_destroy_list_lru(struct list_lru *lru)
+{
+	struct list_lru_node *nlru;
+	int i, j;
+
+	for (i = 0; i < nr_node_ids; i++) {
+		nlru = &lru->node[i];
+		for (j = 0; j < nlru->nr_memcg_lrus; j++)
+			if (nlru->memcg_lrus[j] &&
+			    list_lru_owns(nlru->memcg_lrus[j], j))
+				kfree(nlru->memcg_lrus[j]);
+		kfree(nlru->memcg_lrus);
+	}
+}
+
+static int memcg_register_list_lru(struct list_lru *lru, bool memcg_aware)
+{
+	int i, ret = 0;
+
+	lru->memcg_aware = memcg_aware;
+	if (!memcg_aware)
+		return 0;
+
+	mutex_lock(&list_lrus_mutex);
+	for (i = 0; i < memcg_nr_lru_ids; i++) {
+		ret = memcg_init_list_lru(lru, i);
+		if (ret)
+			break;
+	}
+	if (ret)
+		memcg_destroy_list_lru(lru);
+	else
+		list_add(&lru->list, &list_lrus);
+	mutex_unlock(&list_lrus_mutex);
+
+	return ret;
+}
+
+static void memcg_unregister_list_lru(struct list_lru *lru)
+{
+	if (!lru->memcg_aware)
+		return;
+
+	mutex_lock(&list_lrus_mutex);
+	list_del(&lru->list);
+	memcg_destroy_list_lru(lru);
+	mutex_unlock(&list_lrus_mutex);
+}
+#else
+static int memcg_register_list_lru(struct list_lru *lru, bool memcg_aware)
+{
+	return 0;
+}
+
+static void memcg_unregister_list_lru(struct list_lru *lru)
+{
+}
+#endif /* CONFIG_CGROUP_MEM_RES_CTLR_KMEM */
+
+int __list_lru_init(struct list_lru *lru, bool memcg_aware)
+{
+	int i;
+
+	lru->node = kcalloc(nr_node_ids, sizeof(*lru->node), GFP_KERNEL);
+	if (!lru->node)
+		return -ENOMEM;
+
+	nodes_clear(lru->active_nodes);
+	for (i = 0; i < nr_node_ids; i++) {
+		spin_lock_init(&lru->node[i].lock);
+		init_one_lru(&lru->node[i].lru, -1);
+	}
+
+	if (memcg_register_list_lru(lru, memcg_aware)) {
+		kfree(lru->node);
+		lru->node = NULL;
+		return -ENOMEM;
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__list_lru_init);
+
+void list_lru_destroy(struct list_lru *lru)
+{
+	/* Already destroyed or not yet initialized? */
+	if (!lru->node)
+		return;
+
+	memcg_unregister_list_lru(lru);
+	kfree(lru->node);
+	lru->node = NULL;
+}
+EXPORT_SYMBOL_GPL(list_lru_destroy);
@@ -49,6 +49,9 @@
 #include <linux/page_cgroup.h>
 #include <linux/cpu.h>
 #include <linux/oom.h>
+#include <linux/idr.h>
+#include <linux/workqueue.h>
+#include <linux/list_lru.h>
 #include "internal.h"
 
 #include <asm/uaccess.h>
@@ -286,6 +289,17 @@ struct mem_cgroup {
 	 */
 	struct mem_cgroup_stat_cpu nocpu_base;
 	spinlock_t pcp_counter_lock;
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	/*
+	 * the counter to account for kernel memory usage, which is also
+	 * charged to res (and memsw).
+	 */
+	struct res_counter kmem;
+	/* index into the per-memcg cache arrays, -1 if not accounted */
+	int kmemcg_id;
+	/* per-memcg slab caches, protected by memcg_cache_mutex */
+	struct list_head memcg_slab_caches;
+#endif
 };
 
 /* Stuffs for move charges at task migration. */
@@ -347,6 +361,7 @@ enum charge_type {
 #define _MEM			(0)
 #define _MEMSWAP		(1)
 #define _OOM_TYPE		(2)
+#define _KMEM			(3)
 #define MEMFILE_PRIVATE(x, val)	(((x) << 16) | (val))
 #define MEMFILE_TYPE(val)	(((val) >> 16) & 0xffff)
 #define MEMFILE_ATTR(val)	((val) & 0xffff)
@@ -2420,6 +2435,455 @@ static void __mem_cgroup_cancel_charge(struct mem_cgroup *memcg,
 	}
 }
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+/*
+ * Kernel memory accounting.
+ *
+ * Every memcg but the root one gets a kmemcg_id.  Objects from caches
+ * created with SLAB_ACCOUNT, or allocated with __GFP_ACCOUNT, come from a
+ * per-memcg copy of the cache, which is created on first use from a work
+ * item and whose slab pages are charged to the memcg.  Pages allocated
+ * with __GFP_ACCOUNT straight from the page allocator are charged one by
+ * one and remembered in their page_cgroup.  Kernel memory is charged to
+ * memcg->kmem and to memcg->res (and memsw), and is never moved to the
+ * parent or reclaimed by force_empty.
+ */
+struct jump_label_key memcg_kmem_enabled_key;
+
+static DEFINE_IDA(kmem_limited_groups);
+#define MEMCG_CACHES_MIN_SIZE	4
+#define MEMCG_CACHES_MAX_SIZE	65535
+
+/*
+ * Serializes creation and destruction of per-memcg caches, the growth of
+ * the memcg_caches arrays of the root caches, and memcg_slab_caches.
+ */
+static DEFINE_MUTEX(memcg_cache_mutex);
+static struct workqueue_struct *memcg_cache_wq;
+
+/*
+ * Patching the jump label takes the cpu hotplug lock, which nests outside
+ * cgroup_mutex, so it cannot be done from mem_cgroup_create.
+ */
+static void memcg_kmem_enable_func(struct work_struct *work)
+{
+	if (!memcg_kmem_enabled())
+		jump_label_inc(&memcg_kmem_enabled_key);
+}
+static DECLARE_WORK(memcg_kmem_enable_work, memcg_kmem_enable_func);
+
+static void memcg_init_kmem(struct mem_cgroup *memcg,
+			    struct mem_cgroup *parent)
+{
+	int id;
+
+	if (parent && parent->use_hierarchy)
+		res_counter_init(&memcg->kmem, &parent->kmem);
+	else
+		res_counter_init(&memcg->kmem, NULL);
+	if (!parent)
+		return;
+
+	if (!memcg_cache_wq) {
+		memcg_cache_wq = alloc_workqueue("memcg_cache", 0, 0);
+		if (!memcg_cache_wq)
+			return;
+	}
+	id = ida_simple_get(&kmem_limited_groups, 0, MEMCG_CACHES_MAX_SIZE,
+			    GFP_KERNEL);
+	if (id < 0)
+		return;
+	if (memcg_list_lrus_online(id)) {
+		ida_simple_remove(&kmem_limited_groups, id);
+		return;
+	}
+	memcg->kmemcg_id = id;
+	if (!memcg_kmem_enabled())
+		schedule_work(&memcg_kmem_enable_work);
+}
+
+static void memcg_free_kmem(struct mem_cgroup *memcg)
+{
+	if (memcg->kmemcg_id >= 0)
+		ida_simple_remove(&kmem_limited_groups, memcg->kmemcg_id);
+}
+
+/*
+ * Memcg OOM is not invoked for kernel memory: the allocation fails
+ * instead, as the caller may hold locks the victim needs to exit.
+ */
+static int memcg_charge_kmem(struct mem_cgroup *memcg, gfp_t gfp, u64 size)
+{
+	struct res_counter *fail_res;
+	struct mem_cgroup *_memcg;
+	int ret;
+
+	ret = res_counter_charge(&memcg->kmem, size, &fail_res);
+	if (ret)
+		return ret;
+
+	_memcg = memcg;
+	ret = __mem_cgroup_try_charge(NULL, gfp, size >> PAGE_SHIFT,
+				      &_memcg, false);
+	if (ret) {
+		res_counter_uncharge(&memcg->kmem, size);
+	} else if (!_memcg) {
+		/*
+		 * The charge was bypassed for a dying task.  Charge res and
+		 * memsw anyway, the uncharge will not know about it.
+		 */
+		res_counter_charge_nofail(&memcg->res, size, &fail_res);
+		if (do_swap_account)
+			res_counter_charge_nofail(&memcg->memsw, size,
+						  &fail_res);
+	}
+	return ret;
+}
+
+static void memcg_uncharge_kmem(struct mem_cgroup *memcg, u64 size)
+{
+	res_counter_uncharge(&memcg->res, size);
+	if (do_swap_account)
+		res_counter_uncharge(&memcg->memsw, size);
+	res_counter_uncharge(&memcg->kmem, size);
+}
+
+/**
+ * memcg_cache_id - the index of a memcg in per-memcg kernel memory arrays
+ * @memcg: the memcg
+ *
+ * Returns -1 if kernel memory is not accounted to @memcg.
+ */
+int memcg_cache_id(struct mem_cgroup *memcg)
+{
+	return memcg->kmemcg_id;
+}
+
+static bool memcg_can_account_kmem(void)
+{
+	return current->mm && !(current->flags & PF_KTHREAD) &&
+		!in_interrupt();
+}
+
+int __memcg_kmem_charge_pages(struct page *page, gfp_t gfp, int order)
+{
+	struct mem_cgroup *memcg;
+	struct page_cgroup *pc;
+	int ret;
+
+	if (!memcg_can_account_kmem() || (gfp & __GFP_NOFAIL))
+		return 0;
+
+	memcg = try_get_mem_cgroup_from_mm(current->mm);
+	if (!memcg)
+		return 0;
+	if (memcg->kmemcg_id < 0) {
+		css_put(&memcg->css);
+		return 0;
+	}
+
+	ret = memcg_charge_kmem(memcg, gfp, PAGE_SIZE << order);
+	if (!ret) {
+		pc = lookup_page_cgroup(page);
+		mem_cgroup_get(memcg);
+		pc->mem_cgroup = memcg;
+		SetPageCgroupKmem(pc);
+	}
+	css_put(&memcg->css);
+	return ret;
+}
+
+void __memcg_kmem_uncharge_pages(struct page *page, int order)
+{
+	struct page_cgroup *pc = lookup_page_cgroup(page);
+	struct mem_cgroup *memcg;
+
+	if (!pc || !PageCgroupKmem(pc))
+		return;
+	ClearPageCgroupKmem(pc);
+	memcg = pc->mem_cgroup;
+	memcg_uncharge_kmem(memcg, PAGE_SIZE << order);
+	mem_cgroup_put(memcg);
+}
+
+int memcg_charge_slab(struct kmem_cache *s, gfp_t gfp, int order)
+{
+	struct memcg_cache_params *params = s->memcg_params;
+	int ret;
+
+	ret = memcg_charge_kmem(params->memcg, gfp, PAGE_SIZE << order);
+	if (!ret)
+		atomic_add(1 << order, &params->nr_pages);
+	return ret;
+}
+
+void memcg_uncharge_slab(struct kmem_cache *s, int order)
+{
+	struct memcg_cache_params *params = s->memcg_params;
+
+	memcg_uncharge_kmem(params->memcg, PAGE_SIZE << order);
+	/* the last slab of a cache whose memcg is gone */
+	if (atomic_sub_and_test(1 << order, &params->nr_pages))
+		queue_work(memcg_cache_wq, &params->destroy);
+}
+
+static struct memcg_cache_array *
+memcg_cache_array(struct kmem_cache *root)
+{
+	return rcu_dereference_protected(root->memcg_caches,
+				lockdep_is_held(&memcg_cache_mutex));
+}
+
+/* Make room for @nr per-memcg copies of @root */
+static int memcg_grow_cache_array(struct kmem_cache *root, int nr)
+{
+	struct memcg_cache_array *old, *new;
+	int size;
+
+	old = memcg_cache_array(root);
+	if (old && old->nr_caches >= nr)
+		return 0;
+
+	size = max(nr, MEMCG_CACHES_MIN_SIZE);
+	if (old)
+		size = max(size, 2 * old->nr_caches);
+	size = min(size, MEMCG_CACHES_MAX_SIZE);
+
+	new = kzalloc(sizeof(*new) + size * sizeof(struct kmem_cache *),
+		      GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+	new->nr_caches = size;
+	if (old)
+		memcpy(new->caches, old->caches,
+		       old->nr_caches * sizeof(struct kmem_cache *));
+	rcu_assign_pointer(root->memcg_caches, new);
+	if (old)
+		kfree_rcu(old, rcu_head);
+	return 0;
+}
+
+static void memcg_destroy_cache_work_func(struct work_struct *work)
+{
+	struct memcg_cache_params *params;
+	struct kmem_cache *s;
+	struct mem_cgroup *memcg;
+
+	params = container_of(work, struct memcg_cache_params, destroy);
+	s = params->cachep;
+	memcg = params->memcg;
+
+	mutex_lock(&memcg_cache_mutex);
+	memcg_cache_array(params->root_cache)->caches[memcg->kmemcg_id] = NULL;
+	list_del(&params->list);
+	/* frees params */
+	kmem_cache_destroy(s);
+	mutex_unlock(&memcg_cache_mutex);
+
+	mem_cgroup_put(memcg);
+}
+
+static void memcg_create_cache(struct mem_cgroup *memcg,
+			       struct kmem_cache *root)
+{
+	struct memcg_cache_params *params;
+	struct dentry *dentry = memcg->css.cgroup->dentry;
+	int idx = memcg->kmemcg_id;
+	struct kmem_cache *s;
+	char *name;
+
+	spin_lock(&dentry->d_lock);
+	name = kasprintf(GFP_ATOMIC, "%s(%d:%s)", root->name, idx,
+			 dentry->d_name.name);
+	spin_unlock(&dentry->d_lock);
+	if (!name)
+		return;
+
+	mutex_lock(&memcg_cache_mutex);
+	if (memcg_grow_cache_array(root, idx + 1))
+		goto out;
+	if (memcg_cache_array(root)->caches[idx])
+		goto out;
+
+	params = kzalloc(sizeof(*params), GFP_KERNEL);
+	if (!params)
+		goto out;
+	params->memcg = memcg;
+	params->root_cache = root;
+	atomic_set(&params->nr_pages, 1);
+	INIT_WORK(&params->destroy, memcg_destroy_cache_work_func);
+
+	s = kmem_cache_create_memcg(root, name, params);
+	if (!s) {
+		kfree(params);
+		goto out;
+	}
+	params->cachep = s;
+	mem_cgroup_get(memcg);
+	list_add(&params->list, &memcg->memcg_slab_caches);
+	rcu_assign_pointer(memcg_cache_array(root)->caches[idx], s);
+out:
+	mutex_unlock(&memcg_cache_mutex);
+	kfree(name);
+}
+
+struct memcg_create_work {
+	struct mem_cgroup *memcg;
+	struct kmem_cache *root;
+	struct work_struct work;
+};
+
+static void memcg_create_cache_work_func(struct work_struct *work)
+{
+	struct memcg_create_work *cw;
+
+	cw = container_of(work, struct memcg_create_work, work);
+	memcg_create_cache(cw->memcg, cw->root);
+	css_put(&cw->memcg->css);
+	kfree(cw);
+}
+
+/*
+ * Creating a cache may sleep, but the allocation that needs it may not,
+ * so it is done from a work item.  Consumes the css reference on @memcg.
+ */
+static void memcg_create_cache_enqueue(struct mem_cgroup *memcg,
+				       struct kmem_cache *root)
+{
+	struct memcg_create_work *cw;
+
+	cw = kmalloc(sizeof(*cw), GFP_NOWAIT | __GFP_NOWARN);
+	if (!cw) {
+		css_put(&memcg->css);
+		return;
+	}
+	cw->memcg = memcg;
+	cw->root = root;
+	INIT_WORK(&cw->work, memcg_create_cache_work_func);
+	queue_work(memcg_cache_wq, &cw->work);
+}
+
+/**
+ * __memcg_kmem_get_cache - select the cache to allocate an accounted object from
+ * @root: the cache the caller asked for
+ * @gfp: the allocation mask
+ *
+ * Returns the copy of @root that belongs to the memcg of the current
+ * task, with a css reference held that __memcg_kmem_put_cache drops, or
+ * @root itself if the allocation is not accounted.  The first allocation
+ * of a memcg from a cache only schedules the creation of its copy and is
+ * not accounted.
+ */
+struct kmem_cache *__memcg_kmem_get_cache(struct kmem_cache *root, gfp_t gfp)
+{
+	struct memcg_cache_array *array;
+	struct kmem_cache *s = NULL;
+	struct mem_cgroup *memcg;
+	int idx;
+
+	if (!memcg_can_account_kmem() || (gfp & __GFP_NOFAIL))
+		return root;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_task(rcu_dereference(current->mm->owner));
+	if (!memcg || memcg->kmemcg_id < 0)
+		goto out;
+	if (!css_tryget(&memcg->css))
+		goto out;
+
+	idx = memcg->kmemcg_id;
+	array = rcu_dereference(root->memcg_caches);
+	if (array && idx < array->nr_caches)
+		s = rcu_dereference(array->caches[idx]);
+	rcu_read_unlock();
+
+	if (likely(s))
+		return s;
+	memcg_create_cache_enqueue(memcg, root);
+	return root;
+out:
+	rcu_read_unlock();
+	return root;
+}
+
+void __memcg_kmem_put_cache(struct kmem_cache *s)
+{
+	css_put(&s->memcg_params->memcg->css);
+}
+
+/*
+ * The memcg is going away.  Its caches stop keeping free slabs around
+ * and are destroyed once the last of their objects has been freed.  The
+ * objects left on list_lrus move to the lists of the parent, which is
+ * charged for them too.
+ */
+static void memcg_destroy_kmem_caches(struct mem_cgroup *memcg)
+{
+	struct memcg_cache_params *params;
+	struct mem_cgroup *parent;
+
+	mutex_lock(&memcg_cache_mutex);
+	list_for_each_entry(params, &memcg->memcg_slab_caches, list) {
+		kmem_cache_deactivate_memcg(params->cachep);
+		if (atomic_dec_and_test(&params->nr_pages))
+			queue_work(memcg_cache_wq, &params->destroy);
+	}
+	mutex_unlock(&memcg_cache_mutex);
+
+	if (memcg->kmemcg_id >= 0) {
+		parent = parent_mem_cgroup(memcg);
+		memcg_list_lrus_offline(memcg->kmemcg_id,
+					parent ? parent->kmemcg_id : -1);
+	}
+}
+
+/**
+ * memcg_destroy_child_caches - destroy the per-memcg copies of a cache
+ * @root: the root cache that is being destroyed
+ *
+ * All objects have been freed by now, from @root as well as its copies.
+ */
+void memcg_destroy_child_caches(struct kmem_cache *root)
+{
+	struct memcg_cache_array *array;
+	struct mem_cgroup *memcg;
+	struct kmem_cache *s;
+	int i;
+
+	if (!root->memcg_caches)
+		return;
+	/* pending creations and destructions */
+	flush_workqueue(memcg_cache_wq);
+
+	mutex_lock(&memcg_cache_mutex);
+	array = memcg_cache_array(root);
+	for (i = 0; i < array->nr_caches; i++) {
+		s = array->caches[i];
+		if (!s)
+			continue;
+		array->caches[i] = NULL;
+		memcg = s->memcg_params->memcg;
+		list_del(&s->memcg_params->list);
+		kmem_cache_destroy(s);
+		mem_cgroup_put(memcg);
+	}
+	mutex_unlock(&memcg_cache_mutex);
+}
+#else
+static void memcg_init_kmem(struct mem_cgroup *memcg,
+			    struct mem_cgroup *parent)
+{
+}
+
+static void memcg_free_kmem(struct mem_cgroup *memcg)
+{
+}
+
+static void memcg_destroy_kmem_caches(struct mem_cgroup *memcg)
+{
+}
+#endif /* CONFIG_CGROUP_MEM_RES_CTLR_KMEM */
+
 /*
  * A helper function to get mem_cgroup from ID. must be called under
  * rcu_read_lock(). The caller must check css_is_removed() or some if
@@ -3701,6 +4165,26 @@ static int mem_cgroup_force_empty_list(struct mem_cgroup *memcg,
  * make mem_cgroup's charge to be 0 if there is no task.
  * This enables deleting this mem_cgroup.
  */
+/*
+ * Usage that force_empty can get rid of.  Kernel memory cannot be moved
+ * to the parent or reclaimed from here, it stays charged to this memcg
+ * until the objects are freed.
+ */
+static u64 mem_cgroup_user_usage(struct mem_cgroup *memcg)
+{
+	u64 usage, kmem = 0;
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	kmem = res_counter_read_u64(&memcg->kmem, RES_USAGE);
+#endif
+	usage = res_counter_read_u64(&memcg->res, RES_USAGE);
+	/*
+	 * The two counters are not read atomically, and kmem is charged
+	 * before res but uncharged after it: kmem may appear the larger.
+	 */
+	return usage > kmem ? usage - kmem : 0;
+}
+
 static int mem_cgroup_force_empty(struct mem_cgroup *memcg, bool free_all)
 {
 	int ret;
@@ -3747,7 +4231,7 @@ move_account:
 			goto try_to_free;
 		cond_resched();
 	/* "ret" should also be checked to ensure all lists are empty. */
-	} while (memcg->res.usage > 0 || ret);
+	} while (mem_cgroup_user_usage(memcg) > 0 || ret);
 out:
 	css_put(&memcg->css);
 	return ret;
@@ -3762,7 +4246,7 @@ try_to_free:
 	lru_add_drain_all();
 	/* try to free all pages in this cgroup */
 	shrink = 1;
-	while (nr_retries && memcg->res.usage > 0) {
+	while (nr_retries && mem_cgroup_user_usage(memcg) > 0) {
 		int progress;
 
 		if (signal_pending(current)) {
@@ -3884,6 +4368,11 @@ static u64 mem_cgroup_read(struct cgroup *cont, struct cftype *cft)
 		else
 			val = res_counter_read_u64(&memcg->memsw, name);
 		break;
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	case _KMEM:
+		val = res_counter_read_u64(&memcg->kmem, name);
+		break;
+#endif
 	default:
 		BUG();
 		break;
@@ -3916,8 +4405,12 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 			break;
 		if (type == _MEM)
 			ret = mem_cgroup_resize_limit(memcg, val);
-		else
+		else if (type == _MEMSWAP)
 			ret = mem_cgroup_resize_memsw_limit(memcg, val);
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+		else
+			ret = res_counter_set_limit(&memcg->kmem, val);
+#endif
 		break;
 	case RES_SOFT_LIMIT:
 		ret = res_counter_memparse_write_strategy(buffer, &val);
@@ -3980,14 +4473,22 @@ static int mem_cgroup_reset(struct cgroup *cont, unsigned int event)
 	case RES_MAX_USAGE:
 		if (type == _MEM)
 			res_counter_reset_max(&memcg->res);
-		else
+		else if (type == _MEMSWAP)
 			res_counter_reset_max(&memcg->memsw);
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+		else
+			res_counter_reset_max(&memcg->kmem);
+#endif
 		break;
 	case RES_FAILCNT:
 		if (type == _MEM)
 			res_counter_reset_failcnt(&memcg->res);
-		else
+		else if (type == _MEMSWAP)
 			res_counter_reset_failcnt(&memcg->memsw);
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+		else
+			res_counter_reset_failcnt(&memcg->kmem);
+#endif
 		break;
 	}
 
@@ -4727,6 +5228,45 @@ static int register_memsw_files(struct cgroup *cont, struct cgroup_subsys *ss)
 }
 #endif
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+static struct cftype kmem_cgroup_files[] = {
+	{
+		.name = "kmem.usage_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_USAGE),
+		.read_u64 = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.max_usage_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_MAX_USAGE),
+		.trigger = mem_cgroup_reset,
+		.read_u64 = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.limit_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_LIMIT),
+		.write_string = mem_cgroup_write,
+		.read_u64 = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.failcnt",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_FAILCNT),
+		.trigger = mem_cgroup_reset,
+		.read_u64 = mem_cgroup_read,
+	},
+};
+
+static int register_kmem_files(struct cgroup *cont, struct cgroup_subsys *ss)
+{
+	return cgroup_add_files(cont, ss, kmem_cgroup_files,
+				ARRAY_SIZE(kmem_cgroup_files));
+}
+#else
+static int register_kmem_files(struct cgroup *cont, struct cgroup_subsys *ss)
+{
+	return 0;
+}
+#endif
+
 static int alloc_mem_cgroup_per_zone_info(struct mem_cgroup *memcg, int node)
 {
 	struct mem_cgroup_per_node *pn;
@@ -4782,6 +5322,10 @@ static struct mem_cgroup *mem_cgroup_alloc(void)
 	if (!mem->stat)
 		goto out_free;
 	spin_lock_init(&mem->pcp_counter_lock);
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	mem->kmemcg_id = -1;
+	INIT_LIST_HEAD(&mem->memcg_slab_caches);
+#endif
 	return mem;
 
 out_free:
@@ -4809,6 +5353,7 @@ static void __mem_cgroup_free(struct mem_cgroup *memcg)
 
 	mem_cgroup_remove_from_trees(memcg);
 	free_css_id(&mem_cgroup_subsys, &memcg->css);
+	memcg_free_kmem(memcg);
 
 	for_each_node_state(node, N_POSSIBLE)
 		free_mem_cgroup_per_zone_info(memcg, node);
@@ -4936,6 +5481,7 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 		res_counter_init(&memcg->res, NULL);
 		res_counter_init(&memcg->memsw, NULL);
 	}
+	memcg_init_kmem(memcg, parent);
 	memcg->last_scanned_child = 0;
 	memcg->last_scanned_node = MAX_NUMNODES;
 	INIT_LIST_HEAD(&memcg->oom_notify);
@@ -4964,6 +5510,7 @@ static void mem_cgroup_destroy(struct cgroup_subsys *ss,
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_cont(cont);
 
+	memcg_destroy_kmem_caches(memcg);
 	mem_cgroup_put(memcg);
 }
 
@@ -4977,6 +5524,8 @@ static int mem_cgroup_populate(struct cgroup_subsys *ss,
 
 	if (!ret)
 		ret = register_memsw_files(cont, ss);
+	if (!ret)
+		ret = register_kmem_files(cont, ss);
 	return ret;
 }
 
@@ -57,6 +57,9 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/migrate.h>
+#include <linux/sysctl.h>
+#include <linux/log2.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -1229,8 +1232,10 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		next = pmd_addr_end(addr, end);
 		if (pmd_trans_huge(*pmd)) {
 			if (next-addr != HPAGE_PMD_SIZE) {
-				VM_BUG_ON(!rwsem_is_locked(&tlb->mm->mmap_sem));
-				split_huge_page_pmd(vma->vm_mm, pmd);
+				/* truncation splits page cache pmds too */
+				VM_BUG_ON(!vma->vm_ops &&
+					  !rwsem_is_locked(&tlb->mm->mmap_sem));
+				split_huge_pmd(vma, addr, pmd);
 			} else if (zap_huge_pmd(tlb, vma, pmd))
 				continue;
 			/* fall through */
@@ -3129,6 +3134,103 @@ oom:
 	return VM_FAULT_OOM;
 }
 
+/**
+ * do_set_pte - map a pagecache page into an empty pte
+ * @vma:	vma the page is mapped into
+ * @address:	user virtual address of @pte
+ * @page:	the page, locked, with a reference the pte takes over
+ * @pte:	the pte, which must be none, with the page table lock held
+ *
+ * Maps @page read-only as a file page; used to populate the ptes around
+ * a read fault without taking a fault on each of them.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	inc_mm_counter_fast(vma->vm_mm, MM_FILEPAGES);
+	page_add_file_rmap(page);
+	set_pte_at(vma->vm_mm, address, pte, entry);
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, pte);
+}
+
+unsigned long sysctl_fault_around_bytes __read_mostly = 65536;
+
+int fault_around_bytes_sysctl_handler(struct ctl_table *table, int write,
+		void __user *buffer, size_t *length, loff_t *ppos)
+{
+	static unsigned long min_bytes = PAGE_SIZE;
+	static unsigned long max_bytes = PTRS_PER_PTE * PAGE_SIZE;
+	unsigned long val = sysctl_fault_around_bytes;
+	struct ctl_table t = *table;
+	int ret;
+
+	t.data = &val;
+	t.extra1 = &min_bytes;
+	t.extra2 = &max_bytes;
+	ret = proc_doulongvec_minmax(&t, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	/* the window is aligned to its size, so keep it a power of two */
+	sysctl_fault_around_bytes = rounddown_pow_of_two(val);
+	return 0;
+}
+
+/*
+ * Map the cached pages in a naturally aligned window of
+ * sysctl_fault_around_bytes around @address, clipped to the vma and to
+ * the page table @pte lives in.  The caller holds the page table lock;
+ * ptes that are already populated, including the faulting one if someone
+ * raced with us, are left alone by ->map_pages().
+ */
+static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pte_t *pte, pgoff_t pgoff, unsigned int flags)
+{
+	unsigned long bytes = ACCESS_ONCE(sysctl_fault_around_bytes);
+	unsigned long start_addr, mask;
+	pgoff_t max_pgoff;
+	struct vm_fault vmf;
+	int off;
+
+	mask = ~(bytes - 1) & PAGE_MASK;
+	start_addr = max(address & mask, vma->vm_start);
+	off = ((address - start_addr) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1);
+	pte -= off;
+	pgoff -= off;
+
+	/*
+	 * max_pgoff is either the end of the page table, the end of the vma
+	 * or the end of the window, whichever is closest.
+	 */
+	max_pgoff = pgoff - ((start_addr >> PAGE_SHIFT) & (PTRS_PER_PTE - 1)) +
+		PTRS_PER_PTE - 1;
+	max_pgoff = min3(max_pgoff, vma_pages(vma) + vma->vm_pgoff - 1,
+			 pgoff + (bytes >> PAGE_SHIFT) - 1);
+
+	/* skip the populated ptes at the start, there is nothing to do */
+	while (!pte_none(*pte)) {
+		if (++pgoff > max_pgoff)
+			return;
+		start_addr += PAGE_SIZE;
+		if (start_addr >= vma->vm_end)
+			return;
+		pte++;
+	}
+
+	vmf.virtual_address = (void __user *) start_addr;
+	vmf.pte = pte;
+	vmf.pgoff = pgoff;
+	vmf.max_pgoff = max_pgoff;
+	vmf.flags = flags;
+	vma->vm_ops->map_pages(vma, &vmf);
+}
+
 /*
  * __do_fault() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -3339,6 +3441,24 @@ static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
 
+	/*
+	 * Before taking a read fault on a single page, map whatever the
+	 * page cache already has around it: if the faulting page is among
+	 * them, we are done without calling ->fault() at all.
+	 */
+	if (!(flags & FAULT_FLAG_WRITE) && vma->vm_ops->map_pages &&
+	    sysctl_fault_around_bytes >> PAGE_SHIFT > 1) {
+		spinlock_t *ptl = pte_lockptr(mm, pmd);
+
+		spin_lock(ptl);
+		do_fault_around(vma, address, page_table, pgoff, flags);
+		if (!pte_same(*page_table, orig_pte)) {
+			pte_unmap_unlock(page_table, ptl);
+			return 0;
+		}
+		spin_unlock(ptl);
+	}
+
 	pte_unmap(page_table);
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
@@ -3375,6 +3495,69 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * NUMA hinting fault on a pte made inaccessible by change_prot_numa():
+ * restore access, migrate the page if the memory policy wants it on
+ * another node, and account the fault to the node the page ends up on.
+ *
+ * We enter with non-exclusive mmap_sem and the pte mapped but not locked.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			unsigned long address, pte_t *page_table, pmd_t *pmd,
+			pte_t orig_pte)
+{
+	struct page *page;
+	spinlock_t *ptl;
+	pte_t entry;
+	int nid, target_nid;
+	bool migrated = false;
+
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	if (unlikely(!pte_same(*page_table, orig_pte))) {
+		pte_unmap_unlock(page_table, ptl);
+		return 0;
+	}
+
+	entry = pte_mkyoung(pte_modify(orig_pte, vma->vm_page_prot));
+	set_pte_at(mm, address, page_table, entry);
+	update_mmu_cache(vma, address, page_table);
+
+	page = vm_normal_page(vma, address, entry);
+	if (!page) {
+		pte_unmap_unlock(page_table, ptl);
+		return 0;
+	}
+	nid = page_to_nid(page);
+	target_nid = sysctl_numa_balancing ?
+		mpol_misplaced(page, vma, address) : -1;
+	if (target_nid != -1)
+		get_page(page);
+	pte_unmap_unlock(page_table, ptl);
+
+	count_vm_event(NUMA_HINT_FAULTS);
+	if (nid == numa_node_id())
+		count_vm_event(NUMA_HINT_FAULTS_LOCAL);
+
+	if (target_nid != -1) {
+		migrated = migrate_misplaced_page(page, target_nid);
+		if (migrated)
+			nid = target_nid;
+	}
+	task_numa_fault(nid, 1, migrated);
+	return 0;
+}
+#else
+static inline int do_numa_page(struct mm_struct *mm,
+			struct vm_area_struct *vma, unsigned long address,
+			pte_t *page_table, pmd_t *pmd, pte_t orig_pte)
+{
+	BUG();
+	return 0;
+}
+#endif
+
 /*
  * These routines also need to handle stuff like marking pages dirty
  * and/or accessed for architectures that don't do it in hardware (most
@@ -3413,6 +3596,9 @@ int handle_pte_fault(struct mm_struct *mm,
 					pte, pmd, flags, entry);
 	}
 
+	if (pte_numa(vma, entry))
+		return do_numa_page(mm, vma, address, pte, pmd, entry);
+
 	ptl = pte_lockptr(mm, pmd);
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
@@ -3470,14 +3656,21 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
-		if (!vma->vm_ops)
-			return do_huge_pmd_anonymous_page(mm, vma, address,
-							  pmd, flags);
+	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma) &&
+	    !vma->vm_ops) {
+		return do_huge_pmd_anonymous_page(mm, vma, address,
+						  pmd, flags);
+	} else if (pmd_none(*pmd) && vma->vm_ops && vma->vm_ops->pmd_fault) {
+		int ret = vma->vm_ops->pmd_fault(vma, address, pmd, flags);
+		if (!(ret & VM_FAULT_FALLBACK))
+			return ret;
 	} else {
 		pmd_t orig_pmd = *pmd;
 		barrier();
 		if (pmd_trans_huge(orig_pmd)) {
+			if (pmd_numa(vma, orig_pmd))
+				return do_huge_pmd_numa_page(mm, vma, address,
+							     pmd, orig_pmd);
 			if (flags & FAULT_FLAG_WRITE &&
 			    !pmd_write(orig_pmd) &&
 			    !pmd_trans_splitting(orig_pmd))
@@ -3508,6 +3701,170 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Walk the page tables down to the pte of @address, without allocating
+ * any, for a speculative page fault.  Interrupts must be disabled: as for
+ * get_user_pages_fast(), page tables are only freed once a TLB flush IPI
+ * has reached every CPU running the mm, or after an RCU-sched grace
+ * period, so they stay around until interrupts are enabled again.
+ */
+static pte_t *speculative_pte_offset(struct mm_struct *mm,
+				     unsigned long address,
+				     pmd_t **pmdp, pmd_t *pmdval)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		return NULL;
+	pmd = pmd_offset(pud, address);
+	*pmdval = *pmd;
+	barrier();
+	if (pmd_none(*pmdval) || pmd_trans_huge(*pmdval) ||
+	    unlikely(pmd_bad(*pmdval)))
+		return NULL;
+	*pmdp = pmd;
+	return pte_offset_map(pmdval, address);
+}
+
+/*
+ * Handle a fault on private anonymous memory without mmap_sem.  The vma
+ * is found by get_vma() and copied while its vm_sequence is stable, and
+ * the fault works from the copy.  The new pte is only set if vm_sequence
+ * is still unchanged once the page table lock is held: whatever changes
+ * the vma under vm_write_begin() and then goes on to its ptes needs that
+ * lock too, so it either makes us back off or finds the new pte.
+ *
+ * Only missing ptes of vmas that already have an anon_vma are filled in
+ * here.  For anything else, or on any conflict, VM_FAULT_RETRY is
+ * returned and the caller handles the fault under mmap_sem.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma, pvma;
+	struct page *page = NULL;
+	unsigned long irqflags;
+	unsigned int seq;
+	spinlock_t *ptl;
+	pmd_t *pmd, pmdval;
+	pte_t *pte, entry;
+
+	__set_current_state(TASK_RUNNING);
+
+	vma = get_vma(mm, address);
+	if (!vma)
+		return VM_FAULT_RETRY;
+
+	/* an unlinked vma stays odd for good: don't wait for it to settle */
+	seq = ACCESS_ONCE(vma->vm_sequence.sequence);
+	smp_rmb();
+	if (seq & 1)
+		goto out_put;
+	pvma = *vma;
+	if (read_seqcount_retry(&vma->vm_sequence, seq))
+		goto out_put;
+
+	if (address < pvma.vm_start || address >= pvma.vm_end)
+		goto out_put;
+	if (pvma.vm_ops || pvma.vm_file || !pvma.anon_vma ||
+	    vma_policy(&pvma))
+		goto out_put;
+	if (pvma.vm_flags & (VM_GROWSDOWN | VM_GROWSUP | VM_LOCKED))
+		goto out_put;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(pvma.vm_flags & VM_WRITE))
+			goto out_put;
+	} else if (!(pvma.vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		goto out_put;
+
+	/* Don't allocate a page for a pte that is not missing */
+	local_irq_save(irqflags);
+	pte = speculative_pte_offset(mm, address, &pmd, &pmdval);
+	if (pte) {
+		entry = *pte;
+		pte_unmap(pte);
+	}
+	local_irq_restore(irqflags);
+	if (!pte || !pte_none(entry))
+		goto out_put;
+
+	check_sync_rss_stat(current);
+
+	if (flags & FAULT_FLAG_WRITE) {
+		/* pvma has no policy or vm_ops: the task policy applies */
+		page = alloc_zeroed_user_highpage_movable(&pvma, address);
+		if (!page)
+			goto out_put;
+		__SetPageUptodate(page);
+		if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+			page_cache_release(page);
+			goto out_put;
+		}
+		entry = mk_pte(page, pvma.vm_page_prot);
+		if (pvma.vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+	} else {
+		/* Use the zero-page for reads */
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+					      pvma.vm_page_prot));
+	}
+
+	local_irq_save(irqflags);
+	pte = speculative_pte_offset(mm, address, &pmd, &pmdval);
+	if (!pte)
+		goto out_irq;
+	/*
+	 * Whoever holds the lock may be waiting for us to take its TLB
+	 * flush IPI, so we must not spin on it with interrupts disabled.
+	 */
+	ptl = pte_lockptr(mm, &pmdval);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(pte);
+		goto out_irq;
+	}
+	if (pmd_val(*pmd) != pmd_val(pmdval) ||
+	    read_seqcount_retry(&vma->vm_sequence, seq) ||
+	    !pte_none(*pte)) {
+		pte_unmap_unlock(pte, ptl);
+		goto out_irq;
+	}
+
+	if (page) {
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, &pvma, address);
+	}
+	set_pte_at(mm, address, pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(&pvma, address, pte);
+	pte_unmap_unlock(pte, ptl);
+	local_irq_restore(irqflags);
+	put_vma(vma);
+
+	count_vm_event(PGFAULT);
+	count_vm_event(SPECULATIVE_PGFAULT);
+	mem_cgroup_count_vm_event(mm, PGFAULT);
+	return 0;
+
+out_irq:
+	local_irq_restore(irqflags);
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+out_put:
+	put_vma(vma);
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -622,7 +622,9 @@ static int policy_vma(struct vm_area_struct *vma, struct mempolicy *new)
 		err = vma->vm_ops->set_policy(vma, new);
 	if (!err) {
 		mpol_get(new);
+		vm_write_begin(vma);
 		vma->vm_policy = new;
+		vm_write_end(vma);
 		mpol_put(old);
 	}
 	return err;
@@ -1920,6 +1922,56 @@ struct page *alloc_pages_current(gfp_t gfp, unsigned order)
 }
 EXPORT_SYMBOL(alloc_pages_current);
 
+#ifdef CONFIG_NUMA_BALANCING
+/**
+ * mpol_misplaced - where a page should live for the task faulting on it
+ * @page: page mapped at @addr
+ * @vma: vma containing @addr
+ * @addr: virtual address of the NUMA hinting fault
+ *
+ * Local allocation, the default, wants pages on the node of the faulting
+ * CPU; a preferred node policy wants them on that node, and a bind policy
+ * on the faulting CPU's node if it is one of the bound nodes.  Interleaved
+ * pages are spread on purpose and never move.
+ *
+ * Called with the page table lock held.  Returns the node @page should be
+ * migrated to, or -1 if it is where the policy wants it.
+ */
+int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+		   unsigned long addr)
+{
+	struct mempolicy *pol;
+	int curnid = page_to_nid(page);
+	int thisnid = numa_node_id();
+	int polnid = -1;
+
+	pol = get_vma_policy(current, vma, addr);
+
+	switch (pol->mode) {
+	case MPOL_PREFERRED:
+		if (pol->flags & MPOL_F_LOCAL)
+			polnid = thisnid;
+		else
+			polnid = pol->v.preferred_node;
+		break;
+
+	case MPOL_BIND:
+		if (node_isset(thisnid, pol->v.nodes))
+			polnid = thisnid;
+		break;
+
+	case MPOL_INTERLEAVE:
+		break;
+
+	default:
+		BUG();
+	}
+	mpol_cond_put(pol);
+
+	return polnid == curnid ? -1 : polnid;
+}
+#endif
+
 /*
  * If mpol_dup() sees current->cpuset == cpuset_being_rebound, then it
  * rebinds the mempolicy its copying by calling mpol_rebind_policy()
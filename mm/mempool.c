@@ -12,6 +12,7 @@
 #include <linux/slab.h>
 #include <linux/export.h>
 #include <linux/mempool.h>
+#include <linux/percpu.h>
 #include <linux/blkdev.h>
 #include <linux/writeback.h>
 
@@ -280,6 +281,193 @@ void mempool_free(void *element, mempool_t *pool)
 }
 EXPORT_SYMBOL(mempool_free);
 
+/*
+ * Per-cpu free lists in front of a pool, for pools that see an allocation
+ * and a free for every I/O.  Freed elements are chained through their first
+ * word and handed out again on the cpu that freed them, skipping the pool
+ * and the slab.  The pool's reserve is always refilled first, so callers
+ * sleeping in mempool_alloc() still get woken up.
+ *
+ * For pools backed by a slab cache, an empty list is refilled and a full
+ * one drained a batch at a time with the slab bulk interfaces.
+ */
+
+/* most elements moved between a list and the slab at once */
+#define MEMPOOL_CACHE_BULK_MAX	32
+
+static inline bool mempool_is_slab(mempool_t *pool)
+{
+	return pool->alloc == mempool_alloc_slab &&
+	       pool->free == mempool_free_slab;
+}
+
+/*
+ * Allocate @batch elements from the slab, returning one and putting the
+ * others on this cpu's list.  Like the first attempt of mempool_alloc(),
+ * this neither sleeps nor touches the emergency reserves.
+ */
+static void *mempool_cache_refill(mempool_t *pool,
+				  struct mempool_cpu_cache __percpu *cache,
+				  gfp_t gfp_mask, unsigned int batch)
+{
+	void *elements[MEMPOOL_CACHE_BULK_MAX];
+	struct mempool_cpu_cache *c;
+	unsigned long flags;
+	unsigned int i;
+
+	batch = min_t(unsigned int, batch, MEMPOOL_CACHE_BULK_MAX);
+	gfp_mask |= __GFP_NOMEMALLOC | __GFP_NORETRY | __GFP_NOWARN;
+	gfp_mask &= ~(__GFP_WAIT | __GFP_IO);
+
+	if (!kmem_cache_alloc_bulk(pool->pool_data, gfp_mask, batch, elements))
+		return NULL;
+
+	local_irq_save(flags);
+	c = this_cpu_ptr(cache);
+	for (i = 1; i < batch; i++) {
+		*(void **)elements[i] = c->head;
+		c->head = elements[i];
+		c->nr++;
+	}
+	local_irq_restore(flags);
+
+	return elements[0];
+}
+
+/**
+ * mempool_cpu_cache_create - allocate per-cpu free lists for a pool
+ *
+ * Returns %NULL on failure; the mempool_cache_*() helpers then simply use
+ * the pool directly.
+ */
+struct mempool_cpu_cache __percpu *mempool_cpu_cache_create(void)
+{
+	return alloc_percpu(struct mempool_cpu_cache);
+}
+EXPORT_SYMBOL(mempool_cpu_cache_create);
+
+/**
+ * mempool_cpu_cache_destroy - return cached elements and free the lists
+ * @pool:	pool the elements belong to
+ * @cache:	lists from mempool_cpu_cache_create(), may be %NULL
+ *
+ * Must be called before @pool is destroyed, once nobody allocates or frees
+ * through @cache any more.
+ */
+void mempool_cpu_cache_destroy(mempool_t *pool,
+			       struct mempool_cpu_cache __percpu *cache)
+{
+	int cpu;
+
+	if (!cache)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct mempool_cpu_cache *c = per_cpu_ptr(cache, cpu);
+
+		while (c->head) {
+			void *element = c->head;
+
+			c->head = *(void **)element;
+			mempool_free(element, pool);
+		}
+		c->nr = 0;
+	}
+	free_percpu(cache);
+}
+EXPORT_SYMBOL(mempool_cpu_cache_destroy);
+
+/**
+ * mempool_cache_alloc - allocate an element, preferring this cpu's list
+ * @pool:	pool to fall back to
+ * @cache:	per-cpu lists, may be %NULL
+ * @gfp_mask:	the usual allocation bitmask, for the fallback
+ * @batch:	how many elements to take from the slab when the list is empty
+ */
+void *mempool_cache_alloc(mempool_t *pool,
+			  struct mempool_cpu_cache __percpu *cache,
+			  gfp_t gfp_mask, unsigned int batch)
+{
+	struct mempool_cpu_cache *c;
+	unsigned long flags;
+	void *element = NULL;
+
+	if (likely(cache)) {
+		local_irq_save(flags);
+		c = this_cpu_ptr(cache);
+		if (c->head) {
+			element = c->head;
+			c->head = *(void **)element;
+			c->nr--;
+		}
+		local_irq_restore(flags);
+		if (element)
+			return element;
+
+		if (batch > 1 && mempool_is_slab(pool)) {
+			element = mempool_cache_refill(pool, cache, gfp_mask,
+						       batch);
+			if (element)
+				return element;
+		}
+	}
+	return mempool_alloc(pool, gfp_mask);
+}
+EXPORT_SYMBOL(mempool_cache_alloc);
+
+/**
+ * mempool_cache_free - free an element to this cpu's list
+ * @element:	element from mempool_cache_alloc()
+ * @pool:	pool the element belongs to
+ * @cache:	per-cpu lists, may be %NULL
+ * @max:	how many elements each cpu may keep
+ *
+ * Elements go back to @pool when its reserve is short or the list is full;
+ * a full list of a slab backed pool first returns half of its elements to
+ * the slab in one go.  Can be called from interrupt context.
+ */
+void mempool_cache_free(void *element, mempool_t *pool,
+			struct mempool_cpu_cache __percpu *cache,
+			unsigned int max)
+{
+	void *elements[MEMPOOL_CACHE_BULK_MAX];
+	struct mempool_cpu_cache *c;
+	unsigned int nr = 0;
+	unsigned long flags;
+
+	if (unlikely(element == NULL))
+		return;
+
+	smp_mb();
+	if (likely(cache) && pool->curr_nr >= pool->min_nr) {
+		local_irq_save(flags);
+		c = this_cpu_ptr(cache);
+		if (c->nr >= max && max > 1 && mempool_is_slab(pool)) {
+			unsigned int drain = min_t(unsigned int, max / 2,
+						   MEMPOOL_CACHE_BULK_MAX);
+
+			while (c->head && nr < drain) {
+				elements[nr++] = c->head;
+				c->head = *(void **)c->head;
+				c->nr--;
+			}
+		}
+		if (c->nr < max) {
+			*(void **)element = c->head;
+			c->head = element;
+			c->nr++;
+			element = NULL;
+		}
+		local_irq_restore(flags);
+		if (nr)
+			kmem_cache_free_bulk(pool->pool_data, nr, elements);
+		if (!element)
+			return;
+	}
+	mempool_free(element, pool);
+}
+EXPORT_SYMBOL(mempool_cache_free);
+
 /*
  * A commonly used alloc and free fn.
  */
@@ -1367,3 +1367,104 @@ int migrate_vmas(struct mm_struct *mm, const nodemask_t *to,
  	return err;
 }
 #endif
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Hinting faults may migrate at most ratelimit_pages into a node every
+ * migrate_interval_millisecs, so that a task moving to another node
+ * does not saturate the interconnect dragging its memory along.
+ */
+static unsigned int migrate_interval_millisecs __read_mostly = 100;
+static unsigned int ratelimit_pages __read_mostly = 128 << (20 - PAGE_SHIFT);
+
+static bool numamigrate_update_ratelimit(pg_data_t *pgdat, int nr_pages)
+{
+	bool rate_limited = false;
+
+	spin_lock(&pgdat->numabalancing_migrate_lock);
+	if (time_after(jiffies, pgdat->numabalancing_migrate_next_window)) {
+		pgdat->numabalancing_migrate_nr_pages = 0;
+		pgdat->numabalancing_migrate_next_window = jiffies +
+			msecs_to_jiffies(migrate_interval_millisecs);
+	}
+	if (pgdat->numabalancing_migrate_nr_pages > ratelimit_pages)
+		rate_limited = true;
+	else
+		pgdat->numabalancing_migrate_nr_pages += nr_pages;
+	spin_unlock(&pgdat->numabalancing_migrate_lock);
+
+	return rate_limited;
+}
+
+/* Whether @pgdat can take @nr_pages without waking kswapd */
+static bool migrate_balanced_pgdat(pg_data_t *pgdat, int nr_pages)
+{
+	int z;
+
+	for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+		struct zone *zone = pgdat->node_zones + z;
+
+		if (!populated_zone(zone) || zone->all_unreclaimable)
+			continue;
+		if (zone_watermark_ok(zone, 0,
+				      high_wmark_pages(zone) + nr_pages, 0, 0))
+			return true;
+	}
+	return false;
+}
+
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long node, int **result)
+{
+	/* do not reclaim on behalf of a page that is only misplaced */
+	return alloc_pages_exact_node(node,
+			(GFP_HIGHUSER_MOVABLE | GFP_THISNODE |
+			 __GFP_NOMEMALLOC) & ~GFP_IOFS, 0);
+}
+
+/**
+ * migrate_misplaced_page - move a page to the node that accesses it
+ * @page: page found by a NUMA hinting fault, with a reference held
+ * @node: node to move it to
+ *
+ * Pages mapped by several processes are left where they are, as they
+ * would bounce between the nodes their users run on, and so is everything
+ * while @node is short of memory or has taken its share of migrations.
+ * Consumes the caller's reference to @page.  Returns 1 if the page was
+ * migrated.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	pg_data_t *pgdat = NODE_DATA(node);
+	LIST_HEAD(migratepages);
+	int isolated = 0;
+	int nr_remaining;
+
+	if (page_mapcount(page) != 1)
+		goto out;
+	if (!migrate_balanced_pgdat(pgdat, 1))
+		goto out;
+	if (numamigrate_update_ratelimit(pgdat, 1))
+		goto out;
+	if (isolate_lru_page(page))
+		goto out;
+
+	isolated = 1;
+	inc_zone_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	list_add(&page->lru, &migratepages);
+out:
+	/* an isolated page is pinned by isolate_lru_page() */
+	put_page(page);
+	if (!isolated)
+		return 0;
+
+	nr_remaining = migrate_pages(&migratepages, alloc_misplaced_dst_page,
+				     node, false, false);
+	if (nr_remaining) {
+		putback_lru_pages(&migratepages);
+		return 0;
+	}
+	count_vm_event(NUMA_PAGE_MIGRATE);
+	return 1;
+}
+#endif /* CONFIG_NUMA_BALANCING */
@@ -218,14 +218,23 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 	if (!new_vma)
 		return -ENOMEM;
 
+	/* Keep speculative faults from filling in ptes while they move */
+	vm_write_begin(vma);
+	if (new_vma != vma)
+		vm_write_begin(new_vma);
 	moved_len = move_page_tables(vma, old_addr, new_vma, new_addr, old_len);
-	if (moved_len < old_len) {
+	if (moved_len < old_len)
 		/*
 		 * On error, move entries back from new area to old,
-		 * which will succeed since page tables still there,
-		 * and then proceed to unmap new area instead of old.
+		 * which will succeed since page tables still there.
 		 */
 		move_page_tables(new_vma, new_addr, vma, old_addr, moved_len);
+	if (new_vma != vma)
+		vm_write_end(new_vma);
+	vm_write_end(vma);
+
+	if (moved_len < old_len) {
+		/* and then proceed to unmap new area instead of old. */
 		vma = new_vma;
 		old_len = new_len;
 		old_addr = new_addr;
@@ -63,10 +63,14 @@ static struct vfsmount *shm_mnt;
 #include <linux/highmem.h>
 #include <linux/seq_file.h>
 #include <linux/magic.h>
+#include <linux/khugepaged.h>
+#include <linux/mm_inline.h>
 
 #include <asm/uaccess.h>
 #include <asm/pgtable.h>
 
+#include "internal.h"
+
 #define BLOCKS_PER_PAGE  (PAGE_CACHE_SIZE/512)
 #define VM_ACCT(size)    (PAGE_CACHE_ALIGN(size) >> PAGE_SHIFT)
 
@@ -89,6 +93,7 @@ enum sgp_type {
 	SGP_CACHE,	/* don't exceed i_size, may allocate page */
 	SGP_DIRTY,	/* like SGP_CACHE, but set new page dirty */
 	SGP_WRITE,	/* may exceed i_size, may allocate page */
+	SGP_HUGE,	/* like SGP_CACHE, but may allocate a huge block */
 };
 
 #ifdef CONFIG_TMPFS
@@ -118,6 +123,63 @@ static inline struct shmem_sb_info *SHMEM_SB(struct super_block *sb)
 	return sb->s_fs_info;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Values of the huge= mount option and of shmem_enabled in
+ * /sys/kernel/mm/transparent_hugepage: when to allocate the pages of a file
+ * in naturally aligned blocks of HPAGE_PMD_NR, which are mapped with huge
+ * pmds but remain small pages in the page cache.
+ */
+#define SHMEM_HUGE_NEVER	0	/* never */
+#define SHMEM_HUGE_ALWAYS	1	/* whenever a page is allocated */
+#define SHMEM_HUGE_WITHIN_SIZE	2	/* if the block is within i_size */
+#define SHMEM_HUGE_ADVISE	3	/* in MADV_HUGEPAGE mappings */
+/* shmem_enabled only: override all mounts, for emergencies and testing */
+#define SHMEM_HUGE_DENY		(-1)
+#define SHMEM_HUGE_FORCE	(-2)
+
+/* also the huge= option of the internal mount for SysV and anon shmem */
+static int shmem_huge __read_mostly;
+
+static const char *shmem_format_huge(int huge)
+{
+	switch (huge) {
+	case SHMEM_HUGE_NEVER:
+		return "never";
+	case SHMEM_HUGE_ALWAYS:
+		return "always";
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return "within_size";
+	case SHMEM_HUGE_ADVISE:
+		return "advise";
+	case SHMEM_HUGE_DENY:
+		return "deny";
+	case SHMEM_HUGE_FORCE:
+		return "force";
+	default:
+		VM_BUG_ON(1);
+		return "bad_val";
+	}
+}
+
+static int shmem_parse_huge(const char *str)
+{
+	if (!strcmp(str, "never"))
+		return SHMEM_HUGE_NEVER;
+	if (!strcmp(str, "always"))
+		return SHMEM_HUGE_ALWAYS;
+	if (!strcmp(str, "within_size"))
+		return SHMEM_HUGE_WITHIN_SIZE;
+	if (!strcmp(str, "advise"))
+		return SHMEM_HUGE_ADVISE;
+	if (!strcmp(str, "deny"))
+		return SHMEM_HUGE_DENY;
+	if (!strcmp(str, "force"))
+		return SHMEM_HUGE_FORCE;
+	return -EINVAL;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /*
  * shmem_file_setup pre-accounts the whole fixed size of a VM object,
  * for shared memory and for shared anonymous (/dev/zero) mappings
@@ -796,6 +858,23 @@ static struct page *shmem_alloc_page(gfp_t gfp,
 	 */
 	return alloc_page_vma(gfp, &pvma, 0);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	struct vm_area_struct pvma;
+
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	pvma.vm_pgoff = index;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, index);
+
+	return alloc_pages_vma(gfp, HPAGE_PMD_ORDER, &pvma, 0,
+			       numa_node_id());
+}
+#endif
 #else /* !CONFIG_NUMA */
 #ifdef CONFIG_TMPFS
 static inline void shmem_show_mpol(struct seq_file *seq, struct mempolicy *mpol)
@@ -814,6 +893,14 @@ static inline struct page *shmem_alloc_page(gfp_t gfp,
 {
 	return alloc_page(gfp);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static inline struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	return alloc_pages(gfp, HPAGE_PMD_ORDER);
+}
+#endif
 #endif /* CONFIG_NUMA */
 
 #if !defined(CONFIG_NUMA) || !defined(CONFIG_TMPFS)
@@ -823,6 +910,238 @@ static inline struct mempolicy *shmem_get_sbmpol(struct shmem_sb_info *sbinfo)
 }
 #endif
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Add a new page to the page cache at @index, accounted and zeroed as
+ * shmem_getpage_gfp() does with the pages it allocates itself; the page is
+ * left locked.  On failure the caller still holds the page, to free.
+ */
+static int shmem_add_new_page(struct inode *inode, struct page *page,
+			      pgoff_t index, gfp_t gfp, struct mm_struct *mm)
+{
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	int error;
+
+	if (shmem_acct_block(info->flags))
+		return -ENOSPC;
+	if (sbinfo->max_blocks) {
+		if (percpu_counter_compare(&sbinfo->used_blocks,
+					sbinfo->max_blocks) >= 0) {
+			error = -ENOSPC;
+			goto unacct;
+		}
+		percpu_counter_inc(&sbinfo->used_blocks);
+	}
+
+	SetPageSwapBacked(page);
+	__set_page_locked(page);
+	error = mem_cgroup_cache_charge(page, mm, gfp & GFP_RECLAIM_MASK);
+	if (!error)
+		error = shmem_add_to_page_cache(page, inode->i_mapping, index,
+						gfp, NULL);
+	if (error) {
+		__clear_page_locked(page);
+		goto decused;
+	}
+	lru_cache_add_anon(page);
+
+	spin_lock(&info->lock);
+	info->alloced++;
+	inode->i_blocks += BLOCKS_PER_PAGE;
+	shmem_recalc_inode(inode);
+	spin_unlock(&info->lock);
+
+	clear_highpage(page);
+	flush_dcache_page(page);
+	SetPageUptodate(page);
+	return 0;
+
+decused:
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -1);
+unacct:
+	shmem_unacct_blocks(info->flags, 1);
+	return error;
+}
+
+/*
+ * Take a page added by shmem_add_new_page(), still locked, back out of the
+ * page cache, as shmem_getpage_gfp() does when truncation raced with it.
+ * The caller still holds its own reference to the page.
+ */
+static void shmem_delete_new_page(struct inode *inode, struct page *page)
+{
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+
+	ClearPageDirty(page);
+	delete_from_page_cache(page);
+	spin_lock(&info->lock);
+	info->alloced--;
+	inode->i_blocks -= BLOCKS_PER_PAGE;
+	spin_unlock(&info->lock);
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -1);
+	shmem_unacct_blocks(info->flags, 1);
+}
+
+/* Allocating a block is only worth a little effort, unless asked for */
+static inline gfp_t shmem_huge_gfp(gfp_t gfp, bool defrag)
+{
+	gfp |= __GFP_NOMEMALLOC | __GFP_NORETRY | __GFP_NOWARN |
+		__GFP_NO_KSWAPD;
+	return defrag ? gfp : gfp & ~__GFP_WAIT;
+}
+
+/*
+ * Whether shmem_getpage_gfp() should allocate a whole block for the page at
+ * @index: on SGP_HUGE, after shmem_pmd_fault() checked the policy for its
+ * vma, or as the huge= option of the mount says for any allocation.
+ */
+static bool shmem_should_alloc_huge(struct inode *inode, pgoff_t index,
+				    enum sgp_type sgp)
+{
+	pgoff_t end = round_down(index, HPAGE_PMD_NR) + HPAGE_PMD_NR;
+
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return false;
+	if (sgp == SGP_HUGE || shmem_huge == SHMEM_HUGE_FORCE)
+		return true;
+
+	switch (SHMEM_SB(inode->i_sb)->huge) {
+	case SHMEM_HUGE_ALWAYS:
+		return true;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return end <= DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE);
+	default:
+		return false;
+	}
+}
+
+/*
+ * Allocate the naturally aligned block of HPAGE_PMD_NR pages around @index
+ * and add all its pages to the page cache, as small pages.  Returns the
+ * page at @index locked, or NULL to fall back to allocating that page
+ * alone: when the block is not a hole, would not fit within the limits of
+ * the filesystem, or is not available.
+ */
+static struct page *shmem_alloc_huge(struct inode *inode, pgoff_t index,
+				     gfp_t gfp)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	pgoff_t start = round_down(index, HPAGE_PMD_NR);
+	struct page *block, *page;
+	void **slot;
+	pgoff_t next;
+	bool defrag;
+	int i;
+
+	rcu_read_lock();
+	i = radix_tree_gang_lookup_slot(&mapping->page_tree, &slot, &next,
+					start, 1);
+	rcu_read_unlock();
+	if (i && next < start + HPAGE_PMD_NR)
+		return NULL;
+	if (sbinfo->max_blocks &&
+	    percpu_counter_compare(&sbinfo->used_blocks,
+				   (s64)sbinfo->max_blocks - HPAGE_PMD_NR) > 0)
+		return NULL;
+
+	defrag = transparent_hugepage_flags &
+		 (1 << TRANSPARENT_HUGEPAGE_DEFRAG_FLAG);
+	block = shmem_alloc_hugepage(shmem_huge_gfp(gfp, defrag),
+				     SHMEM_I(inode), start);
+	if (!block) {
+		count_vm_event(THP_FILE_FALLBACK);
+		return NULL;
+	}
+	count_vm_event(THP_FILE_ALLOC);
+	split_page(block, HPAGE_PMD_ORDER);
+
+	page = block + (index - start);
+	if (shmem_add_new_page(inode, page, index, gfp, current->mm)) {
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			put_page(block + i);
+		return NULL;
+	}
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		struct page *p = block + i;
+
+		if (p == page)
+			continue;
+		/* a page that raced in just keeps the block from a pmd */
+		if (shmem_add_new_page(inode, p, start + i, gfp,
+				       current->mm)) {
+			put_page(p);
+			continue;
+		}
+		unlock_page(p);
+		page_cache_release(p);
+	}
+	return page;
+}
+
+/*
+ * Find room for a shared mapping of shmem in which its blocks can be mapped
+ * with huge pmds: where an index aligned to HPAGE_PMD_NR is mapped at an
+ * address aligned to HPAGE_PMD_SIZE.  Returns 0 to leave the choice to the
+ * mm, when the mount does not allocate blocks or the caller chose already.
+ */
+static unsigned long shmem_huge_unmapped_area(struct file *file,
+		unsigned long addr, unsigned long len, unsigned long pgoff,
+		unsigned long flags)
+{
+	struct super_block *sb;
+	unsigned long area;
+
+	if (addr || (flags & MAP_FIXED) || !(flags & MAP_SHARED))
+		return 0;
+	if (len < HPAGE_PMD_SIZE || len > TASK_SIZE - HPAGE_PMD_SIZE)
+		return 0;
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return 0;
+	if (shmem_huge != SHMEM_HUGE_FORCE) {
+		/* shared anonymous memory is about to get a file there */
+		if (file)
+			sb = file->f_path.dentry->d_inode->i_sb;
+		else if (!IS_ERR(shm_mnt))
+			sb = shm_mnt->mnt_sb;
+		else
+			return 0;
+		if (SHMEM_SB(sb)->huge == SHMEM_HUGE_NEVER)
+			return 0;
+	}
+
+	/* ask for a block more, to move up to the first aligned start in it */
+	area = current->mm->get_unmapped_area(file, 0, len + HPAGE_PMD_SIZE,
+					      pgoff, flags);
+	if (IS_ERR_VALUE(area) || (area & ~PAGE_MASK))
+		return 0;
+	return area + (((pgoff << PAGE_SHIFT) - area) & ~HPAGE_PMD_MASK);
+}
+#else
+static inline bool shmem_should_alloc_huge(struct inode *inode,
+					   pgoff_t index, enum sgp_type sgp)
+{
+	return false;
+}
+
+static inline struct page *shmem_alloc_huge(struct inode *inode,
+					    pgoff_t index, gfp_t gfp)
+{
+	return NULL;
+}
+
+static inline unsigned long shmem_huge_unmapped_area(struct file *file,
+		unsigned long addr, unsigned long len, unsigned long pgoff,
+		unsigned long flags)
+{
+	return 0;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /*
  * shmem_getpage_gfp - find page in cache, or get from swap, or allocate
  *
@@ -924,6 +1243,15 @@ repeat:
 		swap_free(swap);
 
 	} else {
+		if (shmem_should_alloc_huge(inode, index, sgp)) {
+			page = shmem_alloc_huge(inode, index, gfp);
+			if (page) {
+				if (sgp == SGP_DIRTY)
+					set_page_dirty(page);
+				goto done;
+			}
+		}
+
 		if (shmem_acct_block(info->flags)) {
 			error = -ENOSPC;
 			goto failed;
@@ -1033,6 +1361,254 @@ static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Whether the pages of a shared mapping of shmem should be mapped with huge
+ * pmds, allocating them in blocks as needed, and collapsed by khugepaged.
+ */
+bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	pgoff_t index;
+
+	/* vma_adjust_trans_huge() splits huge pmds of VM_SHARED vmas only */
+	if (!(vma->vm_flags & VM_SHARED))
+		return false;
+	if (shmem_huge == SHMEM_HUGE_FORCE)
+		return true;
+	if (shmem_huge == SHMEM_HUGE_DENY || (vma->vm_flags & VM_NOHUGEPAGE))
+		return false;
+
+	switch (SHMEM_SB(inode->i_sb)->huge) {
+	case SHMEM_HUGE_ALWAYS:
+		return true;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		/* the first block of the mapping must be within i_size */
+		index = round_up(vma->vm_pgoff, HPAGE_PMD_NR) + HPAGE_PMD_NR;
+		if (index <= DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE))
+			return true;
+		/* fall through */
+	case SHMEM_HUGE_ADVISE:
+		return vma->vm_flags & VM_HUGEPAGE;
+	default:
+		return false;
+	}
+}
+
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *page;
+	pgoff_t index;
+	int ret = 0;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end ||
+	    (vma->vm_flags & VM_NONLINEAR))
+		return VM_FAULT_FALLBACK;
+	index = linear_page_index(vma, haddr);
+	if ((index & (HPAGE_PMD_NR - 1)) || !shmem_huge_enabled(vma))
+		return VM_FAULT_FALLBACK;
+
+	/* errors are for shmem_fault() to report */
+	if (shmem_getpage(inode, index, &page, SGP_HUGE, &ret))
+		return VM_FAULT_FALLBACK;
+
+	ret = do_huge_pmd_file_page(vma->vm_mm, vma, haddr, pmd, page, flags);
+	unlock_page(page);
+	if (ret)
+		page_cache_release(page);
+	return ret;
+}
+
+struct shmem_collapse_control {
+	struct page *block;		/* the pages to collapse into */
+	pgoff_t index;			/* page cache index of the first */
+	unsigned long pfn;		/* block the pages present are in */
+	struct list_head pages;		/* pages isolated for migration */
+	DECLARE_BITMAP(used, HPAGE_PMD_NR);	/* block pages taken */
+};
+
+static struct page *shmem_collapse_new_page(struct page *page,
+					    unsigned long private,
+					    int **result)
+{
+	struct shmem_collapse_control *cc = (void *)private;
+	pgoff_t offset = page->index - cc->index;
+
+	if (offset >= HPAGE_PMD_NR || test_and_set_bit(offset, cc->used))
+		return NULL;
+	return cc->block + offset;
+}
+
+/*
+ * Call @fn on each page of the HPAGE_PMD_NR from cc->index in the page
+ * cache, with its offset in the range.  Returns -EAGAIN if some are in
+ * swap, else how many pages are present.
+ */
+static int shmem_walk_huge(struct address_space *mapping,
+		struct shmem_collapse_control *cc,
+		void (*fn)(struct page *page, pgoff_t offset,
+			   struct shmem_collapse_control *cc))
+{
+	struct pagevec pvec;
+	pgoff_t indices[PAGEVEC_SIZE];
+	pgoff_t start = cc->index, end = cc->index + HPAGE_PMD_NR;
+	int i, present = 0, ret = 0;
+
+	pagevec_init(&pvec, 0);
+	while (start < end) {
+		pvec.nr = shmem_find_get_pages_and_swap(mapping, start,
+				min(end - start, (pgoff_t)PAGEVEC_SIZE),
+				pvec.pages, indices);
+		if (!pvec.nr)
+			break;
+		start = indices[pvec.nr - 1] + 1;
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+
+			if (indices[i] >= end)
+				break;
+			if (radix_tree_exceptional_entry(page)) {
+				ret = -EAGAIN;
+				continue;
+			}
+			present++;
+			fn(page, indices[i] - cc->index, cc);
+		}
+		shmem_pagevec_release(&pvec);
+		cond_resched();
+	}
+	return ret ? ret : present;
+}
+
+static void shmem_check_block(struct page *page, pgoff_t offset,
+			      struct shmem_collapse_control *cc)
+{
+	unsigned long pfn = page_to_pfn(page) - offset;
+
+	if (!offset && !(pfn & (HPAGE_PMD_NR - 1)))
+		cc->pfn = pfn;
+	if (pfn != cc->pfn)
+		cc->pfn = -1UL;
+}
+
+static void shmem_isolate_for_collapse(struct page *page, pgoff_t offset,
+				       struct shmem_collapse_control *cc)
+{
+	__set_bit(offset, cc->used);
+	if (isolate_lru_page(page))
+		return;
+	inc_zone_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	list_add_tail(&page->lru, &cc->pages);
+}
+
+/*
+ * Make the HPAGE_PMD_NR pages of @inode from @index, which is aligned, one
+ * naturally aligned physically contiguous block, that shmem_pmd_fault() can
+ * map with a huge pmd: allocate a new block, fill the holes of the range
+ * from it, up to @max_ptes_none of them, and migrate the pages present into
+ * it.  Ranges with pages in swap are left alone.  Returns 1 if the range
+ * was collapsed, 0 if it was a block already, or a negative errno.
+ */
+int shmem_collapse_huge(struct inode *inode, pgoff_t index,
+			struct mm_struct *mm, unsigned int max_ptes_none)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_collapse_control cc;
+	DECLARE_BITMAP(added, HPAGE_PMD_NR);
+	gfp_t gfp = mapping_gfp_mask(mapping);
+	bool shrunk;
+	int i, present;
+
+	VM_BUG_ON(index & (HPAGE_PMD_NR - 1));
+	if (index + HPAGE_PMD_NR >
+	    DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE))
+		return -EINVAL;
+
+	cc.index = index;
+	cc.pfn = -1UL;
+	present = shmem_walk_huge(mapping, &cc, shmem_check_block);
+	if (present < 0)
+		return present;
+	if (present == HPAGE_PMD_NR && cc.pfn != -1UL)
+		return 0;
+	if (HPAGE_PMD_NR - present > max_ptes_none)
+		return -EAGAIN;
+
+	cc.block = shmem_alloc_hugepage(shmem_huge_gfp(gfp,
+						       khugepaged_defrag()),
+					SHMEM_I(inode), index);
+	if (!cc.block) {
+		count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+		return -ENOMEM;
+	}
+	count_vm_event(THP_COLLAPSE_ALLOC);
+	split_page(cc.block, HPAGE_PMD_ORDER);
+
+	/* the bits of the pages present keep them apart from the holes */
+	bitmap_zero(cc.used, HPAGE_PMD_NR);
+	INIT_LIST_HEAD(&cc.pages);
+	lru_add_drain();
+	shmem_walk_huge(mapping, &cc, shmem_isolate_for_collapse);
+
+	bitmap_zero(added, HPAGE_PMD_NR);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		struct page *page = cc.block + i;
+
+		if (test_bit(i, cc.used))
+			continue;
+		/* a page that raced in keeps the range from collapsing */
+		if (shmem_add_new_page(inode, page, index + i, gfp, mm))
+			continue;
+		__set_bit(i, cc.used);
+		__set_bit(i, added);
+	}
+
+	/*
+	 * Perhaps the file has been truncated since we checked.  The new
+	 * pages are still locked, so either truncation finds them in the page
+	 * cache or we see its new i_size here, as in shmem_getpage_gfp().  On
+	 * a shrunk file they go again, and our reference is dropped below.
+	 */
+	shrunk = index + HPAGE_PMD_NR >
+		 DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE);
+	for_each_set_bit(i, added, HPAGE_PMD_NR) {
+		struct page *page = cc.block + i;
+
+		if (shrunk)
+			shmem_delete_new_page(inode, page);
+		unlock_page(page);
+		if (!shrunk)
+			page_cache_release(page);
+	}
+
+	/* only the block pages now in the page cache stay taken */
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (cc.block[i].mapping != mapping)
+			__clear_bit(i, cc.used);
+
+	if (!list_empty(&cc.pages) &&
+	    (shrunk || migrate_pages(&cc.pages, shmem_collapse_new_page,
+				     (unsigned long)&cc, false, true)))
+		putback_lru_pages(&cc.pages);
+
+	/* migration took or freed the block pages it was given */
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (!test_bit(i, cc.used))
+			put_page(cc.block + i);
+	if (shrunk)
+		return -EINVAL;
+
+	cc.pfn = -1UL;
+	present = shmem_walk_huge(mapping, &cc, shmem_check_block);
+	if (present != HPAGE_PMD_NR || cc.pfn != page_to_pfn(cc.block))
+		return -EINVAL;
+	return 1;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 #ifdef CONFIG_NUMA
 static int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *mpol)
 {
@@ -1083,11 +1659,17 @@ out_nomem:
 	return retval;
 }
 
+bool shmem_mapping(struct address_space *mapping)
+{
+	return mapping->a_ops == &shmem_aops;
+}
+
 static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	file_accessed(file);
 	vma->vm_ops = &shmem_vm_ops;
 	vma->vm_flags |= VM_CAN_NONLINEAR;
+	khugepaged_enter_vma_merge(vma);
 	return 0;
 }
 
@@ -2065,6 +2647,17 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		} else if (!strcmp(this_char,"huge")) {
+			int huge = shmem_parse_huge(value);
+
+			if (huge < 0)
+				goto bad_val;
+			if (!has_transparent_hugepage() &&
+			    huge != SHMEM_HUGE_NEVER)
+				goto bad_val;
+			sbinfo->huge = huge;
+#endif
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2110,6 +2703,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge        = config.huge;
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
@@ -2133,6 +2727,10 @@ static int shmem_show_options(struct seq_file *seq, struct vfsmount *vfs)
 		seq_printf(seq, ",uid=%u", sbinfo->uid);
 	if (sbinfo->gid != 0)
 		seq_printf(seq, ",gid=%u", sbinfo->gid);
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=%s", shmem_format_huge(sbinfo->huge));
+#endif
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -2255,7 +2853,7 @@ static int shmem_init_inodecache(void)
 {
 	shmem_inode_cachep = kmem_cache_create("shmem_inode_cache",
 				sizeof(struct shmem_inode_info),
-				0, SLAB_PANIC, shmem_init_inode);
+				0, SLAB_PANIC|SLAB_ACCOUNT, shmem_init_inode);
 	return 0;
 }
 
@@ -2277,6 +2875,7 @@ static const struct address_space_operations shmem_aops = {
 
 static const struct file_operations shmem_file_operations = {
 	.mmap		= shmem_mmap,
+	.get_unmapped_area = shmem_get_unmapped_area,
 #ifdef CONFIG_TMPFS
 	.llseek		= generic_file_llseek,
 	.read		= do_sync_read,
@@ -2350,6 +2949,9 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -2394,6 +2996,12 @@ int __init shmem_init(void)
 		printk(KERN_ERR "Could not kern_mount tmpfs\n");
 		goto out1;
 	}
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (!has_transparent_hugepage())
+		shmem_huge = SHMEM_HUGE_NEVER;
+	else if (shmem_huge > SHMEM_HUGE_DENY)
+		SHMEM_SB(shm_mnt->mnt_sb)->huge = shmem_huge;
+#endif
 	return 0;
 
 out1:
@@ -2407,6 +3015,76 @@ out4:
 	return error;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static int __init setup_transparent_hugepage_shmem(char *str)
+{
+	int huge = shmem_parse_huge(str);
+
+	if (huge == -EINVAL) {
+		printk(KERN_WARNING
+		       "transparent_hugepage_shmem= cannot parse, ignored\n");
+		return 0;
+	}
+	shmem_huge = huge;
+	return 1;
+}
+__setup("transparent_hugepage_shmem=", setup_transparent_hugepage_shmem);
+#endif
+
+#if defined(CONFIG_TRANSPARENT_HUGEPAGE) && defined(CONFIG_SYSFS)
+static ssize_t shmem_enabled_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	int values[] = {
+		SHMEM_HUGE_ALWAYS,
+		SHMEM_HUGE_WITHIN_SIZE,
+		SHMEM_HUGE_ADVISE,
+		SHMEM_HUGE_NEVER,
+		SHMEM_HUGE_DENY,
+		SHMEM_HUGE_FORCE,
+	};
+	int i, count;
+
+	for (i = 0, count = 0; i < ARRAY_SIZE(values); i++) {
+		const char *fmt = shmem_huge == values[i] ? "[%s] " : "%s ";
+
+		count += sprintf(buf + count, fmt,
+				 shmem_format_huge(values[i]));
+	}
+	buf[count - 1] = '\n';
+	return count;
+}
+
+static ssize_t shmem_enabled_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	char tmp[16];
+	int huge;
+
+	if (count + 1 > sizeof(tmp))
+		return -EINVAL;
+	memcpy(tmp, buf, count);
+	tmp[count] = '\0';
+	if (count && tmp[count - 1] == '\n')
+		tmp[count - 1] = '\0';
+
+	huge = shmem_parse_huge(tmp);
+	if (huge == -EINVAL)
+		return -EINVAL;
+	if (!has_transparent_hugepage() &&
+	    huge != SHMEM_HUGE_NEVER && huge != SHMEM_HUGE_DENY)
+		return -EINVAL;
+
+	shmem_huge = huge;
+	if (shmem_huge > SHMEM_HUGE_DENY)
+		SHMEM_SB(shm_mnt->mnt_sb)->huge = shmem_huge;
+	return count;
+}
+
+struct kobj_attribute shmem_enabled_attr =
+	__ATTR(shmem_enabled, 0644, shmem_enabled_show, shmem_enabled_store);
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE && CONFIG_SYSFS */
+
 #else /* !CONFIG_SHMEM */
 
 /*
@@ -2441,6 +3119,11 @@ int shmem_unuse(swp_entry_t swap, struct page *page)
 	return 0;
 }
 
+bool shmem_mapping(struct address_space *mapping)
+{
+	return false;
+}
+
 int shmem_lock(struct file *file, int lock, struct user_struct *user)
 {
 	return 0;
@@ -2454,6 +3137,7 @@ EXPORT_SYMBOL_GPL(shmem_truncate_range);
 
 #define shmem_vm_ops				generic_file_vm_ops
 #define shmem_file_operations			ramfs_file_operations
+#define shmem_huge_unmapped_area(file, addr, len, pgoff, flags)	0
 #define shmem_get_inode(sb, dir, mode, dev, flags)	ramfs_get_inode(sb, dir, mode, dev)
 #define shmem_acct_size(flags, size)		0
 #define shmem_unacct_size(flags, size)		do {} while (0)
@@ -2544,9 +3228,35 @@ int shmem_zero_setup(struct vm_area_struct *vma)
 	vma->vm_file = file;
 	vma->vm_ops = &shmem_vm_ops;
 	vma->vm_flags |= VM_CAN_NONLINEAR;
+	khugepaged_enter_vma_merge(vma);
 	return 0;
 }
 
+#ifdef CONFIG_MMU
+/**
+ * shmem_get_unmapped_area - get an address for a mapping of shmem
+ * @file: the shmem file, or NULL for a shared anonymous mapping
+ * @addr: the address asked for, if any
+ * @len: the length of the mapping
+ * @pgoff: the offset of the mapping in the file
+ * @flags: the mmap flags
+ *
+ * Shared mappings are aligned so that shmem_pmd_fault() can map their
+ * blocks with huge pmds, when huge pages are enabled for the mount.
+ */
+unsigned long shmem_get_unmapped_area(struct file *file, unsigned long addr,
+				      unsigned long len, unsigned long pgoff,
+				      unsigned long flags)
+{
+	unsigned long area;
+
+	area = shmem_huge_unmapped_area(file, addr, len, pgoff, flags);
+	if (area)
+		return area;
+	return current->mm->get_unmapped_area(file, addr, len, pgoff, flags);
+}
+#endif
+
 /**
  * shmem_read_mapping_page_gfp - read into page cache, using specified page allocation flags.
  * @mapping:	the page's address_space
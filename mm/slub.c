@@ -29,6 +29,7 @@
 #include <linux/math64.h>
 #include <linux/fault-inject.h>
 #include <linux/stacktrace.h>
+#include <linux/memcontrol.h>
 
 #include <trace/events/kmem.h>
 
@@ -165,7 +166,7 @@ static inline int kmem_cache_debug(struct kmem_cache *s)
 		SLAB_FAILSLAB)
 
 #define SLUB_MERGE_SAME (SLAB_DEBUG_FREE | SLAB_RECLAIM_ACCOUNT | \
-		SLAB_CACHE_DMA | SLAB_NOTRACK)
+		SLAB_CACHE_DMA | SLAB_NOTRACK | SLAB_ACCOUNT)
 
 #define OO_SHIFT	16
 #define OO_MASK		((1 << OO_SHIFT) - 1)
@@ -208,6 +209,14 @@ struct track {
 
 enum track_item { TRACK_ALLOC, TRACK_FREE };
 
+static inline void memcg_free_cache_params(struct kmem_cache *s)
+{
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	kfree(s->memcg_caches);
+	kfree(s->memcg_params);
+#endif
+}
+
 #ifdef CONFIG_SYSFS
 static int sysfs_slab_add(struct kmem_cache *);
 static int sysfs_slab_alias(struct kmem_cache *, const char *);
@@ -219,6 +228,7 @@ static inline int sysfs_slab_alias(struct kmem_cache *s, const char *p)
 							{ return 0; }
 static inline void sysfs_slab_remove(struct kmem_cache *s)
 {
+	memcg_free_cache_params(s);
 	kfree(s->name);
 	kfree(s);
 }
@@ -1258,6 +1268,67 @@ static inline void slab_free_hook(struct kmem_cache *s, void *x) {}
 
 #endif /* CONFIG_SLUB_DEBUG */
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+static inline bool is_root_cache(struct kmem_cache *s)
+{
+	return !s->memcg_params;
+}
+
+/*
+ * Accounted allocations are served from the per-memcg copy of the cache,
+ * see __memcg_kmem_get_cache().
+ */
+static __always_inline struct kmem_cache *
+memcg_slab_get_cache(struct kmem_cache *s, gfp_t flags)
+{
+	if (memcg_kmem_enabled() &&
+	    ((s->flags & SLAB_ACCOUNT) || (flags & __GFP_ACCOUNT)))
+		return __memcg_kmem_get_cache(s, flags);
+	return s;
+}
+
+static __always_inline void memcg_slab_put_cache(struct kmem_cache *s)
+{
+	if (!is_root_cache(s))
+		__memcg_kmem_put_cache(s);
+}
+
+static inline int memcg_slab_charge(struct kmem_cache *s, gfp_t flags,
+				    int order)
+{
+	if (is_root_cache(s))
+		return 0;
+	return memcg_charge_slab(s, flags, order);
+}
+
+static inline void memcg_slab_uncharge(struct kmem_cache *s, int order)
+{
+	if (!is_root_cache(s))
+		memcg_uncharge_slab(s, order);
+}
+#else
+static inline bool is_root_cache(struct kmem_cache *s)
+{
+	return true;
+}
+
+static inline struct kmem_cache *
+memcg_slab_get_cache(struct kmem_cache *s, gfp_t flags)
+{
+	return s;
+}
+
+static inline void memcg_slab_put_cache(struct kmem_cache *s) {}
+
+static inline int memcg_slab_charge(struct kmem_cache *s, gfp_t flags,
+				    int order)
+{
+	return 0;
+}
+
+static inline void memcg_slab_uncharge(struct kmem_cache *s, int order) {}
+#endif /* CONFIG_CGROUP_MEM_RES_CTLR_KMEM */
+
 /*
  * Slab allocation and freeing
  */
@@ -1285,6 +1356,11 @@ static struct page *allocate_slab(struct kmem_cache *s, gfp_t flags, int node)
 	if (flags & __GFP_WAIT)
 		local_irq_enable();
 
+	/*
+	 * Slab pages are only accounted through the per-memcg caches, by
+	 * memcg_slab_charge(): the page allocator must not charge them too.
+	 */
+	flags &= ~__GFP_ACCOUNT;
 	flags |= s->allocflags;
 
 	/*
@@ -1306,6 +1382,11 @@ static struct page *allocate_slab(struct kmem_cache *s, gfp_t flags, int node)
 			stat(s, ORDER_FALLBACK);
 	}
 
+	if (page && unlikely(memcg_slab_charge(s, flags, oo_order(oo)))) {
+		__free_pages(page, oo_order(oo));
+		page = NULL;
+	}
+
 	if (flags & __GFP_WAIT)
 		local_irq_disable();
 
@@ -1410,6 +1491,8 @@ static void __free_slab(struct kmem_cache *s, struct page *page)
 	if (current->reclaim_state)
 		current->reclaim_state->reclaimed_slab += pages;
 	__free_pages(page, order);
+	/* may free a dead per-memcg cache, so comes last */
+	memcg_slab_uncharge(s, order);
 }
 
 #define need_reserve_slab_rcu						\
@@ -1791,7 +1874,7 @@ redo:
 
 	new.frozen = 0;
 
-	if (!new.inuse && n->nr_partial > s->min_partial)
+	if (!new.inuse && n->nr_partial >= s->min_partial)
 		m = M_FREE;
 	else if (new.freelist) {
 		m = M_PARTIAL;
@@ -1884,7 +1967,7 @@ static void unfreeze_partials(struct kmem_cache *s)
 
 			new.frozen = 0;
 
-			if (!new.inuse && (!n || n->nr_partial > s->min_partial))
+			if (!new.inuse && (!n || n->nr_partial >= s->min_partial))
 				m = M_FREE;
 			else {
 				struct kmem_cache_node *n2 = get_node(s,
@@ -1980,6 +2063,15 @@ int put_cpu_partial(struct kmem_cache *s, struct page *page, int drain)
 
 	} while (irqsafe_cpu_cmpxchg(s->cpu_slab->partial, oldpage, page) != oldpage);
 	stat(s, CPU_PARTIAL_FREE);
+
+	/* not caching partial slabs per cpu, e.g. a dying per-memcg cache */
+	if (unlikely(!s->cpu_partial)) {
+		unsigned long flags;
+
+		local_irq_save(flags);
+		unfreeze_partials(s);
+		local_irq_restore(flags);
+	}
 	return pobjects;
 }
 
@@ -2267,6 +2359,7 @@ static __always_inline void *slab_alloc(struct kmem_cache *s,
 	if (slab_pre_alloc_hook(s, gfpflags))
 		return NULL;
 
+	s = memcg_slab_get_cache(s, gfpflags);
 redo:
 
 	/*
@@ -2319,6 +2412,7 @@ redo:
 		memset(object, 0, s->objsize);
 
 	slab_post_alloc_hook(s, gfpflags, object);
+	memcg_slab_put_cache(s);
 
 	return object;
 }
@@ -2385,12 +2479,15 @@ EXPORT_SYMBOL(kmem_cache_alloc_node_trace);
  * So we still attempt to reduce cache line usage. Just take the slab
  * lock and free the item. If there is no additional partial page
  * handling required then we can return immediately.
+ *
+ * @head to @tail is a freelist of @cnt objects of the same slab page,
+ * already linked through their free pointers.  Only single objects are
+ * freed to caches with debugging enabled.
  */
 static void __slab_free(struct kmem_cache *s, struct page *page,
-			void *x, unsigned long addr)
+			void *head, void *tail, int cnt, unsigned long addr)
 {
 	void *prior;
-	void **object = (void *)x;
 	int was_frozen;
 	int inuse;
 	struct page new;
@@ -2400,16 +2497,16 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 	stat(s, FREE_SLOWPATH);
 
-	if (kmem_cache_debug(s) && !free_debug_processing(s, page, x, addr))
+	if (kmem_cache_debug(s) && !free_debug_processing(s, page, head, addr))
 		return;
 
 	do {
 		prior = page->freelist;
 		counters = page->counters;
-		set_freepointer(s, object, prior);
+		set_freepointer(s, tail, prior);
 		new.counters = counters;
 		was_frozen = new.frozen;
-		new.inuse--;
+		new.inuse -= cnt;
 		if ((!new.inuse || !prior) && !was_frozen && !n) {
 
 			if (!kmem_cache_debug(s) && !prior)
@@ -2439,7 +2536,7 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 	} while (!cmpxchg_double_slab(s, page,
 		prior, counters,
-		object, new.counters,
+		head, new.counters,
 		"__slab_free"));
 
 	if (likely(!n)) {
@@ -2467,7 +2564,7 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 	if (was_frozen)
 		stat(s, FREE_FROZEN);
 	else {
-		if (unlikely(!inuse && n->nr_partial > s->min_partial))
+		if (unlikely(!inuse && n->nr_partial >= s->min_partial))
                         goto slab_empty;
 
 		/*
@@ -2509,16 +2606,19 @@ slab_empty:
  *
  * If fastpath is not possible then fall back to __slab_free where we deal
  * with all sorts of special processing.
+ *
+ * A whole freelist @head to @tail of @cnt objects of @page is freed with a
+ * single cmpxchg; @tail is NULL when freeing the single object @head.  The
+ * free hooks must have been run on every object already.
  */
-static __always_inline void slab_free(struct kmem_cache *s,
-			struct page *page, void *x, unsigned long addr)
+static __always_inline void do_slab_free(struct kmem_cache *s,
+			struct page *page, void *head, void *tail, int cnt,
+			unsigned long addr)
 {
-	void **object = (void *)x;
+	void *tail_obj = tail ? : head;
 	struct kmem_cache_cpu *c;
 	unsigned long tid;
 
-	slab_free_hook(s, x);
-
 redo:
 	/*
 	 * Determine the currently cpus per cpu slab.
@@ -2532,27 +2632,37 @@ redo:
 	barrier();
 
 	if (likely(page == c->page)) {
-		set_freepointer(s, object, c->freelist);
+		set_freepointer(s, tail_obj, c->freelist);
 
 		if (unlikely(!irqsafe_cpu_cmpxchg_double(
 				s->cpu_slab->freelist, s->cpu_slab->tid,
 				c->freelist, tid,
-				object, next_tid(tid)))) {
+				head, next_tid(tid)))) {
 
 			note_cmpxchg_failure("slab_free", s, tid);
 			goto redo;
 		}
 		stat(s, FREE_FASTPATH);
 	} else
-		__slab_free(s, page, x, addr);
+		__slab_free(s, page, head, tail_obj, cnt, addr);
 
 }
 
+static __always_inline void slab_free(struct kmem_cache *s,
+			struct page *page, void *x, unsigned long addr)
+{
+	slab_free_hook(s, x);
+	do_slab_free(s, page, x, NULL, 1, addr);
+}
+
 void kmem_cache_free(struct kmem_cache *s, void *x)
 {
 	struct page *page;
 
 	page = virt_to_head_page(x);
+	/* objects of per-memcg copies are freed to their own cache */
+	if (memcg_kmem_enabled())
+		s = page->slab;
 
 	slab_free(s, page, x, _RET_IP_);
 
@@ -2560,6 +2670,167 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+struct detached_freelist {
+	struct kmem_cache *s;
+	struct page *page;
+	void *freelist;
+	void *tail;
+	int cnt;
+};
+
+/*
+ * Link the objects at the end of @p that live in the same slab page into
+ * a freelist @df, looking ahead a few objects past ones that do not. The
+ * entries taken are cleared in @p. Returns the number of entries of @p
+ * that still have to be looked at.
+ */
+static inline size_t build_detached_freelist(struct kmem_cache *s,
+		size_t size, void **p, struct detached_freelist *df)
+{
+	size_t first_skipped_index = 0;
+	int lookahead = 3;
+	void *object;
+
+	df->page = NULL;
+
+	do {
+		object = p[--size];
+	} while (!object && size);
+
+	if (!object)
+		return 0;
+
+	df->page = virt_to_head_page(object);
+	/* objects of per-memcg copies are freed to their own cache */
+	df->s = memcg_kmem_enabled() ? df->page->slab : s;
+
+	slab_free_hook(df->s, object);
+	set_freepointer(df->s, object, NULL);
+	df->freelist = object;
+	df->tail = object;
+	df->cnt = 1;
+	p[size] = NULL;
+
+	/* debug processing in __slab_free() handles single objects only */
+	if (kmem_cache_debug(df->s))
+		return size;
+
+	while (size) {
+		object = p[--size];
+		if (!object)
+			continue;	/* already freed */
+
+		if (virt_to_head_page(object) == df->page) {
+			slab_free_hook(df->s, object);
+			set_freepointer(df->s, object, df->freelist);
+			df->freelist = object;
+			df->cnt++;
+			p[size] = NULL;
+			continue;
+		}
+
+		if (!--lookahead)
+			break;
+
+		if (!first_skipped_index)
+			first_skipped_index = size + 1;
+	}
+
+	return first_skipped_index;
+}
+
+/*
+ * Free the @size objects in @p, which are cleared in the process. The
+ * objects of one slab page are returned to it with a single cmpxchg,
+ * taking the list_lock at most once for the whole batch.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct detached_freelist df;
+
+	while (size) {
+		size = build_detached_freelist(s, size, p, &df);
+		if (!df.page)
+			continue;
+
+		do_slab_free(df.s, df.page, df.freelist, df.tail, df.cnt,
+			     _RET_IP_);
+	}
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+/*
+ * Allocate @size objects into @p. The per cpu freelist is drained with
+ * interrupts disabled instead of taking one object per cmpxchg_double,
+ * refilling it from the per cpu partial slabs and then the node lists
+ * as needed. Returns @size, or 0 if not all objects could be allocated,
+ * in which case none are.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long irqflags;
+	size_t i;
+
+	if (slab_pre_alloc_hook(s, flags))
+		return 0;
+
+	s = memcg_slab_get_cache(s, flags);
+
+	/*
+	 * Disabling interrupts keeps out both preemption and the fastpaths
+	 * of interrupt handlers, so the per cpu freelist can be taken
+	 * from without a cmpxchg.
+	 */
+	local_irq_save(irqflags);
+	c = this_cpu_ptr(s->cpu_slab);
+
+	for (i = 0; i < size; i++) {
+		void *object = c->freelist;
+
+		if (unlikely(!object)) {
+			/*
+			 * The slow path may enable interrupts and move us to
+			 * another cpu: make the fastpath of anybody who saw
+			 * this freelist before we took from it retry.
+			 */
+			c->tid = next_tid(c->tid);
+			p[i] = __slab_alloc(s, flags, NUMA_NO_NODE, _RET_IP_, c);
+			if (unlikely(!p[i]))
+				goto error;
+
+			c = this_cpu_ptr(s->cpu_slab);
+			continue;
+		}
+		c->freelist = get_freepointer(s, object);
+		p[i] = object;
+		stat(s, ALLOC_FASTPATH);
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_restore(irqflags);
+
+	for (i = 0; i < size; i++) {
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, s->objsize);
+		slab_post_alloc_hook(s, flags, p[i]);
+	}
+	memcg_slab_put_cache(s);
+
+	return size;
+
+error:
+	local_irq_restore(irqflags);
+	size = i;
+	for (i = 0; i < size; i++)
+		slab_post_alloc_hook(s, flags, p[i]);
+	kmem_cache_free_bulk(s, size, p);
+	memcg_slab_put_cache(s);
+
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /*
  * Object placement in a slab is made very easy because we always start at
  * offset 0. If we tune the size of the object to the alignment then we can
@@ -3145,6 +3416,9 @@ void kmem_cache_destroy(struct kmem_cache *s)
 	if (!s->refcount) {
 		list_del(&s->list);
 		up_write(&slub_lock);
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+		memcg_destroy_child_caches(s);
+#endif
 		if (kmem_cache_close(s)) {
 			printk(KERN_ERR "SLUB %s: %s called for cache that "
 				"still has objects.\n", s->name, __func__);
@@ -3825,6 +4099,10 @@ static int slab_unmergeable(struct kmem_cache *s)
 	if (s->refcount < 0)
 		return 1;
 
+	/* per-memcg copies are private to their memcg */
+	if (!is_root_cache(s))
+		return 1;
+
 	return 0;
 }
 
@@ -3929,6 +4207,60 @@ err:
 }
 EXPORT_SYMBOL(kmem_cache_create);
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+/*
+ * Create the copy of @root that a memcg allocates its objects from.  It
+ * takes over @params on success.
+ */
+struct kmem_cache *kmem_cache_create_memcg(struct kmem_cache *root,
+		const char *name, struct memcg_cache_params *params)
+{
+	struct kmem_cache *s;
+	char *n;
+
+	n = kstrdup(name, GFP_KERNEL);
+	if (!n)
+		return NULL;
+
+	s = kmalloc(kmem_size, GFP_KERNEL);
+	if (!s)
+		goto err;
+
+	down_write(&slub_lock);
+	if (!kmem_cache_open(s, n, root->objsize, root->align,
+			     root->flags & ~SLAB_PANIC, root->ctor)) {
+		up_write(&slub_lock);
+		goto err;
+	}
+	/* before the cache can be found through sysfs */
+	s->memcg_params = params;
+	list_add(&s->list, &slab_caches);
+	if (sysfs_slab_add(s)) {
+		list_del(&s->list);
+		up_write(&slub_lock);
+		kmem_cache_close(s);
+		goto err;
+	}
+	up_write(&slub_lock);
+	return s;
+err:
+	kfree(s);
+	kfree(n);
+	return NULL;
+}
+
+/*
+ * The memcg of a per-memcg cache is gone.  Stop keeping free slabs around
+ * so that the cache empties out as its remaining objects are freed.
+ */
+void kmem_cache_deactivate_memcg(struct kmem_cache *s)
+{
+	s->cpu_partial = 0;
+	s->min_partial = 0;
+	kmem_cache_shrink(s);
+}
+#endif
+
 #ifdef CONFIG_SMP
 /*
  * Use the cpu notifier to insure that the cpu slabs are flushed when
@@ -5153,6 +5485,7 @@ static void kmem_cache_release(struct kobject *kobj)
 {
 	struct kmem_cache *s = to_slab(kobj);
 
+	memcg_free_cache_params(s);
 	kfree(s->name);
 	kfree(s);
 }
@@ -0,0 +1,1039 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * A store for compressed pages.  Allocations are rounded up to one of a
+ * few hundred size classes, PAGE_SIZE/256 bytes apart, and every class
+ * carves its objects out of "zspages": groups of one to four order-0
+ * pages, chosen per class so that the least space is lost at the end.
+ * The pages of a zspage need not be contiguous, physically or virtually,
+ * so an object may start on one page and end on the next.  Such objects
+ * are copied into a per-cpu buffer when mapped, and back when unmapped.
+ *
+ * The allocator hands out handles, not pointers.  A handle is a word
+ * allocated from a slab cache that holds the location of its object, and
+ * every object starts with a header pointing back at its handle.  This
+ * lets zs_compact() move the objects of sparsely used zspages into fuller
+ * ones of the same class, and free the zspages that were emptied, without
+ * the users noticing.  Bit 0 of the handle word is a lock that pins the
+ * object in place while it is mapped or being freed.
+ *
+ * Zspages of a class are kept on lists by how full they are.  Allocations
+ * come from the fullest zspage that has room, so that frees tend to empty
+ * the others; an empty zspage is freed right away.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/zsmalloc.h>
+
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/*
+ * An object is located by the pfn of the first page of its zspage and its
+ * index in the zspage.  Both are packed in one word, which is stored in
+ * the handle shifted left by OBJ_TAG_BITS to leave room for the pin bit.
+ */
+#ifndef MAX_PHYSMEM_BITS
+#ifdef CONFIG_HIGHMEM64G
+#define MAX_PHYSMEM_BITS	36
+#else
+#define MAX_PHYSMEM_BITS	BITS_PER_LONG
+#endif
+#endif
+#define _PFN_BITS		(MAX_PHYSMEM_BITS - PAGE_SHIFT)
+
+#define OBJ_TAG_BITS		1
+#define OBJ_INDEX_BITS		(BITS_PER_LONG - _PFN_BITS - OBJ_TAG_BITS)
+#define OBJ_INDEX_MASK		((1UL << OBJ_INDEX_BITS) - 1)
+
+/* Lock bit in the handle word */
+#define HANDLE_PIN_BIT		0
+
+/* Set in the header of allocated objects, clear in free ones */
+#define OBJ_ALLOCATED_TAG	1UL
+
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+
+/*
+ * Class sizes include the object header.  The smallest class must be big
+ * enough that a zspage of the largest kind never holds more objects than
+ * OBJ_INDEX_BITS can count.
+ */
+#define _ZS_MIN_INDEXABLE	\
+	((ZS_MAX_PAGES_PER_ZSPAGE << PAGE_SHIFT) >> OBJ_INDEX_BITS)
+#define ZS_MIN_ALLOC_SIZE	(_ZS_MIN_INDEXABLE > 32 ? _ZS_MIN_INDEXABLE : 32)
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES		(DIV_ROUND_UP(ZS_MAX_ALLOC_SIZE - \
+				ZS_MIN_ALLOC_SIZE, ZS_SIZE_CLASS_DELTA) + 1)
+
+/*
+ * A zspage is almost empty when at most 3/4 of its objects are in use.
+ * Those are the ones compaction tries to empty.
+ */
+#define ZS_ALMOST_FULL_FRAC	4
+
+enum fullness_group {
+	ZS_EMPTY,		/* no objects in use, or not on a list */
+	ZS_ALMOST_EMPTY,
+	ZS_ALMOST_FULL,
+	ZS_FULL,
+	NR_ZS_FULLNESS,
+};
+
+struct size_class {
+	spinlock_t lock;
+	struct list_head fullness_list[NR_ZS_FULLNESS];
+	unsigned long fullness_count[NR_ZS_FULLNESS];
+
+	int size;			/* object size, header included */
+	int index;			/* largest class index mapped to it */
+	unsigned int pages_per_zspage;
+	unsigned int objs_per_zspage;
+
+	unsigned long zspages;		/* zspages allocated */
+	unsigned long objs_inuse;
+};
+
+struct zspage {
+	struct list_head list;		/* on the class fullness list */
+	struct size_class *class;
+	unsigned int inuse;		/* objects in use */
+	unsigned int freeobj;		/* first free object, if any */
+	enum fullness_group fullness;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+};
+
+struct zs_pool {
+	const char *name;
+	gfp_t flags;			/* for the pages of zspages */
+
+	/* classes of the same density are merged, so entries repeat */
+	struct size_class *size_class[ZS_SIZE_CLASSES];
+
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+
+	struct shrinker shrinker;
+	struct dentry *stat_dentry;
+};
+
+/* Buffer straddling objects are copied through while mapped */
+struct mapping_area {
+	char *vm_buf;
+	char *vm_addr;			/* kmap address of a direct mapping */
+	enum zs_mapmode vm_mm;
+};
+
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+static struct kmem_cache *zs_handle_cachep;
+static struct kmem_cache *zs_zspage_cachep;
+
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *zs_stat_root;
+#endif
+
+/*
+ * Handles and object locations
+ */
+static unsigned long location_to_obj(struct zspage *zspage, unsigned int idx)
+{
+	return (page_to_pfn(zspage->pages[0]) << OBJ_INDEX_BITS) | idx;
+}
+
+static struct zspage *obj_to_location(unsigned long obj, unsigned int *idx)
+{
+	*idx = obj & OBJ_INDEX_MASK;
+	return (struct zspage *)page_private(pfn_to_page(obj >> OBJ_INDEX_BITS));
+}
+
+static unsigned long handle_to_obj(unsigned long handle)
+{
+	return *(unsigned long *)handle >> OBJ_TAG_BITS;
+}
+
+/*
+ * Point a handle at a new location.  The caller either owns a handle
+ * nobody else can see yet, or holds its pin, which is preserved.
+ */
+static void record_obj(unsigned long handle, unsigned long obj)
+{
+	unsigned long *word = (unsigned long *)handle;
+
+	*word = (obj << OBJ_TAG_BITS) | (*word & (1UL << HANDLE_PIN_BIT));
+}
+
+static void pin_tag(unsigned long handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_tag(unsigned long handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static void unpin_tag(unsigned long handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static unsigned long cache_alloc_handle(struct zs_pool *pool)
+{
+	unsigned long *handle;
+
+	handle = kmem_cache_alloc(zs_handle_cachep,
+				  pool->flags & ~(__GFP_HIGHMEM | __GFP_MOVABLE));
+	if (handle)
+		*handle = 0;
+	return (unsigned long)handle;
+}
+
+static void cache_free_handle(unsigned long handle)
+{
+	kmem_cache_free(zs_handle_cachep, (void *)handle);
+}
+
+/*
+ * Object memory
+ */
+
+/* Map the header of an object; the header never crosses a page. */
+static unsigned long *obj_header_map(struct size_class *class,
+				     struct zspage *zspage, unsigned int idx)
+{
+	unsigned long off = (unsigned long)idx * class->size;
+
+	return kmap_atomic(zspage->pages[off >> PAGE_SHIFT]) +
+		(off & ~PAGE_MASK);
+}
+
+static void obj_header_unmap(unsigned long *hdr)
+{
+	kunmap_atomic(hdr);
+}
+
+/* Copy @len bytes at byte @off of a zspage to or from @buf. */
+static void zspage_copy(struct zspage *zspage, unsigned long off,
+			char *buf, int len, bool to_zspage)
+{
+	while (len) {
+		int n = min_t(int, len, PAGE_SIZE - (off & ~PAGE_MASK));
+		char *addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT]);
+
+		if (to_zspage)
+			memcpy(addr + (off & ~PAGE_MASK), buf, n);
+		else
+			memcpy(buf, addr + (off & ~PAGE_MASK), n);
+		kunmap_atomic(addr);
+
+		off += n;
+		buf += n;
+		len -= n;
+	}
+}
+
+/* Copy the payload of an object to another slot of the same class. */
+static void obj_copy(struct size_class *class, struct zspage *dst,
+		     unsigned int didx, struct zspage *src, unsigned int sidx)
+{
+	unsigned long d_off = (unsigned long)didx * class->size + ZS_HANDLE_SIZE;
+	unsigned long s_off = (unsigned long)sidx * class->size + ZS_HANDLE_SIZE;
+	int len = class->size - ZS_HANDLE_SIZE;
+
+	while (len) {
+		int n = min_t(int, len, PAGE_SIZE - (d_off & ~PAGE_MASK));
+		char *saddr, *daddr;
+
+		n = min_t(int, n, PAGE_SIZE - (s_off & ~PAGE_MASK));
+		saddr = kmap_atomic(src->pages[s_off >> PAGE_SHIFT]);
+		daddr = kmap_atomic(dst->pages[d_off >> PAGE_SHIFT]);
+		memcpy(daddr + (d_off & ~PAGE_MASK),
+		       saddr + (s_off & ~PAGE_MASK), n);
+		kunmap_atomic(daddr);
+		kunmap_atomic(saddr);
+
+		d_off += n;
+		s_off += n;
+		len -= n;
+	}
+}
+
+/* Called with the class lock held and a free object in @zspage. */
+static unsigned long obj_malloc(struct size_class *class,
+				struct zspage *zspage, unsigned long handle)
+{
+	unsigned int idx = zspage->freeobj;
+	unsigned long *hdr;
+
+	hdr = obj_header_map(class, zspage, idx);
+	zspage->freeobj = *hdr >> OBJ_TAG_BITS;
+	*hdr = handle | OBJ_ALLOCATED_TAG;
+	obj_header_unmap(hdr);
+
+	zspage->inuse++;
+	class->objs_inuse++;
+
+	return location_to_obj(zspage, idx);
+}
+
+static void obj_free(struct size_class *class, struct zspage *zspage,
+		     unsigned int idx)
+{
+	unsigned long *hdr;
+
+	hdr = obj_header_map(class, zspage, idx);
+	*hdr = (unsigned long)zspage->freeobj << OBJ_TAG_BITS;
+	obj_header_unmap(hdr);
+
+	zspage->freeobj = idx;
+	zspage->inuse--;
+	class->objs_inuse--;
+}
+
+/*
+ * Fullness lists
+ */
+static enum fullness_group get_fullness_group(struct size_class *class,
+					      struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse, max = class->objs_per_zspage;
+
+	if (!inuse)
+		return ZS_EMPTY;
+	if (inuse == max)
+		return ZS_FULL;
+	if (inuse <= max * (ZS_ALMOST_FULL_FRAC - 1) / ZS_ALMOST_FULL_FRAC)
+		return ZS_ALMOST_EMPTY;
+	return ZS_ALMOST_FULL;
+}
+
+static void insert_zspage(struct size_class *class, struct zspage *zspage,
+			  enum fullness_group fullness)
+{
+	zspage->fullness = fullness;
+	if (fullness == ZS_EMPTY)
+		return;
+	list_add(&zspage->list, &class->fullness_list[fullness]);
+	class->fullness_count[fullness]++;
+}
+
+static void remove_zspage(struct size_class *class, struct zspage *zspage)
+{
+	if (zspage->fullness == ZS_EMPTY)
+		return;
+	list_del_init(&zspage->list);
+	class->fullness_count[zspage->fullness]--;
+	zspage->fullness = ZS_EMPTY;
+}
+
+/* Move a zspage to the list it now belongs on; returns its group. */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+					      struct zspage *zspage)
+{
+	enum fullness_group fullness = get_fullness_group(class, zspage);
+
+	if (fullness != zspage->fullness) {
+		remove_zspage(class, zspage);
+		insert_zspage(class, zspage, fullness);
+	}
+	return fullness;
+}
+
+/* The fullest zspage of a class that still has a free object */
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	struct list_head *head;
+
+	head = &class->fullness_list[ZS_ALMOST_FULL];
+	if (list_empty(head))
+		head = &class->fullness_list[ZS_ALMOST_EMPTY];
+	if (list_empty(head))
+		return NULL;
+	return list_first_entry(head, struct zspage, list);
+}
+
+/*
+ * Zspages
+ */
+static void free_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	unsigned int i, nr_pages = zspage->class->pages_per_zspage;
+
+	for (i = 0; i < nr_pages; i++) {
+		set_page_private(zspage->pages[i], 0);
+		__free_page(zspage->pages[i]);
+	}
+	atomic_long_sub(nr_pages, &pool->pages_allocated);
+	kmem_cache_free(zs_zspage_cachep, zspage);
+}
+
+/* Link all objects of a new zspage into its free list. */
+static void init_zspage(struct size_class *class, struct zspage *zspage)
+{
+	unsigned int idx;
+	unsigned long *hdr;
+
+	for (idx = 0; idx < class->objs_per_zspage; idx++) {
+		hdr = obj_header_map(class, zspage, idx);
+		*hdr = (unsigned long)(idx + 1) << OBJ_TAG_BITS;
+		obj_header_unmap(hdr);
+	}
+	zspage->freeobj = 0;
+	zspage->inuse = 0;
+}
+
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+				   struct size_class *class)
+{
+	struct zspage *zspage;
+	unsigned int i;
+
+	zspage = kmem_cache_alloc(zs_zspage_cachep,
+				  pool->flags & ~(__GFP_HIGHMEM | __GFP_MOVABLE));
+	if (!zspage)
+		return NULL;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		struct page *page = alloc_page(pool->flags);
+
+		if (!page) {
+			while (i--)
+				__free_page(zspage->pages[i]);
+			kmem_cache_free(zs_zspage_cachep, zspage);
+			return NULL;
+		}
+		set_page_private(page, (unsigned long)zspage);
+		zspage->pages[i] = page;
+	}
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+	init_zspage(class, zspage);
+	atomic_long_add(class->pages_per_zspage, &pool->pages_allocated);
+
+	return zspage;
+}
+
+/*
+ * Size classes
+ */
+static int get_size_class_index(int size)
+{
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		return DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				    ZS_SIZE_CLASS_DELTA);
+	return 0;
+}
+
+/* The zspage size, in pages, that wastes the least space for @class_size */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0, max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size = i * PAGE_SIZE;
+		int waste = zspage_size % class_size;
+		int usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+/*
+ * Compaction
+ */
+
+/* Pages that could be freed if the objects of @class were packed tightly */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	unsigned long obj_wasted;
+
+	if (!class->fullness_count[ZS_ALMOST_EMPTY])
+		return 0;
+
+	obj_wasted = class->zspages * class->objs_per_zspage -
+		class->objs_inuse;
+	return obj_wasted / class->objs_per_zspage * class->pages_per_zspage;
+}
+
+/*
+ * Move the objects of an isolated zspage into the other zspages of its
+ * class.  Objects that are pinned stay where they are.
+ */
+static void migrate_zspage(struct size_class *class, struct zspage *src)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < class->objs_per_zspage && src->inuse; idx++) {
+		struct zspage *dst;
+		unsigned long *hdr, handle, obj;
+		unsigned int didx;
+
+		hdr = obj_header_map(class, src, idx);
+		handle = *hdr;
+		obj_header_unmap(hdr);
+
+		if (!(handle & OBJ_ALLOCATED_TAG))
+			continue;
+		handle &= ~OBJ_ALLOCATED_TAG;
+
+		if (!trypin_tag(handle))
+			continue;
+
+		dst = find_get_zspage(class);
+		if (!dst) {
+			unpin_tag(handle);
+			break;
+		}
+
+		obj = obj_malloc(class, dst, handle);
+		obj_to_location(obj, &didx);
+		obj_copy(class, dst, didx, src, idx);
+		record_obj(handle, obj);
+		fix_fullness_group(class, dst);
+		obj_free(class, src, idx);
+
+		unpin_tag(handle);
+	}
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+				      struct size_class *class)
+{
+	struct list_head *head = &class->fullness_list[ZS_ALMOST_EMPTY];
+	unsigned long pages_freed = 0;
+	struct zspage *src;
+
+	spin_lock(&class->lock);
+	while (!list_empty(head)) {
+		unsigned long free_objs;
+
+		src = list_entry(head->prev, struct zspage, list);
+
+		/* stop unless the rest of the class can take all of src */
+		free_objs = class->zspages * class->objs_per_zspage -
+			class->objs_inuse;
+		if (free_objs - (class->objs_per_zspage - src->inuse) <
+		    src->inuse)
+			break;
+
+		remove_zspage(class, src);
+		migrate_zspage(class, src);
+
+		if (src->inuse) {
+			/* some objects were pinned: try again later */
+			insert_zspage(class, src,
+				      get_fullness_group(class, src));
+			break;
+		}
+
+		class->zspages--;
+		spin_unlock(&class->lock);
+
+		free_zspage(pool, src);
+		pages_freed += class->pages_per_zspage;
+		cond_resched();
+
+		spin_lock(&class->lock);
+	}
+	spin_unlock(&class->lock);
+
+	return pages_freed;
+}
+
+/**
+ * zs_compact - pack the objects of a pool into fewer zspages
+ * @pool:	pool to compact
+ *
+ * Objects of sparsely used zspages are moved into fuller zspages of the
+ * same class, and the zspages that were emptied are freed.  Must be called
+ * from a context that may sleep.  Returns the number of pages freed.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	unsigned long pages_freed = 0;
+	int i;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--) {
+		struct size_class *class = pool->size_class[i];
+
+		if (class->index != i)
+			continue;
+		pages_freed += zs_compact_class(pool, class);
+	}
+
+	atomic_long_add(pages_freed, &pool->pages_compacted);
+	return pages_freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+/* Compaction is the only way to give memory back under pressure. */
+static int zs_shrinker_shrink(struct shrinker *shrinker,
+			      struct shrink_control *sc)
+{
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+					    shrinker);
+	unsigned long pages = 0;
+	int i;
+
+	if (sc->nr_to_scan)
+		zs_compact(pool);
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--) {
+		struct size_class *class = pool->size_class[i];
+
+		if (class->index != i)
+			continue;
+		spin_lock(&class->lock);
+		pages += zs_can_compact(class);
+		spin_unlock(&class->lock);
+	}
+
+	return min_t(unsigned long, pages, INT_MAX);
+}
+
+/*
+ * Statistics
+ */
+#ifdef CONFIG_DEBUG_FS
+
+static int zs_stats_classes_show(struct seq_file *s, void *v)
+{
+	struct zs_pool *pool = s->private;
+	unsigned long total_objs = 0, total_used = 0, total_pages = 0;
+	unsigned long total_freeable = 0;
+	int i;
+
+	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %8s\n",
+		   "class", "size", "almost_full", "almost_empty",
+		   "obj_allocated", "obj_used", "pages_used",
+		   "pages_per_zspage", "freeable");
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+		unsigned long almost_full, almost_empty, objs, used;
+		unsigned long pages, freeable;
+
+		if (class->index != i)
+			continue;
+
+		spin_lock(&class->lock);
+		almost_full = class->fullness_count[ZS_ALMOST_FULL];
+		almost_empty = class->fullness_count[ZS_ALMOST_EMPTY];
+		objs = class->zspages * class->objs_per_zspage;
+		used = class->objs_inuse;
+		pages = class->zspages * class->pages_per_zspage;
+		freeable = zs_can_compact(class);
+		spin_unlock(&class->lock);
+
+		seq_printf(s, " %5d %5d %11lu %12lu %13lu %10lu %10lu %16u %8lu\n",
+			   i, class->size, almost_full, almost_empty, objs,
+			   used, pages, class->pages_per_zspage, freeable);
+
+		total_objs += objs;
+		total_used += used;
+		total_pages += pages;
+		total_freeable += freeable;
+	}
+
+	seq_printf(s, "\n %5s %5s %11s %12s %13lu %10lu %10lu %16s %8lu\n",
+		   "Total", "", "", "", total_objs, total_used, total_pages,
+		   "", total_freeable);
+
+	return 0;
+}
+
+static int zs_stats_classes_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_stats_classes_show, inode->i_private);
+}
+
+static const struct file_operations zs_stats_classes_fops = {
+	.open		= zs_stats_classes_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+	struct dentry *entry;
+
+	if (!zs_stat_root)
+		return;
+
+	entry = debugfs_create_dir(pool->name, zs_stat_root);
+	if (!entry) {
+		pr_warning("zsmalloc: debugfs dir <%s> creation failed\n",
+			   pool->name);
+		return;
+	}
+	pool->stat_dentry = entry;
+
+	debugfs_create_file("classes", S_IRUGO, entry, pool,
+			    &zs_stats_classes_fops);
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+	debugfs_remove_recursive(pool->stat_dentry);
+}
+
+static void __init zs_stat_init(void)
+{
+	if (debugfs_initialized())
+		zs_stat_root = debugfs_create_dir("zsmalloc", NULL);
+}
+
+#else
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+}
+
+static void __init zs_stat_init(void)
+{
+}
+#endif
+
+/**
+ * zs_get_total_size_bytes - memory used by a pool
+ * @pool:	pool to query
+ *
+ * Returns the size of all zspages of @pool, in bytes.
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
+{
+	stats->pages_compacted = atomic_long_read(&pool->pages_compacted);
+}
+EXPORT_SYMBOL_GPL(zs_pool_stats);
+
+/*
+ * Pools
+ */
+
+/**
+ * zs_create_pool - create a pool of compressed objects
+ * @name:	name of the pool's statistics directory in debugfs
+ * @flags:	allocation flags for the pages backing the pool
+ *
+ * The pool also registers a shrinker that compacts it under memory
+ * pressure.  Returns %NULL if out of memory.
+ */
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
+{
+	struct size_class *prev_class = NULL;
+	struct zs_pool *pool;
+	int i;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->name = kstrdup(name, GFP_KERNEL);
+	if (!pool->name)
+		goto fail;
+
+	/*
+	 * Going from the largest class down, a class that would put as
+	 * many objects into zspages of the same size as the one above it
+	 * is no denser, so the two are merged.
+	 */
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--) {
+		int size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		struct size_class *class;
+		int fullness, pages_per_zspage;
+
+		if (size > ZS_MAX_ALLOC_SIZE)
+			size = ZS_MAX_ALLOC_SIZE;
+		pages_per_zspage = get_pages_per_zspage(size);
+
+		if (prev_class &&
+		    prev_class->pages_per_zspage == pages_per_zspage &&
+		    prev_class->objs_per_zspage ==
+		    pages_per_zspage * PAGE_SIZE / size) {
+			pool->size_class[i] = prev_class;
+			continue;
+		}
+
+		class = kzalloc(sizeof(*class), GFP_KERNEL);
+		if (!class)
+			goto fail;
+
+		class->size = size;
+		class->index = i;
+		class->pages_per_zspage = pages_per_zspage;
+		class->objs_per_zspage = pages_per_zspage * PAGE_SIZE / size;
+		spin_lock_init(&class->lock);
+		for (fullness = 0; fullness < NR_ZS_FULLNESS; fullness++)
+			INIT_LIST_HEAD(&class->fullness_list[fullness]);
+
+		pool->size_class[i] = class;
+		prev_class = class;
+	}
+
+	pool->flags = flags;
+	atomic_long_set(&pool->pages_allocated, 0);
+	atomic_long_set(&pool->pages_compacted, 0);
+
+	pool->shrinker.shrink = zs_shrinker_shrink;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	zs_pool_stat_create(pool);
+
+	return pool;
+
+fail:
+	for (i = 0; i < ZS_SIZE_CLASSES; i++)
+		if (pool->size_class[i] && pool->size_class[i]->index == i)
+			kfree(pool->size_class[i]);
+	kfree(pool->name);
+	kfree(pool);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i;
+
+	unregister_shrinker(&pool->shrinker);
+	zs_pool_stat_destroy(pool);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+		struct zspage *zspage, *tmp;
+		int fullness;
+
+		if (class->index != i)
+			continue;
+
+		/* the user leaked objects: at least don't leak their pages */
+		WARN(class->zspages, "zsmalloc: freeing non-empty class %d\n", i);
+		for (fullness = 0; fullness < NR_ZS_FULLNESS; fullness++) {
+			list_for_each_entry_safe(zspage, tmp,
+					&class->fullness_list[fullness], list) {
+				remove_zspage(class, zspage);
+				free_zspage(pool, zspage);
+			}
+		}
+		kfree(class);
+	}
+
+	kfree(pool->name);
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/*
+ * Allocation
+ */
+
+/**
+ * zs_malloc - allocate an object from a pool
+ * @pool:	pool to allocate from
+ * @size:	object size, at most PAGE_SIZE - sizeof(unsigned long)
+ *
+ * May sleep only if the pool's allocation flags allow it.  Returns the
+ * handle of the new object, or 0 on failure.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size)
+{
+	struct size_class *class;
+	struct zspage *zspage;
+	unsigned long handle, obj;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return 0;
+
+	handle = cache_alloc_handle(pool);
+	if (!handle)
+		return 0;
+
+	class = pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(pool, class);
+		if (unlikely(!zspage)) {
+			cache_free_handle(handle);
+			return 0;
+		}
+		spin_lock(&class->lock);
+		class->zspages++;
+	}
+
+	obj = obj_malloc(class, zspage, handle);
+	record_obj(handle, obj);
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	struct size_class *class;
+	struct zspage *zspage;
+	unsigned int idx;
+	bool empty;
+
+	if (unlikely(!handle))
+		return;
+
+	/* keep compaction from moving the object under us */
+	pin_tag(handle);
+	zspage = obj_to_location(handle_to_obj(handle), &idx);
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, idx);
+	empty = fix_fullness_group(class, zspage) == ZS_EMPTY;
+	if (empty)
+		class->zspages--;
+	spin_unlock(&class->lock);
+	unpin_tag(handle);
+
+	if (empty)
+		free_zspage(pool, zspage);
+	cache_free_handle(handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get the address of an object
+ * @pool:	pool the object belongs to
+ * @handle:	handle returned by zs_malloc()
+ * @mm:		how the object will be accessed
+ *
+ * The object stays in place until zs_unmap_object() is called.  Mappings
+ * are per cpu and cannot nest: the caller must not sleep or map another
+ * object before unmapping this one.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+		    enum zs_mapmode mm)
+{
+	struct mapping_area *area;
+	struct size_class *class;
+	struct zspage *zspage;
+	unsigned long off;
+	unsigned int idx;
+
+	BUG_ON(!handle);
+
+	pin_tag(handle);
+	zspage = obj_to_location(handle_to_obj(handle), &idx);
+	class = zspage->class;
+	off = (unsigned long)idx * class->size;
+
+	area = &get_cpu_var(zs_map_area);
+	area->vm_mm = mm;
+	if ((off & ~PAGE_MASK) + class->size <= PAGE_SIZE) {
+		area->vm_addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT]);
+		return area->vm_addr + (off & ~PAGE_MASK) + ZS_HANDLE_SIZE;
+	}
+
+	/* the object straddles two pages */
+	area->vm_addr = NULL;
+	if (mm != ZS_MM_WO)
+		zspage_copy(zspage, off + ZS_HANDLE_SIZE, area->vm_buf,
+			    class->size - ZS_HANDLE_SIZE, false);
+	return area->vm_buf;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct mapping_area *area;
+	struct size_class *class;
+	struct zspage *zspage;
+	unsigned int idx;
+
+	zspage = obj_to_location(handle_to_obj(handle), &idx);
+	class = zspage->class;
+
+	area = &__get_cpu_var(zs_map_area);
+	if (area->vm_addr)
+		kunmap_atomic(area->vm_addr);
+	else if (area->vm_mm != ZS_MM_RO)
+		zspage_copy(zspage, (unsigned long)idx * class->size +
+			    ZS_HANDLE_SIZE, area->vm_buf,
+			    class->size - ZS_HANDLE_SIZE, true);
+	put_cpu_var(zs_map_area);
+
+	unpin_tag(handle);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/*
+ * Initialization
+ */
+static int __init zs_init(void)
+{
+	int cpu;
+
+	zs_handle_cachep = kmem_cache_create("zs_handle", ZS_HANDLE_SIZE,
+					     0, 0, NULL);
+	zs_zspage_cachep = KMEM_CACHE(zspage, 0);
+	if (!zs_handle_cachep || !zs_zspage_cachep)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		char *buf = kmalloc_node(PAGE_SIZE, GFP_KERNEL,
+					 cpu_to_node(cpu));
+
+		if (!buf)
+			goto fail;
+		per_cpu(zs_map_area, cpu).vm_buf = buf;
+	}
+
+	zs_stat_init();
+	return 0;
+
+fail:
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zs_map_area, cpu).vm_buf);
+		per_cpu(zs_map_area, cpu).vm_buf = NULL;
+	}
+	if (zs_zspage_cachep)
+		kmem_cache_destroy(zs_zspage_cachep);
+	if (zs_handle_cachep)
+		kmem_cache_destroy(zs_handle_cachep);
+	pr_err("zsmalloc: initialization failed\n");
+	return -ENOMEM;
+}
+subsys_initcall(zs_init);
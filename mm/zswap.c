@@ -0,0 +1,606 @@
+/*
+ * zswap.c - compressed cache for swap pages
+ *
+ * Pages that are being swapped out are compressed and kept in RAM instead
+ * of being written to the swap device.  A later swap-in decompresses them
+ * back, so a page that compresses well never costs a disk write or read.
+ *
+ * The pool is limited to max_pool_percent of RAM.  Once it is full, the
+ * oldest entries of the swap area being written to are decompressed into
+ * the swap cache and written to the real device, in LRU order, to make
+ * room.  Pages that do not compress to max_compression_ratio percent of a
+ * page, or that can't be stored for lack of memory, go to the device
+ * directly.
+ *
+ * Entries are kept per swap area in an rbtree indexed by swap offset and
+ * are dropped when the swap slot is freed.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/rbtree.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/pagemap.h>
+#include <linux/writeback.h>
+#include <linux/crypto.h>
+#include <linux/debugfs.h>
+#include <linux/zsmalloc.h>
+#include <linux/zswap.h>
+
+/*
+ * Tunables
+ */
+static bool zswap_enabled;
+module_param_named(enabled, zswap_enabled, bool, 0644);
+
+static char *zswap_compressor = "lzo";
+module_param_named(compressor, zswap_compressor, charp, 0444);
+
+/* The pool may use at most this percentage of RAM */
+static unsigned int zswap_max_pool_percent = 20;
+module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
+
+/* Pages compressing to more than this percentage of a page are rejected */
+static unsigned int zswap_max_compression_ratio = 80;
+module_param_named(max_compression_ratio, zswap_max_compression_ratio,
+		   uint, 0644);
+
+/* How many entries a full pool writes back before giving up on a store */
+#define ZSWAP_WRITEBACK_BATCH	16
+
+/*
+ * Statistics
+ */
+static atomic_t zswap_stored_pages = ATOMIC_INIT(0);
+
+static u64 zswap_pool_limit_hit;
+static u64 zswap_written_back_pages;
+static u64 zswap_reject_reclaim_fail;
+static u64 zswap_reject_alloc_fail;
+static u64 zswap_reject_compress_poor;
+static u64 zswap_duplicate_entry;
+
+/*
+ * Data structures
+ *
+ * An entry holds one compressed page.  It is referenced by the tree while
+ * it is linked there, and for the duration of a load or writeback.  The
+ * refcount and all links are protected by the tree lock.
+ */
+struct zswap_entry {
+	struct rb_node rbnode;
+	struct list_head lru;
+	pgoff_t offset;
+	int refcount;
+	unsigned int length;
+	unsigned long handle;		/* compressed data in zswap_pool */
+};
+
+struct zswap_tree {
+	struct rb_root rbroot;
+	struct list_head lru;		/* newest first */
+	spinlock_t lock;
+};
+
+/* Allocated at the first swapon of each area and never freed */
+static struct zswap_tree *zswap_trees[MAX_SWAPFILES];
+
+static struct kmem_cache *zswap_entry_cache;
+static struct zs_pool *zswap_pool;
+
+static DEFINE_PER_CPU(struct crypto_comp *, zswap_comp_tfm);
+static DEFINE_PER_CPU(u8 *, zswap_dstmem);
+
+static bool zswap_init_ok;
+
+static bool zswap_is_full(void)
+{
+	return (zs_get_total_size_bytes(zswap_pool) >> PAGE_SHIFT) >
+		totalram_pages * zswap_max_pool_percent / 100;
+}
+
+/*
+ * Entry management
+ */
+static struct zswap_entry *zswap_rb_search(struct rb_root *root,
+					   pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (offset < entry->offset)
+			node = node->rb_left;
+		else if (offset > entry->offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Returns -EEXIST, with the entry already there in *dupentry, if the
+ * offset is taken.
+ */
+static int zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry,
+			   struct zswap_entry **dupentry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *myentry;
+
+	while (*link) {
+		parent = *link;
+		myentry = rb_entry(parent, struct zswap_entry, rbnode);
+		if (entry->offset < myentry->offset)
+			link = &parent->rb_left;
+		else if (entry->offset > myentry->offset)
+			link = &parent->rb_right;
+		else {
+			*dupentry = myentry;
+			return -EEXIST;
+		}
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+	return 0;
+}
+
+static void zswap_entry_free(struct zswap_entry *entry)
+{
+	atomic_dec(&zswap_stored_pages);
+	zs_free(zswap_pool, entry->handle);
+	kmem_cache_free(zswap_entry_cache, entry);
+}
+
+static void zswap_entry_put(struct zswap_entry *entry)
+{
+	if (!--entry->refcount)
+		zswap_entry_free(entry);
+}
+
+/* Unlink an entry from its tree and drop the tree's reference. */
+static void zswap_erase(struct zswap_tree *tree, struct zswap_entry *entry)
+{
+	rb_erase(&entry->rbnode, &tree->rbroot);
+	RB_CLEAR_NODE(&entry->rbnode);
+	list_del_init(&entry->lru);
+	zswap_entry_put(entry);
+}
+
+/*
+ * Compression
+ */
+static int zswap_decompress(struct zswap_entry *entry, struct page *page)
+{
+	unsigned int dlen = PAGE_SIZE;
+	struct crypto_comp *tfm;
+	u8 *src, *dst;
+	int ret;
+
+	src = zs_map_object(zswap_pool, entry->handle, ZS_MM_RO);
+	dst = kmap_atomic(page);
+	tfm = get_cpu_var(zswap_comp_tfm);
+	ret = crypto_comp_decompress(tfm, src, entry->length, dst, &dlen);
+	put_cpu_var(zswap_comp_tfm);
+	kunmap_atomic(dst);
+	zs_unmap_object(zswap_pool, entry->handle);
+
+	if (!ret && dlen != PAGE_SIZE)
+		ret = -EINVAL;
+	return ret;
+}
+
+/*
+ * Writeback
+ */
+
+/*
+ * Decompress an entry into a new swap cache page and start writing that
+ * to the swap device.  Fails with -EEXIST if the slot is already in the
+ * swap cache: reclaim will deal with that page.
+ */
+static int zswap_writeback_entry(struct zswap_tree *tree,
+				 struct zswap_entry *entry, int type)
+{
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_NONE,
+	};
+	bool page_was_allocated;
+	struct page *page;
+
+	page = __read_swap_cache_async(swp_entry(type, entry->offset),
+				       GFP_KERNEL, NULL, 0,
+				       &page_was_allocated);
+	if (!page)
+		return -ENOMEM;
+
+	if (!page_was_allocated) {
+		page_cache_release(page);
+		return -EEXIST;
+	}
+
+	/*
+	 * The slot may have been invalidated, and even reused by a new
+	 * store, while the swap cache page was allocated: don't put stale
+	 * data in the swap cache then.
+	 */
+	spin_lock(&tree->lock);
+	if (zswap_rb_search(&tree->rbroot, entry->offset) != entry) {
+		spin_unlock(&tree->lock);
+		delete_from_swap_cache(page);
+		unlock_page(page);
+		page_cache_release(page);
+		return -ENOENT;
+	}
+	spin_unlock(&tree->lock);
+
+	BUG_ON(zswap_decompress(entry, page));
+	SetPageUptodate(page);
+
+	/* move it to the tail of the inactive list after end_writeback */
+	SetPageReclaim(page);
+
+	__swap_writepage(page, &wbc);
+	page_cache_release(page);
+	zswap_written_back_pages++;
+
+	return 0;
+}
+
+/*
+ * Write back the oldest entries of @tree until the pool is below its
+ * limit.  Returns -ENOMEM if it is still full.
+ */
+static int zswap_shrink(struct zswap_tree *tree, int type)
+{
+	struct zswap_entry *entry;
+	int i, ret;
+
+	for (i = 0; i < ZSWAP_WRITEBACK_BATCH && zswap_is_full(); i++) {
+		spin_lock(&tree->lock);
+		if (list_empty(&tree->lru)) {
+			spin_unlock(&tree->lock);
+			break;
+		}
+		entry = list_entry(tree->lru.prev, struct zswap_entry, lru);
+		list_del_init(&entry->lru);
+		entry->refcount++;
+		spin_unlock(&tree->lock);
+
+		ret = zswap_writeback_entry(tree, entry, type);
+
+		spin_lock(&tree->lock);
+		/* the slot may have been freed or rewritten meanwhile */
+		if (!RB_EMPTY_NODE(&entry->rbnode)) {
+			if (!ret)
+				zswap_erase(tree, entry);
+			else
+				list_add(&entry->lru, &tree->lru);
+		}
+		zswap_entry_put(entry);
+		spin_unlock(&tree->lock);
+	}
+
+	return zswap_is_full() ? -ENOMEM : 0;
+}
+
+/*
+ * Swap hooks
+ */
+
+/**
+ * zswap_store - try to keep a page being swapped out in the pool
+ * @page:	locked swap cache page
+ *
+ * Returns 0 if the page was stored and need not be written, or a negative
+ * error if it must go to the swap device.
+ */
+int zswap_store(struct page *page)
+{
+	swp_entry_t swp = { .val = page_private(page) };
+	int type = swp_type(swp);
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry, *dupentry;
+	struct crypto_comp *tfm;
+	unsigned int dlen = PAGE_SIZE * 2;
+	unsigned long handle;
+	u8 *src, *dst, *buf;
+	int ret;
+
+	if (!zswap_enabled || !zswap_init_ok || !tree)
+		return -ENODEV;
+
+	if (zswap_is_full()) {
+		zswap_pool_limit_hit++;
+		if (zswap_shrink(tree, type)) {
+			zswap_reject_reclaim_fail++;
+			return -ENOMEM;
+		}
+	}
+
+	entry = kmem_cache_alloc(zswap_entry_cache, GFP_NOIO | __GFP_NOWARN);
+	if (!entry) {
+		zswap_reject_alloc_fail++;
+		return -ENOMEM;
+	}
+
+	dst = get_cpu_var(zswap_dstmem);
+	tfm = __get_cpu_var(zswap_comp_tfm);
+	src = kmap_atomic(page);
+	ret = crypto_comp_compress(tfm, src, PAGE_SIZE, dst, &dlen);
+	kunmap_atomic(src);
+	if (ret) {
+		ret = -EINVAL;
+		goto put_dstmem;
+	}
+
+	if (dlen * 100 > PAGE_SIZE * zswap_max_compression_ratio) {
+		zswap_reject_compress_poor++;
+		ret = -E2BIG;
+		goto put_dstmem;
+	}
+
+	handle = zs_malloc(zswap_pool, dlen);
+	if (!handle) {
+		zswap_reject_alloc_fail++;
+		ret = -ENOMEM;
+		goto put_dstmem;
+	}
+	buf = zs_map_object(zswap_pool, handle, ZS_MM_WO);
+	memcpy(buf, dst, dlen);
+	zs_unmap_object(zswap_pool, handle);
+	put_cpu_var(zswap_dstmem);
+
+	entry->offset = swp_offset(swp);
+	entry->refcount = 1;
+	entry->length = dlen;
+	entry->handle = handle;
+	atomic_inc(&zswap_stored_pages);
+
+	spin_lock(&tree->lock);
+	while (zswap_rb_insert(&tree->rbroot, entry, &dupentry) == -EEXIST) {
+		/* the slot is being rewritten: the old copy is stale */
+		zswap_duplicate_entry++;
+		zswap_erase(tree, dupentry);
+	}
+	list_add(&entry->lru, &tree->lru);
+	spin_unlock(&tree->lock);
+
+	return 0;
+
+put_dstmem:
+	put_cpu_var(zswap_dstmem);
+	kmem_cache_free(zswap_entry_cache, entry);
+	return ret;
+}
+
+/**
+ * zswap_load - fill a page being swapped in from the pool
+ * @page:	locked, not uptodate swap cache page
+ *
+ * Returns 0 if the page was filled, -ENOENT if it isn't in the pool.
+ * Entries stay in the pool until the swap slot is freed, so a clean page
+ * dropped again by reclaim doesn't need to be stored twice.
+ */
+int zswap_load(struct page *page)
+{
+	swp_entry_t swp = { .val = page_private(page) };
+	struct zswap_tree *tree = zswap_trees[swp_type(swp)];
+	struct zswap_entry *entry;
+
+	if (!tree || RB_EMPTY_ROOT(&tree->rbroot))
+		return -ENOENT;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, swp_offset(swp));
+	if (!entry) {
+		spin_unlock(&tree->lock);
+		return -ENOENT;
+	}
+	entry->refcount++;
+	spin_unlock(&tree->lock);
+
+	BUG_ON(zswap_decompress(entry, page));
+
+	spin_lock(&tree->lock);
+	zswap_entry_put(entry);
+	spin_unlock(&tree->lock);
+
+	return 0;
+}
+
+/* Called with swap_lock held when a swap slot is freed. */
+void zswap_invalidate(int type, pgoff_t offset)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+
+	if (!tree || RB_EMPTY_ROOT(&tree->rbroot))
+		return;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (entry)
+		zswap_erase(tree, entry);
+	spin_unlock(&tree->lock);
+}
+
+int zswap_swapon(int type)
+{
+	struct zswap_tree *tree;
+
+	if (zswap_trees[type])
+		return 0;
+
+	tree = kzalloc(sizeof(*tree), GFP_KERNEL);
+	if (!tree)
+		return -ENOMEM;
+
+	tree->rbroot = RB_ROOT;
+	INIT_LIST_HEAD(&tree->lru);
+	spin_lock_init(&tree->lock);
+	zswap_trees[type] = tree;
+	return 0;
+}
+
+/* Drop whatever the swap area still has in the pool. */
+void zswap_swapoff(int type)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct rb_node *node;
+
+	if (!tree)
+		return;
+
+	spin_lock(&tree->lock);
+	while ((node = rb_first(&tree->rbroot)))
+		zswap_erase(tree, rb_entry(node, struct zswap_entry, rbnode));
+	spin_unlock(&tree->lock);
+}
+
+/*
+ * debugfs
+ */
+#ifdef CONFIG_DEBUG_FS
+
+static int zswap_pool_bytes_get(void *data, u64 *val)
+{
+	*val = zs_get_total_size_bytes(zswap_pool);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(zswap_pool_bytes_fops, zswap_pool_bytes_get,
+			NULL, "%llu\n");
+
+static int zswap_stored_pages_get(void *data, u64 *val)
+{
+	*val = atomic_read(&zswap_stored_pages);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(zswap_stored_pages_fops, zswap_stored_pages_get,
+			NULL, "%llu\n");
+
+static int __init zswap_debugfs_init(void)
+{
+	struct dentry *root;
+
+	if (!debugfs_initialized())
+		return -ENODEV;
+
+	root = debugfs_create_dir("zswap", NULL);
+	if (!root)
+		return -ENOMEM;
+
+	debugfs_create_u64("pool_limit_hit", S_IRUGO,
+			   root, &zswap_pool_limit_hit);
+	debugfs_create_u64("written_back_pages", S_IRUGO,
+			   root, &zswap_written_back_pages);
+	debugfs_create_u64("reject_reclaim_fail", S_IRUGO,
+			   root, &zswap_reject_reclaim_fail);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO,
+			   root, &zswap_reject_alloc_fail);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO,
+			   root, &zswap_reject_compress_poor);
+	debugfs_create_u64("duplicate_entry", S_IRUGO,
+			   root, &zswap_duplicate_entry);
+	debugfs_create_file("pool_bytes", S_IRUGO,
+			    root, NULL, &zswap_pool_bytes_fops);
+	debugfs_create_file("stored_pages", S_IRUGO,
+			    root, NULL, &zswap_stored_pages_fops);
+
+	return 0;
+}
+#else
+static int __init zswap_debugfs_init(void)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Initialization
+ */
+static void zswap_comp_exit(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *tfm = per_cpu(zswap_comp_tfm, cpu);
+
+		if (tfm && !IS_ERR(tfm))
+			crypto_free_comp(tfm);
+		per_cpu(zswap_comp_tfm, cpu) = NULL;
+		kfree(per_cpu(zswap_dstmem, cpu));
+		per_cpu(zswap_dstmem, cpu) = NULL;
+	}
+}
+
+static int __init zswap_comp_init(void)
+{
+	int cpu;
+
+	if (!crypto_has_comp(zswap_compressor, 0, 0)) {
+		pr_info("zswap: %s compressor not available\n",
+			zswap_compressor);
+		return -ENODEV;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *tfm;
+		u8 *dst;
+
+		tfm = crypto_alloc_comp(zswap_compressor, 0, 0);
+		if (IS_ERR(tfm))
+			goto fail;
+		per_cpu(zswap_comp_tfm, cpu) = tfm;
+
+		/* compressed output may be larger than the input */
+		dst = kmalloc_node(PAGE_SIZE * 2, GFP_KERNEL, cpu_to_node(cpu));
+		if (!dst)
+			goto fail;
+		per_cpu(zswap_dstmem, cpu) = dst;
+	}
+	return 0;
+
+fail:
+	zswap_comp_exit();
+	return -ENOMEM;
+}
+
+static int __init init_zswap(void)
+{
+	zswap_entry_cache = KMEM_CACHE(zswap_entry, 0);
+	if (!zswap_entry_cache) {
+		pr_err("zswap: entry cache creation failed\n");
+		return -ENOMEM;
+	}
+
+	/* stores run with preemption disabled and must not sleep */
+	zswap_pool = zs_create_pool("zswap", GFP_NOWAIT | __GFP_NORETRY |
+				    __GFP_NOWARN | __GFP_HIGHMEM);
+	if (!zswap_pool) {
+		pr_err("zswap: pool creation failed\n");
+		kmem_cache_destroy(zswap_entry_cache);
+		return -ENOMEM;
+	}
+
+	if (zswap_comp_init()) {
+		pr_err("zswap: compressor initialization failed\n");
+		zs_destroy_pool(zswap_pool);
+		kmem_cache_destroy(zswap_entry_cache);
+		return -ENODEV;
+	}
+
+	zswap_init_ok = true;
+	pr_info("zswap: using %s compressor\n", zswap_compressor);
+	zswap_debugfs_init();
+	return 0;
+}
+late_initcall(init_zswap);
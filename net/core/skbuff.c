@@ -74,6 +74,43 @@
 static struct kmem_cache *skbuff_head_cache __read_mostly;
 static struct kmem_cache *skbuff_fclone_cache __read_mostly;
 
+/*
+ * Heads freed and allocated on NAPI completion, in softirq context, go
+ * through a small per cpu cache that is refilled and drained in bulk.
+ * Fast clone pairs are only gathered there to be freed in bulk.
+ */
+#define NAPI_SKB_CACHE_SIZE	64
+#define NAPI_SKB_CACHE_BULK	16
+#define NAPI_SKB_CACHE_HALF	(NAPI_SKB_CACHE_SIZE / 2)
+
+struct napi_skb_cache {
+	unsigned int	skb_count;
+	unsigned int	fclone_count;
+	void		*skb_cache[NAPI_SKB_CACHE_SIZE];
+	void		*fclone_cache[NAPI_SKB_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct napi_skb_cache, napi_skb_cache);
+
+/* Softirqs do not nest, and hard interrupts keep off the cache. */
+static inline bool napi_skb_cache_usable(void)
+{
+	return in_serving_softirq() && !in_irq();
+}
+
+static struct sk_buff *napi_skb_cache_get(gfp_t gfp_mask)
+{
+	struct napi_skb_cache *nc = &__get_cpu_var(napi_skb_cache);
+
+	if (unlikely(!nc->skb_count)) {
+		if (!kmem_cache_alloc_bulk(skbuff_head_cache, gfp_mask,
+					   NAPI_SKB_CACHE_BULK, nc->skb_cache))
+			return NULL;
+		nc->skb_count = NAPI_SKB_CACHE_BULK;
+	}
+	return nc->skb_cache[--nc->skb_count];
+}
+
 static void sock_pipe_buf_release(struct pipe_inode_info *pipe,
 				  struct pipe_buffer *buf)
 {
@@ -179,7 +216,11 @@ struct sk_buff *__alloc_skb(unsigned int size, gfp_t gfp_mask,
 	cache = fclone ? skbuff_fclone_cache : skbuff_head_cache;
 
 	/* Get the HEAD */
-	skb = kmem_cache_alloc_node(cache, gfp_mask & ~__GFP_DMA, node);
+	skb = NULL;
+	if (!fclone && node == NUMA_NO_NODE && napi_skb_cache_usable())
+		skb = napi_skb_cache_get(gfp_mask & ~__GFP_DMA);
+	if (!skb)
+		skb = kmem_cache_alloc_node(cache, gfp_mask & ~__GFP_DMA, node);
 	if (!skb)
 		goto out;
 	prefetchw(skb);
@@ -444,6 +485,87 @@ void __kfree_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(__kfree_skb);
 
+/*
+ * kfree_skbmem() for softirq context: plain heads are kept for reuse by
+ * __alloc_skb(), fast clone pairs gathered for __kfree_skb_flush().
+ */
+static void kfree_skbmem_defer(struct sk_buff *skb)
+{
+	struct napi_skb_cache *nc = &__get_cpu_var(napi_skb_cache);
+	struct sk_buff *other;
+	atomic_t *fclone_ref;
+
+	switch (skb->fclone) {
+	case SKB_FCLONE_UNAVAILABLE:
+		nc->skb_cache[nc->skb_count++] = skb;
+		if (unlikely(nc->skb_count == NAPI_SKB_CACHE_SIZE)) {
+			kmem_cache_free_bulk(skbuff_head_cache,
+					     NAPI_SKB_CACHE_HALF,
+					     nc->skb_cache + NAPI_SKB_CACHE_HALF);
+			nc->skb_count = NAPI_SKB_CACHE_HALF;
+		}
+		return;
+
+	case SKB_FCLONE_ORIG:
+		fclone_ref = (atomic_t *) (skb + 2);
+		if (!atomic_dec_and_test(fclone_ref))
+			return;
+		break;
+
+	case SKB_FCLONE_CLONE:
+		fclone_ref = (atomic_t *) (skb + 1);
+		other = skb - 1;
+
+		/* The clone portion is available for
+		 * fast-cloning again.
+		 */
+		skb->fclone = SKB_FCLONE_UNAVAILABLE;
+
+		if (!atomic_dec_and_test(fclone_ref))
+			return;
+		skb = other;
+		break;
+	}
+
+	nc->fclone_cache[nc->fclone_count++] = skb;
+	if (unlikely(nc->fclone_count == NAPI_SKB_CACHE_SIZE))
+		__kfree_skb_flush();
+}
+
+/**
+ *	__kfree_skb_defer - private function
+ *	@skb: buffer
+ *
+ *	Like __kfree_skb(), but from softirq context the memory is returned
+ *	to the slab caches in bulk. Softirq handlers using it must call
+ *	__kfree_skb_flush() before they return.
+ */
+void __kfree_skb_defer(struct sk_buff *skb)
+{
+	if (!napi_skb_cache_usable()) {
+		__kfree_skb(skb);
+		return;
+	}
+	skb_release_all(skb);
+	kfree_skbmem_defer(skb);
+}
+EXPORT_SYMBOL(__kfree_skb_defer);
+
+/**
+ *	__kfree_skb_flush - free the buffers deferred by __kfree_skb_defer()
+ */
+void __kfree_skb_flush(void)
+{
+	struct napi_skb_cache *nc = &__get_cpu_var(napi_skb_cache);
+
+	if (nc->fclone_count) {
+		kmem_cache_free_bulk(skbuff_fclone_cache, nc->fclone_count,
+				     nc->fclone_cache);
+		nc->fclone_count = 0;
+	}
+}
+EXPORT_SYMBOL(__kfree_skb_flush);
+
 /**
  *	kfree_skb - free an sk_buff
  *	@skb: buffer to free
@@ -485,6 +607,26 @@ void consume_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(consume_skb);
 
+/**
+ *	napi_consume_skb - free an skbuff from NAPI context
+ *	@skb: buffer to free
+ *
+ *	Functions identically to consume_skb, but from NAPI context the memory
+ *	is returned in bulk, see __kfree_skb_defer().
+ */
+void napi_consume_skb(struct sk_buff *skb)
+{
+	if (unlikely(!skb))
+		return;
+	if (likely(atomic_read(&skb->users) == 1))
+		smp_rmb();
+	else if (likely(!atomic_dec_and_test(&skb->users)))
+		return;
+	trace_consume_skb(skb);
+	__kfree_skb_defer(skb);
+}
+EXPORT_SYMBOL(napi_consume_skb);
+
 /**
  * 	skb_recycle - clean up an skb for reuse
  * 	@skb: buffer